@@ -0,0 +1,878 @@
+#include "Benchmark.h"
+#include "BlockCompression.h"
+#include "PovLoader.h"
+#include "MappedFile.h"
+#include "GpuResources.h"
+#include "ImageEncoders.h"
+#include "Image.h"
+#include "MaskBitmap.h"
+#include "Scene.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// each measurement is the best of this many runs
+const int RUNS = 5;
+
+// timings compared against by recordTiming() (the most recent ones)
+const int HISTORY = 5;
+
+/*
+* Runs the function RUNS times and returns the fastest time in milliseconds
+*/
+template <typename Function>
+static double bestOf(Function function)
+{
+	double best = 1e30;
+
+	for (int run = 0; run < RUNS; run++)
+	{
+		auto start = chrono::steady_clock::now();
+		function();
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+		best = min(best, elapsed.count());
+	}
+
+	return best;
+}
+
+void benchLoad(const string& filename)
+{
+	double megabytes = MappedFile(filename).size() / (1024.0 * 1024.0);
+	unsigned cores = max(1u, thread::hardware_concurrency());
+
+	size_t triangles = 0;
+	double single = 0;
+
+	cout << "Loading " << filename << " (" << megabytes << " MB)" << endl;
+
+	for (unsigned threads = 1; ; threads = min(threads * 2, cores))
+	{
+		double ms = bestOf([&]() { triangles = loadPov(filename, true, threads).size(); });
+		if (threads == 1) single = ms;
+
+		cout << "  " << threads << " threads: " << ms << " ms, " << megabytes / (ms / 1000) << " MB/s, "
+			 << single / ms << "x speedup (" << triangles << " triangles)" << endl;
+
+		if (threads == cores) break;
+	}
+}
+
+void soakReload(Mesh& mesh, const string& filename, int count)
+{
+	auto report = [](int reloads) {
+		const GpuCounters& gpu = gpuCounters();
+		cout << "  " << reloads << " reloads: " << gpu.buffers << " buffers, " << gpu.vertexArrays << " vertex arrays, "
+			 << gpu.bufferBytes / 1024 << " KB, " << gpu.textures << " textures (" << gpu.textureBytes / 1024 << " KB)" << endl;
+	};
+
+	mesh.reload(filename);
+	mesh.setupBuffers();
+
+	size_t startBytes = gpuCounters().bufferBytes;
+	cout << "Reloading " << filename << " " << count << " times" << endl;
+	report(1);
+
+	for (int i = 2; i <= count; i++)
+	{
+		mesh.reload(filename);
+		mesh.setupBuffers();
+
+		if (i % 1000 == 0) report(i);
+	}
+
+	cout << "GPU memory growth: " << (long long)(gpuCounters().bufferBytes - startBytes) << " bytes" << endl;
+}
+
+void benchRays(const string& filename, int side)
+{
+	Mesh mesh(filename);											// triangle list kept: nothing is uploaded
+	mesh.setResidency(Residency::RayQueries);
+	Point lo = mesh.minCorner();
+	Point hi = mesh.maxCorner();
+
+	//rays along -z, spread over the mesh's bounding box
+	int hits = 0;
+	auto start = chrono::steady_clock::now();
+
+	for (int j = 0; j < side; j++)
+	{
+		for (int i = 0; i < side; i++)
+		{
+			float x = lo.x() + (hi.x() - lo.x()) * (i + 0.5f) / side;
+			float y = lo.y() + (hi.y() - lo.y()) * (j + 0.5f) / side;
+
+			Ray ray(Point(x, y, hi.z() + 1, 1), Vector(0, 0, -1));
+			if (mesh.intersect(ray)) hits++;
+		}
+	}
+
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	const RayStats& stats = mesh.rayStats();
+	long long rays = (long long)side * side;
+
+	cout << rays << " rays through " << filename << " (" << mesh.triangleCount() << " triangles): " << hits << " hits, "
+		 << elapsed.count() * 1000 / rays << " us per ray" << endl;
+
+	if (stats.rays > 0)
+	{
+		cout << "  " << (double)stats.candidates / stats.rays << " triangle hits per ray, " << (double)stats.shaded / stats.rays
+			 << " resolved: " << (double)(stats.candidates - stats.shaded) / stats.rays << " appearance evaluations saved per ray" << endl;
+	}
+}
+
+void benchShading(const string& filename, int count)
+{
+	//small generated images: gradient texture, checkered mask (3/4 visible), rippled bump map
+	const int SIZE = 64;
+	filesystem::path folder = filesystem::temp_directory_path();
+	string names[3] = { (folder / "bench_texture.ppm").string(), (folder / "bench_mask.ppm").string(), (folder / "bench_bump.ppm").string() };
+
+	Image texture(SIZE, SIZE), mask(SIZE, SIZE), bump(SIZE, SIZE);
+	for (int y = 0; y < SIZE; y++)
+	{
+		for (int x = 0; x < SIZE; x++)
+		{
+			float ripple = 0.5f + 0.5f * sin(x * 0.7f) * cos(y * 0.5f);
+
+			texture.setPixel(x, y, Color(x / (float)SIZE, y / (float)SIZE, 0.5f));
+			mask.setPixel(x, y, (x / 8 % 2 && y / 8 % 2) ? Color(0, 0, 0) : Color(1, 1, 1));
+			bump.setPixel(x, y, Color(ripple, ripple, ripple));
+		}
+	}
+	texture.saveImage(names[0]);
+	mask.saveImage(names[1]);
+	bump.saveImage(names[2]);
+
+	//hits spread over the images (the kernels only depend on u, v and the normal)
+	vector<Hit> hits(count);
+	for (Hit& hit : hits)
+	{
+		Unit normal(genFloat() - 0.5f, genFloat() - 0.5f, genFloat() - 0.5f);
+		hit = Hit{ Point(genFloat(), genFloat(), genFloat(), 1), normal, Color(1, 1, 1), genFloat(), {}, genFloat(), genFloat() };
+	}
+
+	//both must agree: same visible hits, same colors and normals
+	auto run = [&](auto resolve, int& visible, double& checksum) {
+		visible = 0;
+		checksum = 0;
+		for (const Hit& hit : hits)
+		{
+			optional<Hit> resolved = resolve(hit);
+			if (!resolved) continue;
+
+			visible++;
+			checksum += resolved->color.r() + resolved->color.g() + resolved->normal.x() + resolved->normal.z();
+		}
+	};
+
+	//with every image, then solid colored (where the per hit decisions are all that is left to save)
+	string appearances[2] = { "texture " + names[0] + " mask " + names[1] + " bump_map " + names[2], "solid rgb <1, 0.5, 0>" };
+	string labels[2] = { "textured, masked, bump mapped", "solid colored" };
+
+	for (int i = 0; i < 2; i++)
+	{
+		Mesh mesh;
+		istringstream description("source " + filename + " smooth direct scale 1 translate <0, 0, 0> " + appearances[i] + " end");
+		description >> mesh;
+
+		int dynamicVisible, kernelVisible;
+		double dynamicSum, kernelSum;
+		double dynamicMs = bestOf([&]() { run([&](const Hit& hit) { return mesh.updateHitDynamic(hit); }, dynamicVisible, dynamicSum); });
+		double kernelMs = bestOf([&]() { run([&](const Hit& hit) { return mesh.updateHit(hit); }, kernelVisible, kernelSum); });
+
+		cout << count << " hits on a " << labels[i] << " " << filename << " (" << kernelVisible << " visible)" << endl;
+		cout << "  per hit decisions: " << dynamicMs << " ms, load time kernel: " << kernelMs << " ms (" << dynamicMs / kernelMs << "x)"
+			 << (dynamicVisible == kernelVisible && dynamicSum == kernelSum ? "" : ", RESULTS DIFFER") << endl;
+	}
+
+	for (const string& name : names) filesystem::remove(name);
+}
+
+
+void benchInstances(const string& meshFile, int copies, int side)
+{
+	Mesh sample(meshFile);
+	Vector extent(sample.minCorner(), sample.maxCorner());
+	float meshScale = 0.8f / max(extent.x(), max(extent.y(), extent.z()));
+	int columns = (int)ceil(sqrt((float)copies));
+	float spacing = 2.0f / columns;
+
+	//the copies in a columns x columns grid over [-1, 1]^2, each turned its own way
+	string filename = (filesystem::temp_directory_path() / "bench_instances.txt").string();
+	{
+		ofstream ofs(filename);
+		ofs << "group translate <0, 0, 0> scale <" << spacing << ", " << spacing << ", " << spacing << "> rotate <0, 0, 0>" << endl;
+		ofs << "mesh source " << meshFile << " smooth none scale " << meshScale << " translate <" << 0.5f - columns / 2.0f << ", "
+			<< 0.5f - columns / 2.0f << ", 0> solid rgb <1, 1, 1> end" << endl;
+
+		for (int i = 1; i < copies; i++)
+		{
+			ofs << "instance 0 translate <" << i % columns + 0.5f - columns / 2.0f << ", " << i / columns + 0.5f - columns / 2.0f
+				<< ", 0> scale " << meshScale << " rotate <0, " << genFloat() * 360 << ", 0>" << endl;
+		}
+		ofs << "end_group" << endl;
+	}
+
+	Scene scene;
+	double loadMs = bestOf([&]() { scene.load(filename); });
+	filesystem::remove(filename);
+
+	Mesh* copy = nullptr;
+	double meshMs = bestOf([&]() { delete copy; copy = new Mesh(meshFile); copy->setResidency(Residency::RayQueries); });
+	size_t meshBytes = copy->cpuBytes();
+	delete copy;
+
+	cout << copies << " copies of " << meshFile << " (" << sample.triangleCount() << " triangles), " << scene.instanceCount() << " of them instances" << endl;
+	cout << "  load: " << loadMs << " ms, " << (meshBytes + scene.rayArrays().instanceTreeBytes()) / 1e6 << " MB (one mesh and the instance hierarchy); "
+		 << "one mesh per copy: " << meshMs * copies << " ms, " << meshBytes * copies / 1e6 << " MB" << endl;
+
+	//rays along -z, covering the grid
+	vector<Ray> rays;
+	for (int j = 0; j < side; j++)
+	{
+		for (int i = 0; i < side; i++)
+		{
+			rays.emplace_back(Point(2.2f * (i + 0.5f) / side - 1.1f, 2.2f * (j + 0.5f) / side - 1.1f, 3, 1), Vector(0, 0, -1));
+		}
+	}
+
+	//every query is checked against testing every instance in turn
+	auto trace = [&](const string& label) {
+		vector<optional<Hit>> flatHits(rays.size()), treeHits(rays.size());
+		double flatMs = bestOf([&]() { for (size_t i = 0; i < rays.size(); i++) flatHits[i] = scene.intersectVirtual(rays[i]); });
+		double treeMs = bestOf([&]() { for (size_t i = 0; i < rays.size(); i++) treeHits[i] = scene.intersect(rays[i]); });
+
+		int hits = 0, mismatches = 0;
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			if (treeHits[i]) hits++;
+			if (flatHits[i].has_value() != treeHits[i].has_value() || (treeHits[i] && fabs(flatHits[i]->t - treeHits[i]->t) >= 1e-3f)) mismatches++;
+		}
+
+		cout << "  " << label << ": " << hits << " hits, every instance: " << flatMs * 1000 / rays.size() << " us per ray, instance hierarchy: "
+			 << treeMs * 1000 / rays.size() << " us per ray (" << flatMs / treeMs << "x)";
+		if (mismatches) cout << ", " << mismatches << " RESULTS DIFFER";
+		cout << endl;
+	};
+
+	trace("placed");
+
+	//rigid motion: every instance turns and drifts a little, as from one frame to the next
+	for (int i = 1; i < scene.placementCount(); i++)
+	{
+		scene.place(i, { i % columns + 0.5f - columns / 2.0f + (genFloat() - 0.5f) * 0.5f, i / columns + 0.5f - columns / 2.0f + (genFloat() - 0.5f) * 0.5f, genFloat() - 0.5f },
+					{ meshScale, meshScale, meshScale }, { genFloat() * 360, genFloat() * 360, 0 });
+	}
+
+	double refitMs = bestOf([&]() { scene.refit(); });
+	trace("moved, refit in " + to_string(refitMs) + " ms");
+
+	double rebuildMs = bestOf([&]() { scene.rebuild(); });
+	trace("moved, rebuilt in " + to_string(rebuildMs) + " ms");
+}
+
+
+void benchBvhCache(const string& meshFile)
+{
+	filesystem::path cache = filesystem::temp_directory_path() / "bench_bvh_cache";
+	filesystem::remove_all(cache);
+	Mesh::setBvhCache(cache.string());
+
+	//cold: nothing saved yet, the load builds the hierarchy and saves it; warm: the load maps it
+	auto start = chrono::steady_clock::now();
+	Mesh cold(meshFile);
+	cold.setResidency(Residency::RayQueries);
+	chrono::duration<double, milli> coldMs = chrono::steady_clock::now() - start;
+
+	start = chrono::steady_clock::now();
+	Mesh warm(meshFile);
+	warm.setResidency(Residency::RayQueries);
+	chrono::duration<double, milli> warmMs = chrono::steady_clock::now() - start;
+
+	//the hierarchy steps alone
+	vector<Triangle> triangles = loadPov(meshFile, true);
+	double buildMs = bestOf([&]() {
+		Bvh bvh;
+		bvh.build((int)triangles.size(), [&](int i, Point corners[3]) {
+			corners[0] = triangles[i].v1.point;
+			corners[1] = triangles[i].v2.point;
+			corners[2] = triangles[i].v3.point;
+		});
+	});
+
+	uint64_t key = 0;
+	double hashMs = bestOf([&]() { key = warm.contentHash(); });
+
+	string cacheFile;
+	for (const auto& entry : filesystem::directory_iterator(cache)) cacheFile = entry.path().string();
+	double mapMs = bestOf([&]() { Bvh bvh; bvh.map(cacheFile, key); });
+
+	cout << meshFile << " (" << warm.triangleCount() << " triangles), hierarchy " << (warm.bvhMapped() ? "mapped" : "NOT MAPPED")
+		 << " from " << filesystem::file_size(cacheFile) / 1e6 << " MB" << endl;
+	cout << "  load: " << coldMs.count() << " ms building the hierarchy, " << warmMs.count() << " ms mapping it" << endl;
+	cout << "  hierarchy: build " << buildMs << " ms, hash " << hashMs << " ms + map " << mapMs << " ms ("
+		 << buildMs / (hashMs + mapMs) << "x, " << buildMs - hashMs - mapMs << " ms saved)" << endl;
+
+	//the mapped tree answers like the built one (rays from around the mesh, toward its center)
+	Point center((cold.minCorner().x() + cold.maxCorner().x()) / 2, (cold.minCorner().y() + cold.maxCorner().y()) / 2,
+				 (cold.minCorner().z() + cold.maxCorner().z()) / 2, 1);
+	Vector reach(cold.minCorner(), cold.maxCorner());
+
+	int mismatches = 0;
+	for (int i = 0; i < 10000; i++)
+	{
+		Point origin(center.x() + (genFloat() - 0.5f) * 2 * reach.x(), center.y() + (genFloat() - 0.5f) * 2 * reach.y(),
+					 center.z() + (genFloat() - 0.5f) * 2 * reach.z(), 1);
+		Ray ray(origin, Vector(origin, center));
+
+		optional<Hit> a = cold.intersect(ray), b = warm.intersect(ray);
+		if (a.has_value() != b.has_value() || (a && a->t != b->t)) mismatches++;
+	}
+	if (mismatches) cout << "  " << mismatches << " RESULTS DIFFER" << endl;
+
+	filesystem::remove_all(cache);
+	Mesh::setBvhCache("mesh_cache");
+}
+
+void benchCompression(int side)
+{
+	//color noise over smooth gradients, a soft edged disc, and ripples
+	Image texture(side, side, PixelFormat::RGB8), mask(side, side, PixelFormat::R8), bump(side, side, PixelFormat::R8);
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			float dx = (x + 0.5f) / side - 0.5f, dy = (y + 0.5f) / side - 0.5f;
+			float edge = clamp((0.4f - sqrt(dx * dx + dy * dy)) * side / 4, 0.0f, 1.0f);
+			float ripple = 0.5f + 0.5f * sin(x * 0.05f) * cos(y * 0.07f);
+			float noise = (genFloat() - 0.5f) * 0.1f;
+
+			texture.setPixel(x, y, Color(clamp(x / (float)side + noise, 0.0f, 1.0f), y / (float)side, ripple));
+			mask.setPixel(x, y, Color(edge, edge, edge));
+			bump.setPixel(x, y, Color(ripple, ripple, ripple));
+		}
+	}
+
+	//what the blocks should decode to, as 8 bit channels (color: rgb, mask: gray, bump: du, dv moved into [0, 1])
+	auto channels = [&](const Image& image, BlockFormat format) {
+		vector<unsigned char> bytes;
+		auto level = [](float value) { return (unsigned char)(clamp(value, 0.0f, 1.0f) * 255 + 0.5f); };
+
+		for (int y = 0; y < side; y++)
+		{
+			for (int x = 0; x < side; x++)
+			{
+				Color c = image.getPixel(x, y);
+				if (format == BlockFormat::BC1) bytes.insert(bytes.end(), { level(c.r()), level(c.g()), level(c.b()) });
+				else if (format == BlockFormat::BC4) bytes.push_back(level(c.r()));
+				else bytes.insert(bytes.end(), { level(c.r()), level(c.g()) });
+			}
+		}
+		return bytes;
+	};
+
+	struct Case { const char* name; const Image& image; BlockFormat format; int uncompressedBytes; };
+	const Case cases[] = { { "texture BC1", texture, BlockFormat::BC1, 4 },		// 8 bit color textures are RGBA8 on the GPU
+		{ "mask BC4", mask, BlockFormat::BC4, 1 }, { "bump map BC5", bump, BlockFormat::BC5, 2 } };
+
+	unsigned cores = max(1u, thread::hardware_concurrency());
+	double megatexels = (double)side * side / 1e6;
+
+	cout << side << "x" << side << " images, encoded on 1 and " << cores << " threads" << endl;
+	for (const Case& c : cases)
+	{
+		CompressedImage compressed;
+		double singleMs = bestOf([&]() { compressed = compressImage(c.image, c.format, 1); });
+		double parallelMs = bestOf([&]() { compressed = compressImage(c.image, c.format); });
+
+		//source and decoded blocks compared as 8 bit channels (the bump map's source is its gradient)
+		Image source(side, side);
+		for (int y = 0; y < side; y++)
+		{
+			for (int x = 0; x < side; x++)
+			{
+				auto [du, dv] = c.image.gradient_wh((float)x, (float)y);
+				source.setPixel(x, y, c.format == BlockFormat::BC5 ? Color(du + 0.5f, dv + 0.5f, 0) : c.image.getPixel(x, y));
+			}
+		}
+		vector<unsigned char> expected = channels(source, c.format), decoded = channels(decompressImage(compressed), c.format);
+
+		size_t gpuBytes = (size_t)side * side * c.uncompressedBytes;
+		cout << "  " << c.name << ": " << megatexels * 1000 / singleMs << " Mtexels/s on 1 thread, " << megatexels * 1000 / parallelMs
+			 << " on " << cores << " (" << singleMs / parallelMs << "x); " << gpuBytes / 1e6 << " MB -> " << compressed.blocks.size() / 1e6
+			 << " MB (" << (double)gpuBytes / compressed.blocks.size() << "x), PSNR " << psnr(expected.data(), decoded.data(), expected.size()) << " dB" << endl;
+	}
+
+	//through the cache: the first call encodes and saves, the next reads the blocks back
+	filesystem::path cache = filesystem::temp_directory_path() / "bench_texture_cache";
+	filesystem::remove_all(cache);
+	setTextureCache(cache.string());
+
+	bool cached = false;
+	auto start = chrono::steady_clock::now();
+	cachedCompress(texture, BlockFormat::BC1);
+	chrono::duration<double, milli> coldMs = chrono::steady_clock::now() - start;
+	double warmMs = bestOf([&]() { cachedCompress(texture, BlockFormat::BC1, &cached); });
+
+	cout << "  texture through the cache: " << coldMs.count() << " ms encoding and saving, " << warmMs << " ms "
+		 << (cached ? "reading it back" : "NOT READ BACK") << " (hash included)" << endl;
+
+	filesystem::remove_all(cache);
+	setTextureCache("texture_cache");
+}
+
+void benchSave(int side)
+{
+	//like a rendered frame: flat background, shaded discs, a noisy (textured) band
+	Image frame(side, side);
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			float dx = (x % (side / 4) - side / 8.0f) / (side / 8.0f), dy = (y % (side / 4) - side / 8.0f) / (side / 8.0f);
+			float shade = max(0.0f, 1 - dx * dx - dy * dy);
+			float noise = y > side / 2 && y < side * 3 / 4 ? genFloat() * 0.2f : 0;
+
+			frame.setPixel(x, y, shade > 0 ? Color(shade, min(1.0f, shade * 0.5f + noise), 0.2f) : Color(0.1f, 0.1f, 0.3f + noise));
+		}
+	}
+
+	filesystem::path folder = filesystem::temp_directory_path();
+	string ppm = (folder / "bench_frame.ppm").string();
+	unsigned cores = max(1u, thread::hardware_concurrency());
+
+	//the old writer: one stream insertion per channel, each pixel looked up (and wrapped) by getPixel
+	double streamMs = bestOf([&]() {
+		ofstream ofs(ppm, ios::binary);
+		ofs << "P6" << endl << side << "\t" << side << endl << 255 << endl;
+		for (int y = 0; y < side; y++)
+		{
+			for (int x = 0; x < side; x++)
+			{
+				Color c = frame.getPixel(x, y);
+				ofs << (unsigned char)(255 * c.r() + 0.5f) << (unsigned char)(255 * c.g() + 0.5f) << (unsigned char)(255 * c.b() + 0.5f);
+			}
+		}
+	});
+	size_t streamSize = filesystem::file_size(ppm);
+	cout << side << "x" << side << " frame" << endl;
+	cout << "  PPM through the stream: " << streamMs << " ms, " << streamSize / 1e6 << " MB" << endl;
+
+	auto save = [&](const string& name) {
+		string file = (folder / name).string();
+		double ms = bestOf([&]() { frame.saveImage(file); });
+		cout << "  " << name << ": " << ms << " ms (" << streamMs / ms << "x the stream), " << filesystem::file_size(file) / 1e6 << " MB" << endl;
+		filesystem::remove(file);
+	};
+	save("bench_frame.ppm");
+	save("bench_frame.qoi");
+	save("bench_frame.png");
+
+	//the PNG encoder alone, by thread count (conversion to bytes excluded)
+	vector<unsigned char> bytes = frame.rgbBytes();
+	double convertMs = bestOf([&]() { bytes = frame.rgbBytes(); });
+	double singleMs = bestOf([&]() { encodePng(bytes.data(), side, side, 1); });
+	double parallelMs = bestOf([&]() { encodePng(bytes.data(), side, side, cores); });
+
+	cout << "  to 8 bit: " << convertMs << " ms; PNG encode " << singleMs << " ms on 1 thread, " << parallelMs << " ms on "
+		 << cores << " (" << singleMs / parallelMs << "x)" << endl;
+}
+
+/*
+* Mask visibility: gray lookups against the 1 bit per texel bitmap (see Benchmark.h)
+*/
+void benchMask(int side, int count)
+{
+	//a disc with a soft edge, crossed by transparent stripes, on a transparent background
+	Image mask(side, side);
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			float dx = (x + 0.5f) / side - 0.5f, dy = (y + 0.5f) / side - 0.5f;
+			float edge = clamp((0.4f - sqrt(dx * dx + dy * dy)) * side / 4, 0.0f, 1.0f);
+			if ((x / 16) % 4 == 0) edge = 0;
+
+			mask.setPixel(x, y, Color(edge, edge, edge));
+		}
+	}
+
+	MaskBitmap bits;
+	double convertMs = bestOf([&]() { bits = MaskBitmap(mask); });
+
+	//lookups spread past the edges, where they wrap around
+	vector<pair<float, float>> uvs(count);
+	for (auto& [u, v] : uvs) u = genFloat() * 2 - 0.5f, v = genFloat() * 2 - 0.5f;
+
+	int grayVisible = 0, bitVisible = 0, mismatches = 0;
+	vector<char> grayAnswers(count), bitAnswers(count);
+	double grayMs = bestOf([&]() { for (int i = 0; i < count; i++) grayAnswers[i] = mask.gray_uv(uvs[i].first, uvs[i].second) > 0; });
+	double bitMs = bestOf([&]() { for (int i = 0; i < count; i++) bitAnswers[i] = bits.visible(uvs[i].first, uvs[i].second); });
+
+	for (int i = 0; i < count; i++)
+	{
+		grayVisible += grayAnswers[i];
+		bitVisible += bitAnswers[i];
+		mismatches += grayAnswers[i] != bitAnswers[i];
+	}
+
+	cout << side << "x" << side << " mask: " << mask.memoryBytes() / 1e6 << " MB of colors, " << bits.memoryBytes() / 1e6
+		 << " MB of bits and pyramid (converted in " << convertMs << " ms)" << endl;
+	cout << "  " << count << " lookups, " << grayVisible << " visible: gray lookups " << grayMs * 1e6 / count << " ns each, bit tests "
+		 << bitMs * 1e6 / count << " ns each (" << grayMs / bitMs << "x)";
+	if (mismatches) cout << ", " << mismatches << " RESULTS DIFFER";
+	cout << endl;
+
+	//regions the pyramid calls fully hidden or fully visible must be so at every sampled point
+	int decided = 0, wrong = 0;
+	const int REGIONS = 2000, SAMPLES = 64;
+	for (int r = 0; r < REGIONS; r++)
+	{
+		float u0 = genFloat() * 2 - 0.5f, v0 = genFloat() * 2 - 0.5f, size = genFloat() * genFloat() * 0.5f;
+		MaskCoverage c = bits.coverage(u0, v0, u0 + size, v0 + size);
+		if (c == MaskCoverage::Partial) continue;
+
+		decided++;
+		for (int i = 0; i < SAMPLES; i++)
+		{
+			bool visible = mask.gray_uv(u0 + genFloat() * size, v0 + genFloat() * size) > 0;
+			if (visible != (c == MaskCoverage::Full))
+			{
+				wrong++;
+				break;
+			}
+		}
+	}
+
+	cout << "  coverage: " << decided << " of " << REGIONS << " regions found fully hidden or visible";
+	if (wrong) cout << ", " << wrong << " WRONG";
+	cout << endl;
+}
+
+
+void benchImages(int side, int count)
+{
+	//smooth color gradients, and ripples for the gray (bump) values
+	Image texture(side, side), bump(side, side);
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			float ripple = 0.5f + 0.5f * sin(x * 0.05f) * cos(y * 0.07f);
+			texture.setPixel(x, y, Color(x / (float)side, y / (float)side, ripple));
+			bump.setPixel(x, y, Color(ripple, ripple, ripple));
+		}
+	}
+
+	vector<pair<float, float>> uvs(count);
+	for (auto& [u, v] : uvs) u = genFloat(), v = genFloat();
+
+	//the float lookups, which every format is compared against
+	vector<Color> colors(count);
+	vector<float> grays(count);
+	vector<pair<float, float>> gradients(count);
+	for (int i = 0; i < count; i++)
+	{
+		colors[i] = texture.rgb_uv(uvs[i].first, uvs[i].second);
+		grays[i] = bump.gray_uv(uvs[i].first, uvs[i].second);
+		gradients[i] = bump.gradient(uvs[i].first, uvs[i].second);
+	}
+
+	const pair<PixelFormat, const char*> formats[] = { { PixelFormat::RGB32F, "RGB32F" }, { PixelFormat::RGB16F, "RGB16F" },
+		{ PixelFormat::R16F, "R16F" }, { PixelFormat::RGB8, "RGB8" }, { PixelFormat::R8, "R8" } };
+
+	cout << side << "x" << side << " images, " << count << " lookups each" << endl;
+	for (auto [format, name] : formats)
+	{
+		Image stored(texture, format), storedBump(bump, format);
+		bool gray = format == PixelFormat::R16F || format == PixelFormat::R8;
+
+		//gray formats only hold bump maps: their color lookups are not timed
+		float colorError = 0, grayError = 0, gradientError = 0;
+		double colorMs = gray ? 0 : bestOf([&]() {
+			for (int i = 0; i < count; i++)
+			{
+				Color c = stored.rgb_uv(uvs[i].first, uvs[i].second);
+				colorError = max({ colorError, abs(c.r() - colors[i].r()), abs(c.g() - colors[i].g()), abs(c.b() - colors[i].b()) });
+			}
+		});
+		double grayMs = bestOf([&]() {
+			for (int i = 0; i < count; i++)
+			{
+				float g = storedBump.gray_uv(uvs[i].first, uvs[i].second);
+				grayError = max(grayError, abs(g - grays[i]));
+			}
+		});
+		double gradientMs = bestOf([&]() {
+			for (int i = 0; i < count; i++)
+			{
+				auto [du, dv] = storedBump.gradient(uvs[i].first, uvs[i].second);
+				gradientError = max({ gradientError, abs(du - gradients[i].first), abs(dv - gradients[i].second) });
+			}
+		});
+
+		cout << "  " << name << ": " << (gray ? storedBump : stored).memoryBytes() / 1e6 << " MB";
+		if (!gray) cout << ", color " << colorMs * 1e6 / count << " ns (max error " << colorError << ")";
+		cout << ", gray " << grayMs * 1e6 / count << " ns (max error " << grayError << "), gradient "
+			 << gradientMs * 1e6 / count << " ns (max error " << gradientError << ")" << endl;
+	}
+}
+
+/*
+* Writes a scene file of 'spheres' random spheres spread through [-1, 1]^3 (in a rotated group)
+* and a 4x4 grid of instances of a mesh behind them, returning its name
+*/
+static string writeBenchScene(const string& meshFile, int spheres)
+{
+	Mesh sample(meshFile);
+	Vector extent(sample.minCorner(), sample.maxCorner());
+	float meshScale = 0.4f / max(extent.x(), max(extent.y(), extent.z()));
+
+	string filename = (filesystem::temp_directory_path() / "bench_scene.txt").string();
+	ofstream ofs(filename);
+
+	ofs << "group translate <0, 0, 0> scale <1, 1, 1> rotate <0, 30, 0>" << endl;
+	for (int i = 0; i < spheres; i++)
+	{
+		ofs << "sphere center <" << genFloat() * 2 - 1 << ", " << genFloat() * 2 - 1 << ", " << genFloat() * 2 - 1 << "> radius "
+			<< 0.01f + genFloat() * 0.03f << " solid rgb <" << genFloat() << ", " << genFloat() << ", " << genFloat() << "> end" << endl;
+	}
+	ofs << "end_group" << endl;
+
+	for (int i = 0; i < 16; i++)
+	{
+		ofs << "mesh source " << meshFile << " smooth none scale " << meshScale << " translate <" << (i % 4) * 0.5f - 0.75f << ", "
+			<< (i / 4) * 0.5f - 0.75f << ", -1.5> solid rgb <1, 1, 1> end" << endl;
+	}
+
+	return filename;
+}
+
+void benchScene(const string& meshFile, int spheres, int side)
+{
+	string filename = writeBenchScene(meshFile, spheres);
+
+	Scene scene;
+	scene.load(filename);
+	filesystem::remove(filename);
+
+	const ShapeArrays& arrays = scene.rayArrays();
+	cout << side * side << " rays through " << arrays.sphereCount() << " spheres and " << arrays.meshCount() << " instances of " << meshFile
+#ifdef __AVX__
+		 << " (AVX)"
+#endif
+		 << endl;
+
+	//rays along -z, covering the scene
+	vector<Ray> rays;
+	for (int j = 0; j < side; j++)
+	{
+		for (int i = 0; i < side; i++)
+		{
+			rays.emplace_back(Point(2.4f * (i + 0.5f) / side - 1.2f, 2.4f * (j + 0.5f) / side - 1.2f, 3, 1), Vector(0, 0, -1));
+		}
+	}
+
+	vector<optional<Hit>> virtualHits(rays.size()), arrayHits(rays.size());
+	double virtualMs = bestOf([&]() { for (size_t i = 0; i < rays.size(); i++) virtualHits[i] = scene.intersectVirtual(rays[i]); });
+	double arrayMs = bestOf([&]() { for (size_t i = 0; i < rays.size(); i++) arrayHits[i] = scene.intersect(rays[i]); });
+
+	//both must find the same hits (distances only differ by float rounding); rounding can also decide
+	//rays that barely graze a sphere either way, so those are counted apart
+	int hits = 0, grazing = 0, mismatches = 0;
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		const optional<Hit>& a = virtualHits[i];
+		const optional<Hit>& b = arrayHits[i];
+		if (b) hits++;
+
+		if (a.has_value() == b.has_value() && (!b || fabs(a->t - b->t) < 1e-3f)) continue;
+
+		const Hit& closer = !a ? *b : !b ? *a : a->t < b->t ? *a : *b;
+		if (fabs(dot(closer.normal, rays[i].dir())) < 0.05f) grazing++;
+		else mismatches++;
+	}
+
+	cout << "  " << hits << " hits, per object virtual calls: " << virtualMs * 1000 / rays.size() << " us per ray, per type arrays: "
+		 << arrayMs * 1000 / rays.size() << " us per ray (" << virtualMs / arrayMs << "x)";
+	if (grazing) cout << ", " << grazing << " grazing hits decided differently";
+	if (mismatches) cout << ", " << mismatches << " RESULTS DIFFER";
+	cout << endl;
+}
+
+void benchPackets(const string& meshFile, int spheres, int side, const string& output)
+{
+	string filename = writeBenchScene(meshFile, spheres);
+
+	Scene scene;
+	scene.load(filename);
+	filesystem::remove(filename);
+
+	//pinhole camera at z = 3 looking down -z, 45 degree field of view
+	const float HALF_VIEW = tan(PI / 8);
+	auto primaryRay = [&](int x, int y) {
+		float px = ((x + 0.5f) / side * 2 - 1) * HALF_VIEW;
+		float py = (1 - (y + 0.5f) / side * 2) * HALF_VIEW;
+		return Ray(Point(0, 0, 3, 1), Vector(px, py, -1));
+	};
+
+	//headlight shading, enough to compare the images
+	auto shade = [](const optional<Hit>& hit, const Ray& ray) {
+		if (!hit) return Color(0, 0, 0);
+		float light = 0.2f + 0.8f * fabs(dot(hit->normal, ray.dir()));
+		return Color(hit->color.r() * light, hit->color.g() * light, hit->color.b() * light);
+	};
+
+	Image single(side, side), packed(side, side);
+
+	double singleMs = bestOf([&]() {
+		for (int y = 0; y < side; y++)
+		{
+			for (int x = 0; x < side; x++)
+			{
+				Ray ray = primaryRay(x, y);
+				single.setPixel(x, y, shade(scene.intersect(ray), ray));
+			}
+		}
+	});
+
+	//4x2 pixel tiles (lanes outside the image stay idle)
+	double packetMs = bestOf([&]() {
+		for (int y = 0; y < side; y += 2)
+		{
+			for (int x = 0; x < side; x += 4)
+			{
+				RayPacket packet;
+				for (int lane = 0; lane < RayPacket::SIZE; lane++)
+				{
+					int px = x + lane % 4, py = y + lane / 4;
+					if (px < side && py < side) packet.set(lane, primaryRay(px, py));
+				}
+
+				optional<Hit> hits[RayPacket::SIZE];
+				scene.intersect(packet, hits);
+
+				for (int lane = 0; lane < RayPacket::SIZE; lane++)
+				{
+					if (packet.active & (1u << lane)) packed.setPixel(x + lane % 4, y + lane / 4, shade(hits[lane], packet.ray(lane)));
+				}
+			}
+		}
+	});
+
+	//the packets must see the same scene (up to float rounding)
+	int differing = 0;
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			Color a = single.getPixel(x, y), b = packed.getPixel(x, y);
+			if (fabs(a.r() - b.r()) + fabs(a.g() - b.g()) + fabs(a.b() - b.b()) > 1e-3f) differing++;
+		}
+	}
+
+	PacketStats stats = scene.rayArrays().packetStats();
+
+	cout << side << "x" << side << " primary rays through " << scene.rayArrays().sphereCount() << " spheres and "
+		 << scene.rayArrays().meshCount() << " instances of " << meshFile
+#ifdef __AVX__
+		 << " (AVX)"
+#endif
+		 << endl;
+	cout << "  single rays: " << singleMs << " ms, packets of " << RayPacket::SIZE << ": " << packetMs << " ms (" << singleMs / packetMs << "x)";
+	if (differing) cout << ", " << differing << " PIXELS DIFFER";
+	cout << endl;
+	cout << "  mesh traversal: " << stats.laneUtilization() * 100 << "% lane utilization, "
+		 << (double)stats.nodeVisits / max(1LL, stats.packets) << " node visits per packet, "
+		 << (double)stats.singleRays / max(1LL, stats.packets) << " rays finished alone per packet" << endl;
+
+	if (!output.empty()) packed.saveImage(output);
+}
+
+GoldenDiff compareGolden(const vector<unsigned char>& frame, int width, int height, const string& goldenFile, int tolerance, int grid)
+{
+	GoldenDiff diff;
+	diff.badPixels.assign(grid * grid, 0);
+
+	if (!filesystem::exists(goldenFile))
+	{
+		Image golden(width, height);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				const unsigned char* pixel = &frame[((size_t)y * width + x) * 3];
+				golden.setPixel(x, y, Color(pixel[0] / 255.0f, pixel[1] / 255.0f, pixel[2] / 255.0f));
+			}
+		}
+
+		golden.saveImage(goldenFile);
+		diff.created = true;
+		diff.psnr = INFINITY;
+		return diff;
+	}
+
+	Image golden(goldenFile);
+	if (golden.getWidth() != width || golden.getHeight() != height)
+	{
+		diff.sizeMismatch = true;
+		return diff;
+	}
+
+	vector<unsigned char> expected(frame.size());
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			Color color = golden.getPixel(x, y);
+			size_t at = ((size_t)y * width + x) * 3;
+
+			expected[at] = (unsigned char)(255 * color.r() + 0.5f);
+			expected[at + 1] = (unsigned char)(255 * color.g() + 0.5f);
+			expected[at + 2] = (unsigned char)(255 * color.b() + 0.5f);
+
+			bool off = false;
+			for (int channel = 0; channel < 3; channel++) off |= abs(frame[at + channel] - expected[at + channel]) > tolerance;
+
+			if (off) diff.badPixels[min(y * grid / height, grid - 1) * grid + min(x * grid / width, grid - 1)]++;
+		}
+	}
+
+	diff.psnr = psnr(frame.data(), expected.data(), frame.size());
+	return diff;
+}
+
+bool recordTiming(const string& historyFile, const string& name, double ms, double slack)
+{
+	//earlier timings of the same name, oldest first
+	vector<double> earlier;
+	ifstream in(historyFile);
+	string line;
+
+	while (getline(in, line))
+	{
+		istringstream fields(line);
+		string entry;
+		double entryMs;
+
+		if (fields >> entry >> entryMs && entry == name) earlier.push_back(entryMs);
+	}
+	in.close();
+
+	ofstream(historyFile, ios::app) << name << " " << ms << endl;
+
+	if (earlier.empty()) return true;
+
+	vector<double> recent(earlier.end() - min((int)earlier.size(), HISTORY), earlier.end());
+	nth_element(recent.begin(), recent.begin() + recent.size() / 2, recent.end());
+	double median = recent[recent.size() / 2];
+
+	return ms <= median * (1 + slack);
+}
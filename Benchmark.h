@@ -0,0 +1,114 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+#include "Mesh.h"
+using namespace std;
+
+/*
+* Command line benchmarks (run instead of the openGL window, see main()).
+* Each prints its timings to cout.
+*/
+
+/*
+* Times loading a .pov mesh with 1, 2, 4, ... threads up to one per core
+*/
+void benchLoad(const string& filename);
+
+/*
+* Reloads a mesh (and sets up its buffers) 'count' times, printing the GL objects and
+* buffer memory alive as it goes; both should stay flat. Needs an openGL context.
+*/
+void soakReload(Mesh& mesh, const string& filename, int count);
+
+/*
+* Casts a grid of side x side parallel rays through a .pov mesh (CPU, no context needed), printing the time
+* per ray and how many hit appearances closest-hit-only resolution saved compared to resolving every hit
+*/
+void benchRays(const string& filename, int side);
+
+/*
+* Times resolving 'count' hits on a textured, masked and bump mapped copy of a .pov mesh, with the
+* kernel picked at load time against deciding the mapping and image lookups per hit
+*/
+void benchShading(const string& filename, int count);
+
+/*
+* Times 'count' visibility tests on a generated side x side mask, as bilinear gray lookups against
+* its 1 bit per texel bitmap, checking both agree, and the bitmap's region coverage against sampling
+*/
+void benchMask(int side, int count);
+
+/*
+* Stores a generated side x side texture (color) and bump map (gray) in each pixel format, printing the texel memory,
+* the time of 'count' color, gray and gradient lookups, and the largest difference from the float (RGB32F) lookups
+*/
+void benchImages(int side, int count);
+
+/*
+* Casts a grid of side x side rays through a generated scene of 'spheres' spheres and a 4x4 grid of instances
+* of a .pov mesh, with the per type shape arrays against one virtual intersect() per shape (CPU, no context needed)
+*/
+void benchScene(const string& meshFile, int spheres, int side);
+
+/*
+* Renders the same generated scene from a pinhole camera into a side x side image, one primary ray at a time
+* and in packets of 8 (4x2 pixel tiles), printing both times and the packets' SIMD lane utilization.
+* The packet render is saved to 'output' unless it is empty.
+*/
+void benchPackets(const string& meshFile, int spheres, int side, const string& output);
+
+
+/*
+* Generates a scene of one .pov mesh placed 'copies' times (the mesh once, then instances of it) in a grid,
+* and reports the load time and memory against loading the mesh for each copy, the time of side x side
+* rays down the instance hierarchy against testing every instance, and after moving every instance,
+* the time to refit the hierarchy against building it anew (with the ray time through each)
+*/
+void benchInstances(const string& meshFile, int copies, int side);
+
+/*
+* Loads a .pov mesh with an empty hierarchy cache (the hierarchy is built and saved) and again (it is mapped),
+* printing the time of each step: building against hashing the geometry plus mapping the saved tree
+*/
+void benchBvhCache(const string& meshFile);
+
+/*
+* Block compresses a generated side x side texture (BC1), mask (BC4) and bump map (BC5) on 1 thread and one per core,
+* printing the encode throughput, the GPU memory against 8 bit texels, the error of the decoded blocks,
+* and the time of compressing through the cache when it is empty against reading the blocks back
+*/
+void benchCompression(int side);
+
+/*
+* Saves a generated side x side frame as PPM one channel at a time through the stream (the old writer) and in one write,
+* then as QOI and PNG (on 1 thread and one per core), printing the time and file size of each
+*/
+void benchSave(int side);
+
+/*
+* Differences between a rendered frame and its golden image (see compareGolden())
+*/
+struct GoldenDiff
+{
+	bool created = false;				// there was no golden image: the frame became it
+	bool sizeMismatch = false;			// the golden image has another size (nothing compared)
+	vector<int> badPixels;				// per cell of the grid (rows top first): pixels off by more than the tolerance
+	double psnr = 0;					// of the whole frame against the golden image
+};
+
+/*
+* Compares an 8 bit RGB frame (rows top first) with the golden PPM image 'goldenFile', counting the pixels
+* of each cell of a grid x grid split that have a channel more than 'tolerance' levels off.
+* When the golden image does not exist yet, the frame is saved as it.
+*/
+GoldenDiff compareGolden(const vector<unsigned char>& frame, int width, int height, const string& goldenFile, int tolerance, int grid);
+
+/*
+* Appends a timing to the history file ("name ms" lines) and returns false when it is more than 'slack'
+* (e.g. 0.25 = 25%) slower than the median of the name's last few timings already there.
+*/
+bool recordTiming(const string& historyFile, const string& name, double ms, double slack);
+
+#endif
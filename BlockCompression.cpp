@@ -0,0 +1,499 @@
+#include "BlockCompression.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+// texels along each side of a block
+const int BLOCK = 4;
+
+/*
+* Start of a cached compressed image file (the blocks follow it)
+*/
+struct CompressedFileHeader
+{
+	char magic[8] = { 'B', 'C', 'B', 'L', 'O', 'C', 'K', '1' };
+	uint64_t key = 0;					// content hash of the source image and the format
+	int32_t format = 0;					// BlockFormat
+	int32_t width = 0;
+	int32_t height = 0;
+	int32_t padding = 0;
+};
+
+/*
+* Directory of compressed images, named by content hash (kept in a function like the mesh hierarchy cache,
+* so it is set up before global shapes are loaded)
+*/
+static string& textureCache()
+{
+	static string directory = "texture_cache";
+	return directory;
+}
+
+
+int CompressedImage::blocksWide() const
+{
+	return (width + BLOCK - 1) / BLOCK;
+}
+
+int CompressedImage::blocksHigh() const
+{
+	return (height + BLOCK - 1) / BLOCK;
+}
+
+int CompressedImage::blockBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC5 ? 16 : 8;
+}
+
+
+/*
+* Rounds the 16 values of a block to steps of 1 / scale above 'lo', clamped to [0, steps] (AVX: 8 values at a time)
+*/
+static void quantize(const float values[16], float lo, float scale, int steps, int out[16])
+{
+#ifdef __AVX__
+	__m256 low = _mm256_set1_ps(lo), factor = _mm256_set1_ps(scale), half = _mm256_set1_ps(0.5f);
+	__m256 zero = _mm256_setzero_ps(), top = _mm256_set1_ps((float)steps);
+
+	for (int i = 0; i < 16; i += 8)
+	{
+		__m256 t = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(values + i), low), factor), half);
+		t = _mm256_min_ps(_mm256_max_ps(t, zero), top);
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_cvttps_epi32(t));
+	}
+#else
+	for (int i = 0; i < 16; i++)
+	{
+		float t = (values[i] - lo) * scale + 0.5f;
+		out[i] = (int)min(max(t, 0.0f), (float)steps);
+	}
+#endif
+}
+
+/*
+* 5:6:5 colors: packed from [0, 1] (rounded), and expanded back the way the GPU does
+*/
+static uint16_t pack565(const float rgb[3])
+{
+	auto level = [](float value, int top) { return (int)(min(max(value, 0.0f), 1.0f) * top + 0.5f); };
+	return (uint16_t)((level(rgb[0], 31) << 11) | (level(rgb[1], 63) << 5) | level(rgb[2], 31));
+}
+
+static void unpack565(uint16_t color, float rgb[3])
+{
+	int r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+	rgb[0] = ((r << 3) | (r >> 2)) / 255.0f;
+	rgb[1] = ((g << 2) | (g >> 4)) / 255.0f;
+	rgb[2] = ((b << 3) | (b >> 2)) / 255.0f;
+}
+
+/*
+* Puts the endpoints in 4 color order (c0 > c1) and finds each texel's step from c0 (0) to c1 (3):
+* its projection on the line between them, rounded. Returns the block's squared error.
+*/
+static float fitBC1(const float rgb[16][3], uint16_t& c0, uint16_t& c1, int steps[16])
+{
+	if (c0 < c1) swap(c0, c1);
+
+	float e0[3], e1[3];
+	unpack565(c0, e0);
+	unpack565(c1, e1);
+
+	float d[3] = { e1[0] - e0[0], e1[1] - e0[1], e1[2] - e0[2] };
+	float length2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+
+	if (c0 == c1) fill(steps, steps + 16, 0);								// one color (in 3 color mode, index 0 is still c0)
+	else
+	{
+		float along[16];
+		for (int i = 0; i < 16; i++) along[i] = (rgb[i][0] - e0[0]) * d[0] + (rgb[i][1] - e0[1]) * d[1] + (rgb[i][2] - e0[2]) * d[2];
+		quantize(along, 0, 3 / length2, 3, steps);
+	}
+
+	float error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			float difference = e0[c] + d[c] * steps[i] / 3 - rgb[i][c];
+			error += difference * difference;
+		}
+	}
+
+	return error;
+}
+
+/*
+* BC1 block: endpoints at the ends of the colors' principal axis, then refit to the chosen steps by least squares
+*/
+static void encodeBC1(const float rgb[16][3], uint8_t* out)
+{
+	float mean[3] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++) mean[c] += rgb[i][c] / 16;
+	}
+
+	//covariance, and its main eigenvector by a few power iterations (starting along the bounding box diagonal)
+	float cov[3][3] = {}, axis[3] = { 0, 0, 0 }, lo[3] = { 1, 1, 1 }, hi[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			for (int b = 0; b < 3; b++) cov[a][b] += (rgb[i][a] - mean[a]) * (rgb[i][b] - mean[b]);
+			lo[a] = min(lo[a], rgb[i][a]);
+			hi[a] = max(hi[a], rgb[i][a]);
+		}
+	}
+	for (int c = 0; c < 3; c++) axis[c] = hi[c] - lo[c];
+
+	for (int iteration = 0; iteration < 4; iteration++)
+	{
+		float next[3];
+		for (int a = 0; a < 3; a++) next[a] = cov[a][0] * axis[0] + cov[a][1] * axis[1] + cov[a][2] * axis[2];
+
+		float length = sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+		if (length < 1e-12f) break;
+		for (int c = 0; c < 3; c++) axis[c] = next[c] / length;
+	}
+
+	float length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	if (length > 0) for (float& c : axis) c /= length;
+
+	//extent along the axis, inset a little: the ends are the rarest colors, the middle matters more
+	float tMin = 0, tMax = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = (rgb[i][0] - mean[0]) * axis[0] + (rgb[i][1] - mean[1]) * axis[1] + (rgb[i][2] - mean[2]) * axis[2];
+		tMin = min(tMin, t);
+		tMax = max(tMax, t);
+	}
+	float inset = (tMax - tMin) / 16;
+
+	float first[3], last[3];
+	for (int c = 0; c < 3; c++)
+	{
+		first[c] = mean[c] + axis[c] * (tMax - inset);
+		last[c] = mean[c] + axis[c] * (tMin + inset);
+	}
+
+	uint16_t c0 = pack565(first), c1 = pack565(last);
+	int steps[16];
+	float error = fitBC1(rgb, c0, c1, steps);
+
+	//least squares endpoints for those steps (texel i = (1 - t) e0 + t e1, t = step / 3), kept if they do better
+	float aa = 0, ab = 0, bb = 0, xa[3] = {}, xb[3] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float t = steps[i] / 3.0f;
+		aa += (1 - t) * (1 - t);
+		ab += (1 - t) * t;
+		bb += t * t;
+		for (int c = 0; c < 3; c++)
+		{
+			xa[c] += (1 - t) * rgb[i][c];
+			xb[c] += t * rgb[i][c];
+		}
+	}
+
+	float det = aa * bb - ab * ab;
+	if (fabs(det) > 1e-6f)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			first[c] = (bb * xa[c] - ab * xb[c]) / det;
+			last[c] = (aa * xb[c] - ab * xa[c]) / det;
+		}
+
+		uint16_t r0 = pack565(first), r1 = pack565(last);
+		int refitSteps[16];
+		if (fitBC1(rgb, r0, r1, refitSteps) < error)
+		{
+			c0 = r0;
+			c1 = r1;
+			copy(refitSteps, refitSteps + 16, steps);
+		}
+	}
+
+	//indices: 0 = c0, 1 = c1, 2 and 3 the colors between (texel 0 in the lowest bits)
+	const uint32_t INDEX[4] = { 0, 2, 3, 1 };
+	uint32_t bits = 0;
+	for (int i = 0; i < 16; i++) bits |= INDEX[steps[i]] << (2 * i);
+
+	memcpy(out, &c0, 2);
+	memcpy(out + 2, &c1, 2);
+	memcpy(out + 4, &bits, 4);
+}
+
+/*
+* BC4 block: the values' range as the endpoints (8 value mode), each value rounded to the nearest of the 8
+*/
+static void encodeBC4(const float values[16], uint8_t* out)
+{
+	float lo = *min_element(values, values + 16), hi = *max_element(values, values + 16);
+	int a0 = (int)(min(max(hi, 0.0f), 1.0f) * 255 + 0.5f);
+	int a1 = (int)(min(max(lo, 0.0f), 1.0f) * 255 + 0.5f);
+
+	uint64_t bits = 0;
+	if (a0 > a1)
+	{
+		//steps from a1 (0) up to a0 (7): a0 is index 0, a1 index 1, and step s between them index 8 - s
+		int steps[16];
+		quantize(values, a1 / 255.0f, 7 * 255.0f / (a0 - a1), 7, steps);
+
+		for (int i = 0; i < 16; i++)
+		{
+			uint64_t index = steps[i] == 7 ? 0 : steps[i] == 0 ? 1 : 8 - steps[i];
+			bits |= index << (3 * i);
+		}
+	}
+
+	out[0] = (uint8_t)a0;
+	out[1] = (uint8_t)a1;
+	for (int b = 0; b < 6; b++) out[2 + b] = (uint8_t)(bits >> (8 * b));
+}
+
+/*
+* The 8 values a BC4 block's indices pick from
+*/
+static void paletteBC4(const uint8_t* block, float palette[8])
+{
+	float a0 = block[0] / 255.0f, a1 = block[1] / 255.0f;
+	palette[0] = a0;
+	palette[1] = a1;
+
+	if (block[0] > block[1])
+	{
+		for (int i = 2; i < 8; i++) palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+	}
+	else
+	{
+		for (int i = 2; i < 6; i++) palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+		palette[6] = 0;
+		palette[7] = 1;
+	}
+}
+
+/*
+* Encodes rows [firstRow, lastRow) of blocks
+*/
+static void compressRows(const Image& image, CompressedImage& out, int firstRow, int lastRow)
+{
+	int width = image.getWidth(), height = image.getHeight();
+	int bytes = CompressedImage::blockBytes(out.format);
+
+	for (int by = firstRow; by < lastRow; by++)
+	{
+		for (int bx = 0; bx < out.blocksWide(); bx++)
+		{
+			uint8_t* block = &out.blocks[((size_t)by * out.blocksWide() + bx) * bytes];
+
+			//texels of the block (blocks past the edges repeat the last row / column)
+			float rgb[16][3], red[16], green[16];
+			for (int i = 0; i < 16; i++)
+			{
+				int x = min(bx * BLOCK + i % BLOCK, width - 1);
+				int y = min(by * BLOCK + i / BLOCK, height - 1);
+
+				if (out.format == BlockFormat::BC1)
+				{
+					Color c = image.getPixel(x, y);
+					rgb[i][0] = c.r();
+					rgb[i][1] = c.g();
+					rgb[i][2] = c.b();
+				}
+				else if (out.format == BlockFormat::BC4)
+				{
+					red[i] = image.gray_wh((float)x, (float)y);
+				}
+				else
+				{
+					auto [du, dv] = image.gradient_wh((float)x, (float)y);
+					red[i] = du + 0.5f;
+					green[i] = dv + 0.5f;
+				}
+			}
+
+			if (out.format == BlockFormat::BC1) encodeBC1(rgb, block);
+			else encodeBC4(red, block);
+			if (out.format == BlockFormat::BC5) encodeBC4(green, block + 8);
+		}
+	}
+}
+
+CompressedImage compressImage(const Image& image, BlockFormat format, unsigned threads)
+{
+	CompressedImage out;
+	out.format = format;
+	out.width = image.getWidth();
+	out.height = image.getHeight();
+	out.blocks.resize((size_t)out.blocksWide() * out.blocksHigh() * CompressedImage::blockBytes(format));
+
+	//each thread encodes a band of block rows (the first band on this thread); blocks are independent
+	if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+	int bands = min((int)threads, out.blocksHigh());
+
+	vector<thread> workers;
+	for (int b = 1; b < bands; b++)
+	{
+		workers.emplace_back(compressRows, cref(image), ref(out), out.blocksHigh() * b / bands, out.blocksHigh() * (b + 1) / bands);
+	}
+	compressRows(image, out, 0, bands > 0 ? out.blocksHigh() / bands : 0);
+
+	for (thread& worker : workers) worker.join();
+
+	return out;
+}
+
+Image decompressImage(const CompressedImage& compressed)
+{
+	Image image(compressed.width, compressed.height);
+	int bytes = CompressedImage::blockBytes(compressed.format);
+
+	for (int by = 0; by < compressed.blocksHigh(); by++)
+	{
+		for (int bx = 0; bx < compressed.blocksWide(); bx++)
+		{
+			const uint8_t* block = &compressed.blocks[((size_t)by * compressed.blocksWide() + bx) * bytes];
+
+			//the colors (or values) each index stands for
+			float colors[4][3], red[8], green[8];
+			uint64_t bits = 0, greenBits = 0;
+
+			if (compressed.format == BlockFormat::BC1)
+			{
+				uint16_t c0, c1;
+				memcpy(&c0, block, 2);
+				memcpy(&c1, block + 2, 2);
+				unpack565(c0, colors[0]);
+				unpack565(c1, colors[1]);
+
+				for (int c = 0; c < 3; c++)
+				{
+					if (c0 > c1)
+					{
+						colors[2][c] = (2 * colors[0][c] + colors[1][c]) / 3;
+						colors[3][c] = (colors[0][c] + 2 * colors[1][c]) / 3;
+					}
+					else
+					{
+						colors[2][c] = (colors[0][c] + colors[1][c]) / 2;
+						colors[3][c] = 0;
+					}
+				}
+				memcpy(&bits, block + 4, 4);
+			}
+			else
+			{
+				paletteBC4(block, red);
+				for (int b = 0; b < 6; b++) bits |= (uint64_t)block[2 + b] << (8 * b);
+			}
+			if (compressed.format == BlockFormat::BC5)
+			{
+				paletteBC4(block + 8, green);
+				for (int b = 0; b < 6; b++) greenBits |= (uint64_t)block[10 + b] << (8 * b);
+			}
+
+			for (int i = 0; i < 16; i++)
+			{
+				int x = bx * BLOCK + i % BLOCK, y = by * BLOCK + i / BLOCK;
+				if (x >= compressed.width || y >= compressed.height) continue;
+
+				switch (compressed.format)
+				{
+					case BlockFormat::BC1:
+					{
+						const float* c = colors[(bits >> (2 * i)) & 3];
+						image.setPixel(x, y, Color(c[0], c[1], c[2]));
+						break;
+					}
+					case BlockFormat::BC4:
+					{
+						float value = red[(bits >> (3 * i)) & 7];
+						image.setPixel(x, y, Color(value, value, value));
+						break;
+					}
+					case BlockFormat::BC5:
+						image.setPixel(x, y, Color(red[(bits >> (3 * i)) & 7], green[(greenBits >> (3 * i)) & 7], 0));
+						break;
+				}
+			}
+		}
+	}
+
+	return image;
+}
+
+CompressedImage cachedCompress(const Image& image, BlockFormat format, bool* cached)
+{
+	if (cached) *cached = false;
+	if (textureCache().empty()) return compressImage(image, format);
+
+	int32_t formatId = (int32_t)format;
+	uint64_t key = hashBytes(&formatId, sizeof(formatId), image.contentHash());
+
+	ostringstream name;
+	name << hex << setw(16) << setfill('0') << key << ".bc";
+	string filename = (filesystem::path(textureCache()) / name.str()).string();
+
+	CompressedImage out;
+	out.format = format;
+	out.width = image.getWidth();
+	out.height = image.getHeight();
+	size_t bytes = (size_t)out.blocksWide() * out.blocksHigh() * CompressedImage::blockBytes(format);
+
+	//a file for another image, or from another version of the layout, is ignored (and gets replaced)
+	{
+		ifstream ifs(filename, ios::binary);
+		CompressedFileHeader header;
+		if (ifs.read((char*)&header, sizeof(header)) && memcmp(header.magic, CompressedFileHeader().magic, sizeof(header.magic)) == 0
+			&& header.key == key && header.format == formatId && header.width == out.width && header.height == out.height)
+		{
+			out.blocks.resize(bytes);
+			if (ifs.read((char*)out.blocks.data(), bytes) && ifs.peek() == EOF)
+			{
+				if (cached) *cached = true;
+				return out;
+			}
+		}
+	}
+
+	out = compressImage(image, format);
+
+	//written to a temporary name first, so a reader never sees a half written file
+	//(a cache that cannot be written only costs the next load an encode)
+	error_code error;
+	filesystem::create_directories(textureCache(), error);
+
+	CompressedFileHeader header;
+	header.key = key;
+	header.format = formatId;
+	header.width = out.width;
+	header.height = out.height;
+
+	string partial = filename + ".part";
+	{
+		ofstream ofs(partial, ios::binary);
+		ofs.write((const char*)&header, sizeof(header));
+		ofs.write((const char*)out.blocks.data(), out.blocks.size());
+		if (!ofs) return out;
+	}
+	filesystem::rename(partial, filename, error);
+
+	return out;
+}
+
+void setTextureCache(const string& directory)
+{
+	textureCache() = directory;
+}
@@ -0,0 +1,65 @@
+#ifndef BLOCKCOMPRESSION_H
+#define BLOCKCOMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Image.h"
+using namespace std;
+
+/*
+* GPU block compression formats: the image is cut into 4 x 4 texel blocks, each stored in a fixed number of bytes
+*	BC1		color maps: two 5:6:5 endpoint colors, and 2 bit indices into the 4 colors between them (8 bytes)
+*	BC4		masks: one channel, two 8 bit endpoints and 3 bit indices into the 8 values between them (8 bytes)
+*	BC5		bump maps: the gradient (du, dv) as two BC4 channels (16 bytes)
+*/
+enum class BlockFormat
+{
+	BC1,
+	BC4,
+	BC5
+};
+
+/*
+* A block compressed image, laid out as the GPU reads it (rows of blocks, top first)
+*/
+struct CompressedImage
+{
+	BlockFormat format = BlockFormat::BC1;
+	int width = 0;						// texels along each axis (the blocks cover them, rounded up to multiples of 4)
+	int height = 0;
+	vector<uint8_t> blocks;
+
+	/*
+	* Blocks along each axis, and the bytes of one block of a format
+	*/
+	int blocksWide() const;
+	int blocksHigh() const;
+	static int blockBytes(BlockFormat format);
+};
+
+/*
+* Compresses an image on 'threads' threads (0 = one per core), each encoding its own rows of blocks:
+* BC1 takes the colors, BC4 the gray values, BC5 the gradient (du, dv) of the gray values, moved from [-0.5, 0.5] into [0, 1]
+*/
+CompressedImage compressImage(const Image& image, BlockFormat format, unsigned threads = 0);
+
+/*
+* Decodes the blocks as the GPU samples them (BC4: gray, BC5: du + 0.5 in red and dv + 0.5 in green)
+*/
+Image decompressImage(const CompressedImage& compressed);
+
+/*
+* compressImage() through a cache on disk: an image compressed before (by this run or an earlier one) is read back
+* instead of encoded. Files are named by the content hash of the texels and the format.
+* 'cached' (when given) tells whether the blocks came from the cache.
+*/
+CompressedImage cachedCompress(const Image& image, BlockFormat format, bool* cached = nullptr);
+
+/*
+* Directory of the compressed image cache ("" = always compress)
+*/
+void setTextureCache(const string& directory);
+
+#endif
@@ -0,0 +1,330 @@
+#include "Bvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+
+// items a leaf may hold when splitting them would not pay off
+const int MAX_LEAF = 8;
+
+// split positions tried along an axis
+const int BINS = 16;
+
+/*
+* Surface area of a box given as lo[3], hi[3] (half of it: only ratios matter)
+*/
+static float halfArea(const float lo[3], const float hi[3])
+{
+	float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+bool boxHit(const BvhNode& node, const float o[3], const float inv[3], float maxT)
+{
+	float tEnter = 0, tExit = maxT;
+
+	for (int c = 0; c < 3; c++)
+	{
+		float t0 = (node.lo[c] - o[c]) * inv[c];
+		float t1 = (node.hi[c] - o[c]) * inv[c];
+
+		tEnter = max(tEnter, min(t0, t1));
+		tExit = min(tExit, max(t0, t1));
+	}
+
+	return tEnter <= tExit;
+}
+
+float along(const BvhNode& node, const float d[3])
+{
+	return (node.lo[0] + node.hi[0]) * d[0] + (node.lo[1] + node.hi[1]) * d[1] + (node.lo[2] + node.hi[2]) * d[2];
+}
+
+void Bvh::build(int count, const function<void(int, Point[3])>& corners)
+{
+	buildBoxes(count, [&](int i, float lo[3], float hi[3]) {
+		Point p[3];
+		corners(i, p);
+
+		float xs[3] = { p[0].x(), p[1].x(), p[2].x() };
+		float ys[3] = { p[0].y(), p[1].y(), p[2].y() };
+		float zs[3] = { p[0].z(), p[1].z(), p[2].z() };
+		const float* axes[3] = { xs, ys, zs };
+
+		for (int c = 0; c < 3; c++)
+		{
+			lo[c] = *min_element(axes[c], axes[c] + 3);
+			hi[c] = *max_element(axes[c], axes[c] + 3);
+		}
+	});
+}
+
+void Bvh::buildBoxes(int count, const function<void(int, float[3], float[3])>& bounds)
+{
+	clear();
+	if (count == 0) return;
+
+	//box (lo, hi) and center of every item
+	vector<float> boxes(count * 6);
+	vector<float> centers(count * 3);
+
+	for (int i = 0; i < count; i++)
+	{
+		bounds(i, &boxes[i * 6], &boxes[i * 6 + 3]);
+		for (int c = 0; c < 3; c++) centers[i * 3 + c] = (boxes[i * 6 + c] + boxes[i * 6 + 3 + c]) / 2;
+	}
+
+	builtOrder.resize(count);
+	iota(builtOrder.begin(), builtOrder.end(), 0);
+
+	builtNodes.reserve(2 * count);
+	builtNodes.push_back({});
+	split(0, 0, count, 0, boxes, centers);
+	builtNodes.shrink_to_fit();
+
+	nodes = builtNodes;
+	order = builtOrder;
+}
+
+void Bvh::refit(const function<void(int, float[3], float[3])>& bounds)
+{
+	//a mapped tree is read-only: refitting works on a copy
+	if (mapping)
+	{
+		builtNodes.assign(nodes.begin(), nodes.end());
+		builtOrder.assign(order.begin(), order.end());
+		mapping.reset();
+
+		nodes = builtNodes;
+		order = builtOrder;
+	}
+
+	//children always come after their parent: going backwards, both are done before it
+	for (int index = (int)builtNodes.size() - 1; index >= 0; index--)
+	{
+		BvhNode& node = builtNodes[index];
+		fill(node.lo, node.lo + 3, FLT_MAX);
+		fill(node.hi, node.hi + 3, -FLT_MAX);
+
+		auto grow = [&](const float lo[3], const float hi[3]) {
+			for (int c = 0; c < 3; c++)
+			{
+				node.lo[c] = min(node.lo[c], lo[c]);
+				node.hi[c] = max(node.hi[c], hi[c]);
+			}
+		};
+
+		if (node.count == 0)
+		{
+			grow(builtNodes[index + 1].lo, builtNodes[index + 1].hi);
+			grow(builtNodes[node.first].lo, builtNodes[node.first].hi);
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			float lo[3], hi[3];
+			bounds(builtOrder[i], lo, hi);
+			grow(lo, hi);
+		}
+	}
+}
+
+void Bvh::split(int node, int first, int count, int depth, const vector<float>& boxes, const vector<float>& centers)
+{
+	//bounds of the triangles, and of their centers (where the splits are tried)
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	float centerLo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, centerHi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (int i = first; i < first + count; i++)
+	{
+		int tri = builtOrder[i];
+		for (int c = 0; c < 3; c++)
+		{
+			lo[c] = min(lo[c], boxes[tri * 6 + c]);
+			hi[c] = max(hi[c], boxes[tri * 6 + 3 + c]);
+			centerLo[c] = min(centerLo[c], centers[tri * 3 + c]);
+			centerHi[c] = max(centerHi[c], centers[tri * 3 + c]);
+		}
+	}
+
+	BvhNode& current = builtNodes[node];
+	copy(lo, lo + 3, current.lo);
+	copy(hi, hi + 3, current.hi);
+	current.first = first;
+	current.count = count;
+
+	if (count <= 2 || depth >= MAX_DEPTH) return;
+
+	//split along the axis where the centers spread the most
+	int axis = 0;
+	for (int c = 1; c < 3; c++)
+	{
+		if (centerHi[c] - centerLo[c] > centerHi[axis] - centerLo[axis]) axis = c;
+	}
+
+	float extent = centerHi[axis] - centerLo[axis];
+	if (extent <= 0) return;								// every center in the same spot: nothing to split
+
+	auto binOf = [&](int tri) { return min(BINS - 1, (int)((centers[tri * 3 + axis] - centerLo[axis]) / extent * BINS)); };
+
+	//count and bound the triangles of each bin
+	int binCounts[BINS] = {};
+	float binLo[BINS][3], binHi[BINS][3];
+	for (int b = 0; b < BINS; b++)
+	{
+		fill(binLo[b], binLo[b] + 3, FLT_MAX);
+		fill(binHi[b], binHi[b] + 3, -FLT_MAX);
+	}
+
+	for (int i = first; i < first + count; i++)
+	{
+		int tri = builtOrder[i];
+		int b = binOf(tri);
+
+		binCounts[b]++;
+		for (int c = 0; c < 3; c++)
+		{
+			binLo[b][c] = min(binLo[b][c], boxes[tri * 6 + c]);
+			binHi[b][c] = max(binHi[b][c], boxes[tri * 6 + 3 + c]);
+		}
+	}
+
+	//cost of each split (between bin b - 1 and b): area of each side times the triangles in it
+	float leftCost[BINS] = {};
+	float runLo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, runHi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	int runCount = 0;
+
+	for (int b = 0; b < BINS - 1; b++)
+	{
+		runCount += binCounts[b];
+		for (int c = 0; c < 3; c++)
+		{
+			runLo[c] = min(runLo[c], binLo[b][c]);
+			runHi[c] = max(runHi[c], binHi[b][c]);
+		}
+		leftCost[b + 1] = runCount ? halfArea(runLo, runHi) * runCount : 0;
+	}
+
+	fill(runLo, runLo + 3, FLT_MAX);
+	fill(runHi, runHi + 3, -FLT_MAX);
+	runCount = 0;
+
+	float bestCost = FLT_MAX;
+	int bestBin = -1;
+
+	for (int b = BINS - 1; b > 0; b--)
+	{
+		runCount += binCounts[b];
+		for (int c = 0; c < 3; c++)
+		{
+			runLo[c] = min(runLo[c], binLo[b][c]);
+			runHi[c] = max(runHi[c], binHi[b][c]);
+		}
+
+		float cost = leftCost[b] + (runCount ? halfArea(runLo, runHi) * runCount : 0);
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestBin = b;
+		}
+	}
+
+	//one traversal step (counted as one triangle test) against testing every triangle here
+	float leafCost = halfArea(lo, hi) * count;
+	float splitCost = halfArea(lo, hi) + bestCost;
+	if (count <= MAX_LEAF && splitCost >= leafCost) return;
+
+	int* middle = partition(&builtOrder[first], &builtOrder[first] + count, [&](int tri) { return binOf(tri) < bestBin; });
+	int leftCount = (int)(middle - &builtOrder[first]);
+
+	//all in one bin (e.g. long thin triangles): halve by center instead
+	if (leftCount == 0 || leftCount == count)
+	{
+		leftCount = count / 2;
+		nth_element(&builtOrder[first], &builtOrder[first] + leftCount, &builtOrder[first] + count,
+					[&](int a, int b) { return centers[a * 3 + axis] < centers[b * 3 + axis]; });
+	}
+
+	//first child right after the node, second one after the first one's subtree
+	int left = (int)builtNodes.size();
+	builtNodes.push_back({});
+	split(left, first, leftCount, depth + 1, boxes, centers);
+
+	int right = (int)builtNodes.size();
+	builtNodes.push_back({});
+	split(right, first + leftCount, count - leftCount, depth + 1, boxes, centers);
+
+	builtNodes[node].first = right;								// (nodes may have moved: no reference kept)
+	builtNodes[node].count = 0;
+}
+
+bool Bvh::save(const string& filename, uint64_t key) const
+{
+	BvhFileHeader header;
+	header.key = key;
+	header.nodeCount = (uint32_t)nodes.size();
+	header.orderCount = (uint32_t)order.size();
+
+	//written to a temporary name first, so a reader never maps a half written file
+	string partial = filename + ".part";
+	{
+		ofstream ofs(partial, ios::binary);
+		ofs.write((const char*)&header, sizeof(header));
+		ofs.write((const char*)nodes.data(), nodes.size_bytes());
+		ofs.write((const char*)order.data(), order.size_bytes());
+		if (!ofs) return false;
+	}
+
+	error_code error;
+	filesystem::rename(partial, filename, error);
+	return !error;
+}
+
+bool Bvh::map(const string& filename, uint64_t key)
+{
+	auto file = make_unique<MappedFile>(filename);
+	if (!file->isOpen() || file->size() < sizeof(BvhFileHeader)) return false;
+
+	//a file for other geometry, or from another version of the layout, is ignored (and gets replaced)
+	const BvhFileHeader* header = (const BvhFileHeader*)file->data();
+	if (memcmp(header->magic, BvhFileHeader().magic, sizeof(header->magic)) != 0 || header->key != key) return false;
+	if (file->size() != sizeof(BvhFileHeader) + header->nodeCount * sizeof(BvhNode) + header->orderCount * sizeof(int)) return false;
+
+	clear();
+
+	//the nodes follow the header, the order follows the nodes (mappings are page aligned, so both are aligned)
+	const char* data = file->data() + sizeof(BvhFileHeader);
+	nodes = span<const BvhNode>((const BvhNode*)data, header->nodeCount);
+	order = span<const int>((const int*)(data + header->nodeCount * sizeof(BvhNode)), header->orderCount);
+	mapping = move(file);
+
+	return true;
+}
+
+bool Bvh::empty() const
+{
+	return nodes.empty();
+}
+
+size_t Bvh::memoryBytes() const
+{
+	return builtNodes.capacity() * sizeof(BvhNode) + builtOrder.capacity() * sizeof(int);
+}
+
+bool Bvh::mapped() const
+{
+	return mapping != nullptr;
+}
+
+void Bvh::clear()
+{
+	builtNodes.clear();
+	builtOrder.clear();
+	mapping.reset();
+
+	nodes = {};
+	order = {};
+}
@@ -0,0 +1,131 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "Point.h"
+using namespace std;
+
+/*
+* Node of a bounding volume hierarchy (32 bytes). Children and triangles are referred to by index,
+* never by pointer, so a whole tree can be copied, moved or written out as one block.
+*/
+struct BvhNode
+{
+	float lo[3];						// corners of the box around everything below the node
+	int first;							// leaf: first entry of the triangle order; inner node: index of the second child (the first one follows the node)
+	float hi[3];
+	int count;							// triangles in a leaf, 0 for an inner node
+};
+
+/*
+* Start of a hierarchy saved to disk (see Bvh::save()), followed by the nodes, then the order
+*/
+struct BvhFileHeader
+{
+	char magic[8] = { 'B', 'V', 'H', 'N', 'O', 'D', 'E', '1' };	// file type and node layout version
+	uint64_t key = 0;					// content hash of the geometry the tree was built for
+	uint32_t nodeCount = 0;
+	uint32_t orderCount = 0;
+	uint32_t padding[2] = {};			// (so the nodes start 32 byte aligned)
+};
+
+/*
+* True if the ray (origin o, 1 / direction inv) enters the node's box before maxT
+*/
+bool boxHit(const BvhNode& node, const float o[3], const float inv[3], float maxT);
+
+/*
+* Position of the node's center along a direction (to visit the nearer child first)
+*/
+float along(const BvhNode& node, const float d[3]);
+
+/*
+* Bounding volume hierarchy for ray queries, built top down with binned surface area heuristic splits.
+* Its items are a mesh's triangles, or the instances of a scene (each with its world space box).
+* Nodes are stored depth first (root at 0), and each leaf covers a consecutive range of 'order'.
+* A tree either lives in memory (built) or in a file mapped into memory (see map()): queries read both
+* through the same views.
+*/
+class Bvh
+{
+private:
+	vector<BvhNode> builtNodes;			// storage of a tree built here
+	vector<int> builtOrder;
+	unique_ptr<MappedFile> mapping;		// storage of a tree mapped from a file
+
+	/*
+	* Makes 'node' cover entries [first, first + count) of the order, splitting them further when worth it
+	*/
+	void split(int node, int first, int count, int depth, const vector<float>& boxes, const vector<float>& centers);
+
+public:
+	static const int MAX_DEPTH = 48;	// deeper nodes become leaves (traversal stacks hold 64 nodes)
+
+	span<const BvhNode> nodes;			// the tree, wherever it is stored
+	span<const int> order;				// item (triangle) indices, grouped by leaf
+
+	Bvh() = default;
+
+	//the views point into the tree's own storage: moving keeps it, copying would not
+	Bvh(const Bvh&) = delete;
+	Bvh& operator=(const Bvh&) = delete;
+	Bvh(Bvh&&) noexcept = default;
+	Bvh& operator=(Bvh&&) noexcept = default;
+
+	/*
+	* Builds the hierarchy over 'count' triangles, whose corners the function fills in
+	*/
+	void build(int count, const function<void(int, Point[3])>& corners);
+
+	/*
+	* Builds the hierarchy over 'count' items, whose boxes (lo, hi) the function fills in
+	*/
+	void buildBoxes(int count, const function<void(int, float[3], float[3])>& bounds);
+
+	/*
+	* Recomputes every node's box from the items' current boxes, keeping the tree as it is
+	* (for items that moved: cheaper than a build, though the tree gets looser as they stray)
+	*/
+	void refit(const function<void(int, float[3], float[3])>& bounds);
+
+	/*
+	* Writes the tree to a file, tagged with the key of the geometry it was built for
+	*/
+	bool save(const string& filename, uint64_t key) const;
+
+	/*
+	* Replaces the tree with the one in a file written by save(), mapped rather than read: it is usable at
+	* once, and its pages are only loaded as queries touch them. False (tree unchanged) when the file does
+	* not exist, or was saved for another key or layout.
+	*/
+	bool map(const string& filename, uint64_t key);
+
+	/*
+	* True when there is no tree (no triangles)
+	*/
+	bool empty() const;
+
+	/*
+	* Bytes of memory held by the nodes and the order (those of a mapped tree belong to the file)
+	*/
+	size_t memoryBytes() const;
+
+	/*
+	* True when the tree was mapped from a file
+	*/
+	bool mapped() const;
+
+	/*
+	* Drops the tree
+	*/
+	void clear();
+};
+
+#endif
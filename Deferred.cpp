@@ -0,0 +1,466 @@
+#include "Deferred.h"
+#include "shaderutils.h"
+#include "utils.h"
+
+DeferredRenderer::~DeferredRenderer()
+{
+	release();
+
+	if (gbufferProgram) glDeleteProgram(gbufferProgram);
+	if (resolveProgram) glDeleteProgram(resolveProgram);
+	if (lowProgram) glDeleteProgram(lowProgram);
+	if (upsampleProgram) glDeleteProgram(upsampleProgram);
+	if (temporalProgram) glDeleteProgram(temporalProgram);
+	if (sheetProgram) glDeleteProgram(sheetProgram);
+}
+
+void DeferredRenderer::setup()
+{
+	gbufferProgram = loadProgram(vector<string>{ "vertexShader.glsl" }, vector<string>{ "gbufferShader.glsl", "effects.glsl" });
+	resolveProgram = loadProgram(vector<string>{ "screenShader.glsl" }, vector<string>{ "resolveShader.glsl", "effects.glsl" },
+		"#define NO_DISCARD");											// holes were already cut in the G-buffer pass
+
+	sheetProgram = loadProgram(vector<string>{ "screenShader.glsl" }, vector<string>{ "sheetShader.glsl", "effects.glsl" }, "#define NO_DISCARD");
+
+	//G-buffer textures are always bound to the same units
+	for (GLuint each : { resolveProgram, sheetProgram })
+	{
+		glUseProgram(each);
+		glUniform1i(glGetUniformLocation(each, "gColor"), 0);
+		glUniform1i(glGetUniformLocation(each, "gNormal"), 1);
+		glUniform1i(glGetUniformLocation(each, "gCoord"), 2);
+	}
+
+	lowProgram = loadProgram(vector<string>{ "screenShader.glsl" }, vector<string>{ "lowResShader.glsl", "effects.glsl" }, "#define NO_DISCARD");
+	upsampleProgram = loadProgram(vector<string>{ "screenShader.glsl" }, vector<string>{ "upsampleShader.glsl", "effects.glsl" }, "#define NO_DISCARD");
+
+	//reduced resolution results follow the G-buffer's units
+	const char* samplers[7] = { "gColor", "gNormal", "gCoord", "lowColor", "lowNormal", "lowCoord", "lowGuide" };
+	for (GLuint each : { lowProgram, upsampleProgram })
+	{
+		glUseProgram(each);
+		for (int unit = 0; unit < 7; unit++) glUniform1i(glGetUniformLocation(each, samplers[unit]), unit);
+	}
+
+	temporalProgram = loadProgram(vector<string>{ "screenShader.glsl" }, vector<string>{ "temporalShader.glsl", "effects.glsl" }, "#define NO_DISCARD");
+
+	const char* historySamplers[6] = { "gColor", "gNormal", "gCoord", "historyColor", "historyNormal", "historyCoord" };
+	glUseProgram(temporalProgram);
+	for (int unit = 0; unit < 6; unit++) glUniform1i(glGetUniformLocation(temporalProgram, historySamplers[unit]), unit);
+}
+
+GLuint DeferredRenderer::geometryProgram() const
+{
+	return gbufferProgram;
+}
+
+GLuint DeferredRenderer::shadingProgram() const
+{
+	return resolveProgram;
+}
+
+vector<GLuint> DeferredRenderer::shadingPrograms() const
+{
+	return { resolveProgram, lowProgram, upsampleProgram, temporalProgram, sheetProgram };
+}
+
+void DeferredRenderer::setReduced(unsigned mask, int scale)
+{
+	reducedMask = mask;
+	reducedScale = scale < 1 ? 1 : scale;
+}
+
+unsigned DeferredRenderer::reducedEffects() const
+{
+	return reducedMask;
+}
+
+int DeferredRenderer::reducedFactor() const
+{
+	return reducedScale;
+}
+
+void DeferredRenderer::setTemporal(bool on)
+{
+	temporal = on;
+	historyValid = false;
+}
+
+bool DeferredRenderer::temporalCache() const
+{
+	return temporal;
+}
+
+void DeferredRenderer::setView(float angle, int frame)
+{
+	viewAngle = angle;
+	viewFrame = frame;
+}
+
+void DeferredRenderer::invalidateHistory()
+{
+	historyValid = false;
+}
+
+void DeferredRenderer::resize(int w, int h)
+{
+	release();
+
+	width = w;
+	height = h;
+
+	//one texture per attachment: format, and where it goes
+	struct Target { GLuint* texture; GLenum format; GLenum attachment; };
+	Target targets[3] = { { &colorTexture, GL_RGBA8, GL_COLOR_ATTACHMENT0 },
+						  { &normalTexture, GL_RGBA16F, GL_COLOR_ATTACHMENT1 },			// w holds object ids (exact up to 2048)
+						  { &coordTexture, GL_RGBA32F, GL_COLOR_ATTACHMENT2 } };		// effects need full precision coords
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	for (Target& target : targets)
+	{
+		glGenTextures(1, target.texture);
+		glBindTexture(GL_TEXTURE_2D, *target.texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, target.format, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, target.attachment, GL_TEXTURE_2D, *target.texture, 0);
+	}
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+	GLenum buffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, buffers);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeferredRenderer::resizeReduced()
+{
+	if (lowFramebuffer)
+	{
+		glDeleteFramebuffers(1, &lowFramebuffer);
+		glDeleteTextures(4, lowTextures);
+	}
+	lowFramebuffer = 0;
+
+	lowScale = reducedScale;
+	int lowWidth = (width + lowScale - 1) / lowScale;		// a partial block at the edge still gets a pixel
+	int lowHeight = (height + lowScale - 1) / lowScale;
+
+	GLenum formats[4] = { GL_RGBA8, GL_RGBA16F, GL_RGBA32F, GL_RGBA16F };	// coords keep full precision (compared against the G-buffer's)
+	GLenum buffers[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+
+	glGenFramebuffers(1, &lowFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, lowFramebuffer);
+	glGenTextures(4, lowTextures);
+
+	for (int i = 0; i < 4; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, lowTextures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, formats[i], lowWidth, lowHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);		// the upsampling filter does its own weighting
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, buffers[i], GL_TEXTURE_2D, lowTextures[i], 0);
+	}
+
+	glDrawBuffers(4, buffers);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeferredRenderer::resizeHistory()
+{
+	GLenum formats[4] = { GL_RGBA8, GL_RGBA16F, GL_RGBA16F, GL_RGBA32F };	// coords are compared against the G-buffer's: full precision
+	GLenum buffers[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+
+	glGenFramebuffers(2, historyFramebuffers);
+
+	for (int i = 0; i < 2; i++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, historyFramebuffers[i]);
+		glGenTextures(4, historyTextures[i]);
+
+		for (int target = 0; target < 4; target++)
+		{
+			glBindTexture(GL_TEXTURE_2D, historyTextures[i][target]);
+			glTexImage2D(GL_TEXTURE_2D, 0, formats[target], width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, buffers[target], GL_TEXTURE_2D, historyTextures[i][target], 0);
+		}
+
+		glDrawBuffers(4, buffers);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	historyValid = false;
+}
+
+void DeferredRenderer::release()
+{
+	for (GLuint* texture : { &colorTexture, &normalTexture, &coordTexture })
+	{
+		if (*texture) glDeleteTextures(1, texture);
+		*texture = 0;
+	}
+
+	if (lowFramebuffer)									// (created together with its textures)
+	{
+		glDeleteTextures(4, lowTextures);
+		glDeleteFramebuffers(1, &lowFramebuffer);
+	}
+	for (GLuint& texture : lowTextures) texture = 0;
+	lowFramebuffer = 0;
+	lowScale = 0;
+
+	if (historyFramebuffers[0])							// (created on the first temporal frame, with their textures)
+	{
+		for (int i = 0; i < 2; i++) glDeleteTextures(4, historyTextures[i]);
+		glDeleteFramebuffers(2, historyFramebuffers);
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		for (GLuint& texture : historyTextures[i]) texture = 0;
+	}
+	historyFramebuffers[0] = historyFramebuffers[1] = 0;
+	historyValid = false;
+
+	if (depthBuffer) glDeleteRenderbuffers(1, &depthBuffer);
+	if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+	depthBuffer = 0;
+	framebuffer = 0;
+}
+
+void DeferredRenderer::beginGeometry()
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (viewport[2] != width || viewport[3] != height || framebuffer == 0) resize(viewport[2], viewport[3]);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	//all zeros: coord w = 0 marks pixels no mesh covers
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+	glUseProgram(gbufferProgram);
+}
+
+void DeferredRenderer::beginSheet()
+{
+	beginGeometry();
+
+	//the stored effect is ignored, but function2 (2) would cut its holes for every cell
+	glUniform1i(glGetUniformLocation(gbufferProgram, "currFunc"), 0);
+}
+
+void DeferredRenderer::resolveSheet()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glUseProgram(sheetProgram);
+
+	GLuint textures[3] = { colorTexture, normalTexture, coordTexture };
+	for (int unit = 0; unit < 3; unit++)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, textures[unit]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	glDisable(GL_DEPTH_TEST);
+	screenLayout.bind();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void DeferredRenderer::resolve()
+{
+	if (temporal) resolveTemporal();
+	else if (reducedMask == 0) resolveFull();
+	else resolveReduced();
+}
+
+void DeferredRenderer::resolveFull()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glUseProgram(resolveProgram);
+
+	GLuint textures[3] = { colorTexture, normalTexture, coordTexture };
+	for (int unit = 0; unit < 3; unit++)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, textures[unit]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	//every pixel is shaded once: no depth test needed (the G-buffer already kept the nearest fragment)
+	glDisable(GL_DEPTH_TEST);
+	screenLayout.bind();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void DeferredRenderer::resolveReduced()
+{
+	if (lowFramebuffer == 0 || lowScale != reducedScale) resizeReduced();
+
+	GLuint textures[7] = { colorTexture, normalTexture, coordTexture, lowTextures[0], lowTextures[1], lowTextures[2], lowTextures[3] };
+	for (int unit = 0; unit < 7; unit++)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, unit < 3 ? textures[unit] : 0);		// the reduced targets are not read while written
+	}
+
+	glDisable(GL_DEPTH_TEST);
+	screenLayout.bind();
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	//effects, once per block of pixels
+	glBindFramebuffer(GL_FRAMEBUFFER, lowFramebuffer);
+	glViewport(0, 0, (width + lowScale - 1) / lowScale, (height + lowScale - 1) / lowScale);
+	glUseProgram(lowProgram);
+	glUniform1i(glGetUniformLocation(lowProgram, "scale"), lowScale);
+	glUniform1i(glGetUniformLocation(lowProgram, "lowResMask"), (GLint)reducedMask);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	//upsampling (and the other effects) and lighting, once per pixel
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	for (int unit = 3; unit < 7; unit++)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, textures[unit]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	glUseProgram(upsampleProgram);
+	glUniform1i(glGetUniformLocation(upsampleProgram, "scale"), lowScale);
+	glUniform1i(glGetUniformLocation(upsampleProgram, "lowResMask"), (GLint)reducedMask);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glEnable(GL_DEPTH_TEST);
+}
+
+void DeferredRenderer::resolveTemporal()
+{
+	if (historyFramebuffers[0] == 0) resizeHistory();
+
+	int read = historyIndex;
+	int write = 1 - historyIndex;
+
+	//background: the window's clear color, and no effect in the history
+	GLfloat clearColor[4];
+	GLfloat none[4] = { 0, 0, 0, 0 };
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, historyFramebuffers[write]);
+	glClearBufferfv(GL_COLOR, 0, clearColor);
+	for (int target = 1; target < 4; target++) glClearBufferfv(GL_COLOR, target, none);
+
+	GLuint textures[6] = { colorTexture, normalTexture, coordTexture, historyTextures[read][1], historyTextures[read][2], historyTextures[read][3] };
+	for (int unit = 0; unit < 6; unit++)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, textures[unit]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	glUseProgram(temporalProgram);
+	glUniform1f(glGetUniformLocation(temporalProgram, "angle"), viewAngle);
+	glUniform1f(glGetUniformLocation(temporalProgram, "prevAngle"), historyAngle);
+	glUniform1i(glGetUniformLocation(temporalProgram, "frame"), viewFrame);
+	glUniform1i(glGetUniformLocation(temporalProgram, "prevFrame"), historyFrame);
+	glUniform1i(glGetUniformLocation(temporalProgram, "historyValid"), historyValid);
+	glUniform1i(glGetUniformLocation(temporalProgram, "phase"), phase);
+	glUniform1f(glGetUniformLocation(temporalProgram, "tolerance"), 3.0f / (width < height ? width : height));		// 1.5 pixels (screen spans 2 units)
+
+	glDisable(GL_DEPTH_TEST);
+	screenLayout.bind();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glEnable(GL_DEPTH_TEST);
+
+	//show the lit color
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, historyFramebuffers[write]);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	historyIndex = write;
+	historyValid = true;
+	historyAngle = viewAngle;
+	historyFrame = viewFrame;
+	phase = (phase + 1) % 4;
+}
+
+ReducedQuality DeferredRenderer::compareReduced()
+{
+	ReducedQuality quality;
+	if (framebuffer == 0) return quality;
+
+	vector<unsigned char> full((size_t)width * height * 3);
+	vector<unsigned char> reduced(full.size());
+	GpuTimer timer;
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadBuffer(GL_BACK);
+
+	timer.begin();
+	resolveFull();
+	timer.end();
+	quality.fullMs = timer.result();
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, full.data());
+
+	timer.begin();
+	resolveReduced();
+	timer.end();
+	quality.reducedMs = timer.result();
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, reduced.data());
+
+	quality.psnr = psnr(full.data(), reduced.data(), full.size());
+	return quality;
+}
+
+vector<int> DeferredRenderer::pixelsPerObject(int objects)
+{
+	vector<int> pixels(objects + 1, 0);
+	if (framebuffer == 0) return pixels;
+
+	vector<float> normals((size_t)width * height * 4);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, normals.data());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	for (size_t i = 3; i < normals.size(); i += 4)
+	{
+		int id = (int)normals[i];
+		if (id >= 0 && id <= objects) pixels[id]++;
+	}
+
+	return pixels;
+}
+
+ostream& operator<<(ostream& os, const ReducedQuality& quality)
+{
+	os << "Reduced resolution effects: PSNR " << quality.psnr << " dB against full resolution";
+
+	if (quality.fullMs >= 0 && quality.reducedMs >= 0)
+	{
+		os << ", second pass " << quality.fullMs << " ms -> " << quality.reducedMs << " ms ("
+		   << quality.fullMs - quality.reducedMs << " ms saved)";
+	}
+
+	return os;
+}
@@ -0,0 +1,181 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <vector>
+#include <iostream>
+#include <GL/glew.h>
+#include "GpuResources.h"
+using namespace std;
+
+/*
+* How close reduced resolution effects come to full resolution ones, and what they save (see compareReduced())
+*/
+struct ReducedQuality
+{
+	double psnr = 0;					// dB, of the reduced frame against the full resolution one (infinite when identical)
+	double fullMs = -1;					// GPU time of the second pass at full resolution (-1 = not measured)
+	double reducedMs = -1;				// same, with the reduced resolution passes
+};
+
+ostream& operator<<(ostream& os, const ReducedQuality& quality);
+
+
+/*
+* Two pass (deferred) shading: meshes are first drawn into a G-buffer that keeps, for each pixel,
+* only the nearest fragment's color, normal, effect coords and effect. A full screen pass then runs
+* the effect once per covered pixel, instead of once per fragment drawn (hidden ones included).
+*/
+class DeferredRenderer
+{
+private:
+	GLuint framebuffer = 0;
+	GLuint colorTexture = 0;			// G-buffer: vertex color
+	GLuint normalTexture = 0;			// normal, and id of the draw that wrote the pixel
+	GLuint coordTexture = 0;			// effect coords, and effect + 1 (0 = nothing drawn)
+	GLuint depthBuffer = 0;
+	int width = 0;						// size the G-buffer was created with
+	int height = 0;
+
+	GLuint lowFramebuffer = 0;			// reduced resolution effect results (see setReduced())
+	GLuint lowTextures[4] = {};			// effect color, effect normal, coords and effect + 1, G-buffer normal
+	int lowScale = 0;					// scale the reduced targets were created with
+
+	GLuint historyFramebuffers[2] = {};	// temporal cache: this frame's effect results are written to one, the previous frame's read from the other
+	GLuint historyTextures[2][4] = {};	// lit color, effect color, effect normal and objectId, coords and effect + 1
+	int historyIndex = 0;				// the one written last frame
+	bool historyValid = false;			// it holds the previous frame (and nothing made it stale since)
+
+	GLuint gbufferProgram = 0;			// first pass (same vertex shader as forward drawing)
+	GLuint resolveProgram = 0;			// second pass
+	GLuint lowProgram = 0;				// second pass with reduced resolution effects: effects...
+	GLuint upsampleProgram = 0;			// ...then upsampling and lighting
+	GLuint temporalProgram = 0;			// second pass reusing the previous frame's effect results
+	GLuint sheetProgram = 0;			// second pass showing every effect in a grid
+	VertexArray screenLayout;			// empty layout for the full screen triangle
+
+	unsigned reducedMask = 0;			// bit n set: effect n runs at reduced resolution
+	int reducedScale = 2;
+
+	bool temporal = false;				// use the temporal cache (see setTemporal())
+	int phase = 0;						// checkerboard cell whose pixels run their effect this frame
+	float viewAngle = 0;				// rotation and flow of this frame (see setView())...
+	int viewFrame = 0;
+	float historyAngle = 0;				// ...and of the frame held by the history
+	int historyFrame = 0;
+
+	/*
+	* (Re)creates the G-buffer textures for the given size
+	*/
+	void resize(int w, int h);
+
+	/*
+	* (Re)creates the reduced resolution targets for the G-buffer's size and the current scale
+	*/
+	void resizeReduced();
+
+	/*
+	* (Re)creates both history framebuffers for the G-buffer's size
+	*/
+	void resizeHistory();
+
+	/*
+	* Deletes the G-buffer (and the targets sized after it)
+	*/
+	void release();
+
+	/*
+	* Second pass variants: every effect at full resolution, the reduced ones at reduced resolution,
+	* or a quarter of the pixels plus the temporal cache
+	*/
+	void resolveFull();
+	void resolveReduced();
+	void resolveTemporal();
+
+public:
+	DeferredRenderer() = default;
+	~DeferredRenderer();
+
+	DeferredRenderer(const DeferredRenderer&) = delete;
+	DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+	/*
+	* Builds the programs of both passes (requires an openGL context)
+	*/
+	void setup();
+
+	/*
+	* Program of the first pass (needs the same uniforms as forward drawing)
+	*/
+	GLuint geometryProgram() const;
+
+	/*
+	* Program of the second pass (needs the effect uniforms: f, k, t, frame, flow)
+	*/
+	GLuint shadingProgram() const;
+
+	/*
+	* Every second pass program, reduced resolution ones included (all need the effect uniforms)
+	*/
+	vector<GLuint> shadingPrograms() const;
+
+	/*
+	* Chooses the effects that run at reduced resolution (bit n = effect n, 0 = none) and by how much
+	* each axis is divided (2: a quarter of the effect runs, 4: a sixteenth). Lighting stays at full resolution.
+	*/
+	void setReduced(unsigned mask, int scale);
+
+	unsigned reducedEffects() const;
+	int reducedFactor() const;
+
+	/*
+	* Turns the temporal cache on or off: each frame a quarter of the pixels (rotating checkerboard) run
+	* their effect, the others reproject the previous frame's result when it is still valid.
+	* Takes precedence over reduced resolution effects.
+	*/
+	void setTemporal(bool on);
+	bool temporalCache() const;
+
+	/*
+	* Rotation angle and flow frame of the frame being drawn (the cache reprojects with their change)
+	*/
+	void setView(float angle, int frame);
+
+	/*
+	* Drops the cached results: call when effect parameters change, since the cache cannot tell
+	*/
+	void invalidateHistory();
+
+	/*
+	* Binds and clears the G-buffer (sized to the viewport) and makes the first pass program active
+	*/
+	void beginGeometry();
+
+	/*
+	* Draws the shaded pixels into the window with the second pass program (left active)
+	*/
+	void resolve();
+
+	/*
+	* Same as beginGeometry(), for a G-buffer shown with every effect (no effect cuts holes in it)
+	*/
+	void beginSheet();
+
+	/*
+	* Draws the G-buffer into the window once per effect, as a 3x3 grid (effect 0 top left)
+	*/
+	void resolveSheet();
+
+	/*
+	* Resolves the G-buffer twice, every effect at full resolution then with the reduced effects, timing both
+	* and comparing the resulting pixels. The reduced frame is left in the window. Slow (waits for the GPU).
+	*/
+	ReducedQuality compareReduced();
+
+	/*
+	* Reads back how many pixels each draw ended up covering (index = object id, 0 = background).
+	* Slow (waits for the GPU), only meant for statistics.
+	*/
+	vector<int> pixelsPerObject(int objects);
+};
+
+#endif
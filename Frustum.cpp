@@ -0,0 +1,41 @@
+#include "Frustum.h"
+#include <cmath>
+
+Frustum::Frustum(const Mat4& m)
+{
+	//rows of the (column-major) matrix
+	float row[4][4];
+	for (int r = 0; r < 4; r++)
+	{
+		for (int c = 0; c < 4; c++) row[r][c] = m[c * 4 + r];
+	}
+
+	//left/right, bottom/top, near/far: row4 +/- row1, row2, row3
+	for (int i = 0; i < 6; i++)
+	{
+		float sign = (i % 2 == 0) ? 1 : -1;
+		const float* axis = row[i / 2];
+
+		float length = 0;
+		for (int c = 0; c < 4; c++)
+		{
+			planes[i][c] = row[3][c] + sign * axis[c];
+			if (c < 3) length += planes[i][c] * planes[i][c];
+		}
+
+		length = sqrt(length);
+		for (int c = 0; c < 4; c++) planes[i][c] /= length;
+	}
+}
+
+bool Frustum::intersects(const Point& center, float radius) const
+{
+	for (const float* plane : planes)
+	{
+		float dist = plane[0] * center.x() + plane[1] * center.y() + plane[2] * center.z() + plane[3];
+
+		if (dist < -radius) return false;			// entirely on the outside of this plane
+	}
+
+	return true;
+}
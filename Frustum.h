@@ -0,0 +1,28 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "Point.h"
+#include "Transform.h"
+
+/*
+* The six clipping planes of a view-projection matrix, used to reject
+* bounding spheres that are completely outside of the view volume.
+*/
+class Frustum
+{
+private:
+	float planes[6][4];		// (a, b, c, d) of each plane, normalized so a*x + b*y + c*z + d is a distance (inside > 0)
+
+public:
+	/*
+	* Extracts the planes of the given view-projection matrix (Gribb-Hartmann)
+	*/
+	Frustum(const Mat4& viewProj);
+
+	/*
+	* True if any part of the sphere is inside the view volume
+	*/
+	bool intersects(const Point& center, float radius) const;
+};
+
+#endif
@@ -0,0 +1,263 @@
+#include "GpuResources.h"
+#include <utility>
+
+static GpuCounters counters;
+
+const GpuCounters& gpuCounters()
+{
+	return counters;
+}
+
+
+GpuBuffer::~GpuBuffer()
+{
+	release();
+}
+
+GpuBuffer::GpuBuffer(GpuBuffer&& other) noexcept
+	:
+	id(exchange(other.id, 0)),
+	capacity(exchange(other.capacity, 0))
+{
+}
+
+GpuBuffer& GpuBuffer::operator=(GpuBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		id = exchange(other.id, 0);
+		capacity = exchange(other.capacity, 0);
+	}
+
+	return *this;
+}
+
+void GpuBuffer::upload(const void* data, size_t bytes)
+{
+	if (id == 0)
+	{
+		glGenBuffers(1, &id);
+		if (id) counters.buffers++;				// (no name without a context)
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, id);
+
+	if (capacity > 0 && bytes <= capacity && bytes >= capacity / 2)
+	{
+		//orphan: the driver swaps in fresh storage of the same size, so draws still using the old contents do not stall us
+		glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_STATIC_DRAW);
+		if (data) glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+		return;
+	}
+
+	glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+
+	counters.bufferBytes += bytes;
+	counters.bufferBytes -= capacity;
+	capacity = bytes;
+}
+
+void GpuBuffer::release()
+{
+	if (id == 0) return;
+
+	glDeleteBuffers(1, &id);
+	counters.buffers--;
+	counters.bufferBytes -= capacity;
+
+	id = 0;
+	capacity = 0;
+}
+
+GLuint GpuBuffer::name() const
+{
+	return id;
+}
+
+size_t GpuBuffer::size() const
+{
+	return capacity;
+}
+
+
+VertexArray::~VertexArray()
+{
+	release();
+}
+
+VertexArray::VertexArray(VertexArray&& other) noexcept
+	:
+	id(exchange(other.id, 0))
+{
+}
+
+VertexArray& VertexArray::operator=(VertexArray&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		id = exchange(other.id, 0);
+	}
+
+	return *this;
+}
+
+void VertexArray::bind()
+{
+	if (id == 0)
+	{
+		glGenVertexArrays(1, &id);
+		if (id) counters.vertexArrays++;
+	}
+
+	glBindVertexArray(id);
+}
+
+void VertexArray::release()
+{
+	if (id == 0) return;
+
+	glDeleteVertexArrays(1, &id);
+	counters.vertexArrays--;
+	id = 0;
+}
+
+GLuint VertexArray::name() const
+{
+	return id;
+}
+
+
+GpuTexture::~GpuTexture()
+{
+	release();
+}
+
+GpuTexture::GpuTexture(GpuTexture&& other) noexcept
+	:
+	id(exchange(other.id, 0)),
+	bytes(exchange(other.bytes, 0))
+{
+}
+
+GpuTexture& GpuTexture::operator=(GpuTexture&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		id = exchange(other.id, 0);
+		bytes = exchange(other.bytes, 0);
+	}
+
+	return *this;
+}
+
+void GpuTexture::uploadCompressed(GLenum format, int width, int height, const void* data, size_t size)
+{
+	if (id == 0)
+	{
+		glGenTextures(1, &id);
+		if (id) counters.textures++;			// (no name without a context)
+	}
+
+	glBindTexture(GL_TEXTURE_2D, id);
+	glCompressedTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, (GLsizei)size, data);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);		// (uv lookups wrap around, like Image's)
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	counters.textureBytes += size;
+	counters.textureBytes -= bytes;
+	bytes = size;
+}
+
+void GpuTexture::release()
+{
+	if (id == 0) return;
+
+	glDeleteTextures(1, &id);
+	counters.textures--;
+	counters.textureBytes -= bytes;
+
+	id = 0;
+	bytes = 0;
+}
+
+GLuint GpuTexture::name() const
+{
+	return id;
+}
+
+size_t GpuTexture::size() const
+{
+	return bytes;
+}
+
+
+InvocationCounter::~InvocationCounter()
+{
+	if (id) glDeleteQueries(1, &id);
+}
+
+void InvocationCounter::begin()
+{
+	if (!GLEW_ARB_pipeline_statistics_query) return;
+
+	if (id == 0) glGenQueries(1, &id);
+	glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, id);
+}
+
+void InvocationCounter::end()
+{
+	if (id == 0) return;
+
+	glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+	issued = true;
+}
+
+long long InvocationCounter::result()
+{
+	if (!issued) return -1;
+
+	GLuint64 invocations = 0;
+	glGetQueryObjectui64v(id, GL_QUERY_RESULT, &invocations);
+	issued = false;
+
+	return (long long)invocations;
+}
+
+
+GpuTimer::~GpuTimer()
+{
+	if (id) glDeleteQueries(1, &id);
+}
+
+void GpuTimer::begin()
+{
+	if (id == 0) glGenQueries(1, &id);
+	if (id == 0) return;
+
+	glBeginQuery(GL_TIME_ELAPSED, id);
+}
+
+void GpuTimer::end()
+{
+	if (id == 0) return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	issued = true;
+}
+
+double GpuTimer::result()
+{
+	if (!issued) return -1;
+
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(id, GL_QUERY_RESULT, &nanoseconds);
+	issued = false;
+
+	return nanoseconds / 1e6;
+}
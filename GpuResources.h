@@ -0,0 +1,178 @@
+#ifndef GPURESOURCES_H
+#define GPURESOURCES_H
+
+#include <cstddef>
+#include <GL/glew.h>
+using namespace std;
+
+/*
+* Running totals of the GL objects alive through the classes below (to spot leaks, see soakReload())
+*/
+struct GpuCounters
+{
+	size_t bufferBytes = 0;				// storage allocated for buffers
+	int buffers = 0;					// buffer objects
+	int vertexArrays = 0;				// vertex array (layout) objects
+	size_t textureBytes = 0;			// storage of textures, as uploaded
+	int textures = 0;					// texture objects
+};
+
+/*
+* Current totals of every GpuBuffer, VertexArray and GpuTexture
+*/
+const GpuCounters& gpuCounters();
+
+
+/*
+* Owns one GL array buffer: deleted with the object, moved but never copied.
+* Uploading again reuses the buffer's storage when the new data fits.
+*/
+class GpuBuffer
+{
+private:
+	GLuint id = 0;
+	size_t capacity = 0;				// bytes of storage allocated for the buffer
+
+public:
+	GpuBuffer() = default;
+	~GpuBuffer();
+
+	GpuBuffer(const GpuBuffer&) = delete;
+	GpuBuffer& operator=(const GpuBuffer&) = delete;
+	GpuBuffer(GpuBuffer&& other) noexcept;
+	GpuBuffer& operator=(GpuBuffer&& other) noexcept;
+
+	/*
+	* Makes the buffer the active array buffer and fills it with 'bytes' of 'data' (nullptr = leave undefined).
+	* Storage that is big enough (but not more than twice as big) is orphaned and refilled instead of reallocated.
+	*/
+	void upload(const void* data, size_t bytes);
+
+	/*
+	* Deletes the GL buffer (the object can be uploaded to again)
+	*/
+	void release();
+
+	GLuint name() const;
+	size_t size() const;
+};
+
+
+/*
+* Owns one GL vertex array (layout) object, with the same lifetime rules as GpuBuffer
+*/
+class VertexArray
+{
+private:
+	GLuint id = 0;
+
+public:
+	VertexArray() = default;
+	~VertexArray();
+
+	VertexArray(const VertexArray&) = delete;
+	VertexArray& operator=(const VertexArray&) = delete;
+	VertexArray(VertexArray&& other) noexcept;
+	VertexArray& operator=(VertexArray&& other) noexcept;
+
+	/*
+	* Makes the vertex array active, creating it the first time
+	*/
+	void bind();
+
+	/*
+	* Deletes the GL vertex array
+	*/
+	void release();
+
+	GLuint name() const;
+};
+
+
+/*
+* Owns one GL 2D texture, with the same lifetime rules as GpuBuffer
+*/
+class GpuTexture
+{
+private:
+	GLuint id = 0;
+	size_t bytes = 0;					// bytes of the uploaded level
+
+public:
+	GpuTexture() = default;
+	~GpuTexture();
+
+	GpuTexture(const GpuTexture&) = delete;
+	GpuTexture& operator=(const GpuTexture&) = delete;
+	GpuTexture(GpuTexture&& other) noexcept;
+	GpuTexture& operator=(GpuTexture&& other) noexcept;
+
+	/*
+	* Makes the texture the active 2D texture and fills it with block compressed data of the given
+	* compressed 'format' (e.g. GL_COMPRESSED_RED_RGTC1), linearly filtered and repeating, without mipmaps
+	*/
+	void uploadCompressed(GLenum format, int width, int height, const void* data, size_t size);
+
+	/*
+	* Deletes the GL texture (the object can be uploaded to again)
+	*/
+	void release();
+
+	GLuint name() const;
+	size_t size() const;
+};
+
+
+/*
+* Counts the fragment shader runs of the commands between begin() and end()
+* (ARB_pipeline_statistics_query; without it result() is -1)
+*/
+class InvocationCounter
+{
+private:
+	GLuint id = 0;
+	bool issued = false;				// begin()/end() ran since the last result()
+
+public:
+	InvocationCounter() = default;
+	~InvocationCounter();
+
+	InvocationCounter(const InvocationCounter&) = delete;
+	InvocationCounter& operator=(const InvocationCounter&) = delete;
+
+	void begin();
+	void end();
+
+	/*
+	* Number of fragment shader runs (waits for the GPU, statistics only)
+	*/
+	long long result();
+};
+
+
+/*
+* Measures the GPU time taken by the commands between begin() and end()
+*/
+class GpuTimer
+{
+private:
+	GLuint id = 0;
+	bool issued = false;				// begin()/end() ran since the last result()
+
+public:
+	GpuTimer() = default;
+	~GpuTimer();
+
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	void begin();
+	void end();
+
+	/*
+	* Elapsed milliseconds (waits for the GPU), -1 when nothing was measured
+	*/
+	double result();
+};
+
+#endif
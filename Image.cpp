@@ -1,25 +1,209 @@
 #include "Image.h"
 #include "Color.h"
+#include "utils.h"
+#include "ImageEncoders.h"
 
 #include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <string>
 #include <ostream>
 #include <fstream>
 
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
 using uchar = unsigned char;
 
 
-void Image::setPixel(int w, int h, const Color& c) const
+/**
+ * Converts a float to a half float (rounded to nearest even, out of range values become infinite)
+ */
+static uint16_t floatToHalf(float f)
 {
-	image[h][w] = c;
+	uint32_t x = std::bit_cast<uint32_t>(f);
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t mantissa = x & 0x7fffff;
+	int exponent = (int)((x >> 23) & 0xff) - 127 + 15;
+
+	if (((x >> 23) & 0xff) == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0);		// infinity, NaN
+	if (exponent >= 31) return sign | 0x7c00;
+
+	//too small for a normal half: subnormal (or 0), the implicit 1 shifted in
+	int shift = exponent <= 0 ? 14 - exponent : 13;
+	if (shift > 24) return sign;
+
+	uint32_t bits = exponent <= 0 ? (mantissa | 0x800000) >> shift : ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t rest = (exponent <= 0 ? mantissa | 0x800000 : mantissa) & ((1u << shift) - 1);
+	uint32_t middle = 1u << (shift - 1);
+
+	if (rest > middle || (rest == middle && (bits & 1))) bits++;						// (a carry moves into the exponent, as it should)
+	return sign | bits;
 }
 
+/**
+ * Converts a half float to a float (exactly)
+ */
+static float halfToFloat(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
 
-Color Image::getPixel(int w, int h) const
-{	
+	if (exponent == 0)
+	{
+		float value = mantissa * (1.0f / (1 << 24));									// subnormal (or 0)
+		return sign ? -value : value;
+	}
+	if (exponent == 31) return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+
+	return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+/**
+ * Bytes each texel of a format takes
+ */
+static int formatBytes(PixelFormat format)
+{
+	switch (format)
+	{
+		case PixelFormat::RGB32F: return 12;
+		case PixelFormat::RGB16F: return 6;
+		case PixelFormat::R16F: return 2;
+		case PixelFormat::RGB8: return 3;
+		default: return 1;
+	}
+}
+
+
+int Image::getWidth() const
+{
+	return width;
+}
+
+
+int Image::getHeight() const
+{
+	return height;
+}
+
+
+PixelFormat Image::getFormat() const
+{
+	return format;
+}
+
+
+size_t Image::memoryBytes() const
+{
+	return texels.capacity();
+}
+
+
+uint64_t Image::contentHash() const
+{
+	int header[3] = { width, height, (int)format };
+	return hashBytes(texels.data(), texels.size(), hashBytes(header, sizeof(header)));
+}
+
+
+const unsigned char* Image::texel(int w, int h) const
+{
 	int wrapH = (h % height + height) % height;						//handle wrapping around in both directions
-	int wrapW = (w % width + width) % width;							
-	return image[wrapH][wrapW];											
+	int wrapW = (w % width + width) % width;
+	return &texels[((size_t)wrapH * width + wrapW) * pixelBytes];
+}
+
+
+void Image::setPixel(int w, int h, const Color& c)
+{
+	unsigned char* p = &texels[((size_t)h * width + w) * pixelBytes];
+	float rgb[3] = { c.r(), c.g(), c.b() };
+
+	//one channel formats keep the gray value; 8 bits never round a nonzero one down to 0 (masks test for > 0)
+	auto level = [&](float value) {
+		uchar byte = (uchar)std::min(255.0f, value * byteMax + 0.5f);
+		return (value > 0 && byte == 0) ? (uchar)1 : byte;
+	};
+
+	switch (format)
+	{
+		case PixelFormat::RGB32F:
+			memcpy(p, rgb, sizeof(rgb));
+			break;
+		case PixelFormat::RGB16F:
+			for (int i = 0; i < 3; i++)
+			{
+				uint16_t half = floatToHalf(rgb[i]);
+				memcpy(p + i * 2, &half, 2);
+			}
+			break;
+		case PixelFormat::R16F:
+		{
+			uint16_t half = floatToHalf(gray(c));
+			memcpy(p, &half, 2);
+			break;
+		}
+		case PixelFormat::RGB8:
+			for (int i = 0; i < 3; i++) p[i] = level(rgb[i]);
+			break;
+		case PixelFormat::R8:
+			p[0] = level(gray(c));
+			break;
+	}
+}
+
+
+Color Image::getPixel(int w, int h) const
+{
+	const unsigned char* p = texel(w, h);
+
+	//decoded to float whatever the storage
+	switch (format)
+	{
+		case PixelFormat::RGB32F:
+		{
+			float rgb[3];
+			memcpy(rgb, p, sizeof(rgb));
+			return Color(rgb[0], rgb[1], rgb[2]);
+		}
+		case PixelFormat::RGB16F:
+		{
+			uint16_t half[3];
+			memcpy(half, p, sizeof(half));
+			return Color(halfToFloat(half[0]), halfToFloat(half[1]), halfToFloat(half[2]));
+		}
+		case PixelFormat::R16F:
+		{
+			uint16_t half;
+			memcpy(&half, p, 2);
+			float value = halfToFloat(half);
+			return Color(value, value, value);
+		}
+		case PixelFormat::RGB8:
+			return Color(byteValues[p[0]], byteValues[p[1]], byteValues[p[2]]);
+		default:
+			return Color(byteValues[p[0]], byteValues[p[0]], byteValues[p[0]]);
+	}
+}
+
+
+float Image::grayPixel(int w, int h) const
+{
+	if (format == PixelFormat::R8) return byteValues[*texel(w, h)];
+
+	if (format == PixelFormat::R16F)
+	{
+		uint16_t half;
+		memcpy(&half, texel(w, h), 2);
+		return halfToFloat(half);
+	}
+
+	return gray(getPixel(w, h));
 }
 
 
@@ -60,17 +244,32 @@ Color Image::rgb_wh(float w, float h) const
 
 float Image::gray_uv(float u, float v) const
 {
-	Color c = this->rgb_uv(u, v);
-
-	return gray(c);
+	return gray_wh(u * width, v * height);
 }
 
 
 float Image::gray_wh(float w, float h) const
 {
-	Color c = this->rgb_wh(w, h);
+	if (format != PixelFormat::R8 && format != PixelFormat::R16F)
+	{
+		Color c = this->rgb_wh(w, h);
+
+		return gray(c);
+	}
+
+	//one channel: interpolated directly (same weights as getPixel(float, float)), no colors built
+	float i0 = w - floor(w);
+	float i1 = 1 - i0;
+	float j0 = h - floor(h);
+	float j1 = 1 - j0;
+
+	int x = floor(w);
+	int y = floor(h);
 
-	return gray(c);
+	float g1 = j0 * grayPixel(x, y + 1) + j1 * grayPixel(x, y);
+	float g2 = j0 * grayPixel(x + 1, y + 1) + j1 * grayPixel(x + 1, y);
+
+	return i0 * g2 + i1 * g1;
 }
 
 
@@ -95,60 +294,290 @@ pair<float, float> Image::gradient_wh(float w, float h) const
 }
 
 
-Image::Image(int width, int height)
+/**
+ * Color clamps every value it is given above 1: the same on plain floats
+ */
+static float clampOne(float value)
+{
+	return value > 1 ? 1.0f : value;
+}
+
+/**
+ * Decodes one texel stored as 'Storage' into rgb, as getPixel(int, int) does (clamped as its Color is)
+ */
+template <PixelFormat Storage>
+static std::array<float, 3> decodeColor(const uchar* p, const std::array<float, 256>& byteValues)
+{
+	float rgb[3];
+
+	if constexpr (Storage == PixelFormat::RGB32F) memcpy(rgb, p, sizeof(rgb));
+	else if constexpr (Storage == PixelFormat::RGB16F)
+	{
+		uint16_t half[3];
+		memcpy(half, p, sizeof(half));
+		for (int c = 0; c < 3; c++) rgb[c] = halfToFloat(half[c]);
+	}
+	else if constexpr (Storage == PixelFormat::R16F)
+	{
+		uint16_t half;
+		memcpy(&half, p, 2);
+		rgb[0] = rgb[1] = rgb[2] = halfToFloat(half);
+	}
+	else if constexpr (Storage == PixelFormat::RGB8)
+	{
+		for (int c = 0; c < 3; c++) rgb[c] = byteValues[p[c]];
+	}
+	else rgb[0] = rgb[1] = rgb[2] = byteValues[p[0]];
+
+	return { clampOne(rgb[0]), clampOne(rgb[1]), clampOne(rgb[2]) };
+}
+
+/**
+ * Decodes the gray value of one texel of a one channel format, as grayPixel() does
+ */
+template <PixelFormat Storage>
+static float decodeGray(const uchar* p, const std::array<float, 256>& byteValues)
+{
+	static_assert(Storage == PixelFormat::R8 || Storage == PixelFormat::R16F);
+
+	if constexpr (Storage == PixelFormat::R8) return byteValues[p[0]];
+	else
+	{
+		uint16_t half;
+		memcpy(&half, p, 2);
+		return halfToFloat(half);
+	}
+}
+
+/**
+ * Wraps a texel coordinate around the edges as texel() does (the division only for coordinates outside)
+ */
+static int wrapTexel(int i, int size)
+{
+	return (unsigned)i < (unsigned)size ? i : (i % size + size) % size;
+}
+
+
+template <PixelFormat Storage>
+Color Image::bilinearColor(float w, float h) const
+{
+	//same weights and order of operations as getPixel(float, float)
+	float i0 = w - floor(w);
+	float i1 = 1 - i0;
+	float j0 = h - floor(h);
+	float j1 = 1 - j0;
+
+	int x0 = wrapTexel(floor(w), width), y0 = wrapTexel(floor(h), height);
+	int x1 = x0 + 1 == width ? 0 : x0 + 1, y1 = y0 + 1 == height ? 0 : y0 + 1;
+
+	const uchar* row0 = &texels[(size_t)y0 * width * pixelBytes];
+	const uchar* row1 = &texels[(size_t)y1 * width * pixelBytes];
+	std::array<float, 3> t00 = decodeColor<Storage>(row0 + (size_t)x0 * pixelBytes, byteValues);
+	std::array<float, 3> t01 = decodeColor<Storage>(row1 + (size_t)x0 * pixelBytes, byteValues);
+	std::array<float, 3> t10 = decodeColor<Storage>(row0 + (size_t)x1 * pixelBytes, byteValues);
+	std::array<float, 3> t11 = decodeColor<Storage>(row1 + (size_t)x1 * pixelBytes, byteValues);
+
+	//the Color arithmetic of getPixel(float, float), channel by channel (each product and sum clamped as a Color)
+	float rgb[3];
+	for (int c = 0; c < 3; c++)
+	{
+		float c1 = clampOne(clampOne(j0 * t01[c]) + clampOne(j1 * t00[c]));
+		float c2 = clampOne(clampOne(j0 * t11[c]) + clampOne(j1 * t10[c]));
+		rgb[c] = clampOne(clampOne(i0 * c2) + clampOne(i1 * c1));
+	}
+
+	return Color(rgb[0], rgb[1], rgb[2]);
+}
+
+
+template <PixelFormat Storage>
+float Image::bilinearGray(float w, float h) const
+{
+	//colors are interpolated before taking their gray value, as gray_wh() does
+	if constexpr (Storage != PixelFormat::R8 && Storage != PixelFormat::R16F) return gray(bilinearColor<Storage>(w, h));
+	else
+	{
+		float i0 = w - floor(w);
+		float i1 = 1 - i0;
+		float j0 = h - floor(h);
+		float j1 = 1 - j0;
+
+		int x0 = wrapTexel(floor(w), width), y0 = wrapTexel(floor(h), height);
+		int x1 = x0 + 1 == width ? 0 : x0 + 1, y1 = y0 + 1 == height ? 0 : y0 + 1;
+
+		const uchar* row0 = &texels[(size_t)y0 * width * pixelBytes];
+		const uchar* row1 = &texels[(size_t)y1 * width * pixelBytes];
+		auto at = [&](const uchar* row, int x) { return decodeGray<Storage>(row + (size_t)x * pixelBytes, byteValues); };
+
+		float g1 = j0 * at(row1, x0) + j1 * at(row0, x0);
+		float g2 = j0 * at(row1, x1) + j1 * at(row0, x1);
+
+		return i0 * g2 + i1 * g1;
+	}
+}
+
+
+template <PixelFormat Storage>
+Color Image::sampleColor(const Image& image, float u, float v)
+{
+	return image.bilinearColor<Storage>(u * image.width, v * image.height);
+}
+
+
+template <PixelFormat Storage>
+pair<float, float> Image::sampleGradient(const Image& image, float u, float v)
+{
+	//same steps as gradient(), through gray_uv()
+	auto grayAt = [&](float u, float v) { return image.bilinearGray<Storage>(u * image.width, v * image.height); };
+
+	float incrU = 1.0 / image.width;
+	float incrV = 1.0 / image.height;
+	float du = (grayAt(u + incrU, v) - grayAt(u - incrU, v)) / 2;
+	float dv = (grayAt(u, v + incrV) - grayAt(u, v - incrV)) / 2;
+
+	return pair<float, float> {du, dv};
+}
+
+
+Image::ColorSampler Image::colorSampler() const
+{
+	switch (format)
+	{
+		case PixelFormat::RGB32F: return &sampleColor<PixelFormat::RGB32F>;
+		case PixelFormat::RGB16F: return &sampleColor<PixelFormat::RGB16F>;
+		case PixelFormat::R16F: return &sampleColor<PixelFormat::R16F>;
+		case PixelFormat::RGB8: return &sampleColor<PixelFormat::RGB8>;
+		default: return &sampleColor<PixelFormat::R8>;
+	}
+}
+
+
+Image::GradientSampler Image::gradientSampler() const
+{
+	switch (format)
+	{
+		case PixelFormat::RGB32F: return &sampleGradient<PixelFormat::RGB32F>;
+		case PixelFormat::RGB16F: return &sampleGradient<PixelFormat::RGB16F>;
+		case PixelFormat::R16F: return &sampleGradient<PixelFormat::R16F>;
+		case PixelFormat::RGB8: return &sampleGradient<PixelFormat::RGB8>;
+		default: return &sampleGradient<PixelFormat::R8>;
+	}
+}
+
+
+Image::Image(int width, int height, PixelFormat format)
 	:
 	width(width),
 	height(height)
 {
-	makeCanvas();
+	makeCanvas(format);
 	clear();
 }
 
 
-Image::~Image()
+Image::Image(const string& filename, bool grayOnly)
 {
-	destroyCanvas();
+	std::ifstream ifs(filename, std::ios::binary);
+
+	string token;
+	ifs >> token;				// type of file: 'P6' (8 bit PPM), 'PF' / 'Pf' (color / gray PFM)
+
+	if (token == "PF" || token == "Pf") readPfm(ifs, token, grayOnly);
+	else readPpm(ifs, grayOnly);
 }
 
 
-Image::Image(string filename)
+Image::Image(const Image& other, PixelFormat format)
+	:
+	width(other.width),
+	height(other.height)
 {
-	std::ifstream ifs(filename, std::ios::binary);
+	makeCanvas(format);
 
-	string token;
+	//8 bit copies of 8 bit images keep their levels
+	byteMax = other.byteMax;
+	byteValues = other.byteValues;
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			setPixel(x, y, other.getPixel(x, y));
+		}
+	}
+}
+
+
+void Image::readPpm(std::istream& ifs, bool grayOnly)
+{
 	float channelMax;
 
 	// read header info
-	ifs >> token;				// type of PPM file
 	ifs >> width >> height;		// width, height of image
 	ifs >> channelMax;			// max value per channel
 
 
-	//make the 'canvas' before writing to it
-	makeCanvas();
+	//make the 'canvas' before writing to it: 8 bit texels, each level read back as level / channelMax
+	makeCanvas(grayOnly ? PixelFormat::R8 : PixelFormat::RGB8);
+	byteMax = channelMax;
+	for (int level = 0; level < 256; level++) byteValues[level] = level / channelMax;
 
 
 	// read rgb info
 	ifs.ignore(1024, '\n');		// will remove the '\n' after 255
-	ifs >> noskipws;			// will ensure spaces are not skipped
-
-	uchar r;
-	uchar g;
-	uchar b;
-	Color color;
 
+	std::vector<uchar> row((size_t)width * 3);
 	for (int y = 0; y < height; y++)
 	{
+		ifs.read((char*)row.data(), row.size());					// read in triples for each rgb value
+
 		for (int x = 0; x < width; x++)
 		{
-			ifs >> r >> g >> b;								// read in triples for each rgb value
+			const uchar* rgb = &row[(size_t)x * 3];
+			uchar* p = &texels[((size_t)y * width + x) * pixelBytes];
+
+			if (!grayOnly)
+			{
+				memcpy(p, rgb, 3);										// kept as read
+			}
+			else if (rgb[0] == rgb[1] && rgb[1] == rgb[2])
+			{
+				p[0] = rgb[0];											// gray already: nothing lost
+			}
+			else
+			{
+				setPixel(x, y, Color(byteValues[rgb[0]], byteValues[rgb[1]], byteValues[rgb[2]]));
+			}
+		}
+	}
+}
 
-			float rComp = (int)r / channelMax;
-			float gComp = (int)g / channelMax;
-			float bComp = (int)b / channelMax;
-			color = Color(rComp, gComp, bComp);				// convert from [0 to channelMax] into [0 to 1] and create color
 
-			setPixel(x, y, color);							// set this pixel in the image	
+void Image::readPfm(std::istream& ifs, const string& type, bool grayOnly)
+{
+	float scale;
+	ifs >> width >> height >> scale;			// a negative scale means little endian floats
+	ifs.ignore(1024, '\n');
+
+	int channels = type == "PF" ? 3 : 1;
+	makeCanvas(grayOnly || channels == 1 ? PixelFormat::R16F : PixelFormat::RGB16F);
+
+	//rows are stored bottom first, the image keeps them top first
+	std::vector<float> row((size_t)width * channels);
+	for (int y = height - 1; y >= 0; y--)
+	{
+		ifs.read((char*)row.data(), row.size() * sizeof(float));
+
+		for (float& value : row)
+		{
+			if ((scale < 0) != (std::endian::native == std::endian::little)) value = std::bit_cast<float>(std::byteswap(std::bit_cast<uint32_t>(value)));
+			value = std::max(value, 0.0f);										// (colors are never negative)
+		}
+
+		for (int x = 0; x < width; x++)
+		{
+			const float* v = &row[(size_t)x * channels];
+			setPixel(x, y, channels == 3 ? Color(v[0], v[1], v[2]) : Color(v[0], v[0], v[0]));
 		}
 	}
 }
@@ -161,26 +590,75 @@ void Image::clear()
 }
 
 
+/**
+ * Converts floats to bytes, rounded: uchar(255 * value + 0.5f) each, values outside [0, 1] clamped (AVX: 8 at a time)
+ */
+static void floatsToBytes(const float* values, size_t count, uchar* out)
+{
+	size_t i = 0;
+#ifdef __AVX__
+	__m256 scale = _mm256_set1_ps(255), half = _mm256_set1_ps(0.5f);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i levels = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(values + i), scale), half));
+		__m128i words = _mm_packs_epi32(_mm256_castsi256_si128(levels), _mm256_extractf128_si256(levels, 1));
+		_mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(words, words));
+	}
+#endif
+	for (; i < count; i++) out[i] = uchar(std::clamp(255 * values[i] + 0.5f, 0.0f, 255.0f));		// (saturated like the packs above)
+}
+
+
+std::vector<unsigned char> Image::rgbBytes() const
+{
+	std::vector<uchar> bytes((size_t)width * height * 3);
+
+	//a row at a time, straight from the texels: float texels through the vector kernel, bytes read at 0..255 as they are
+	for (int y = 0; y < height; ++y) {
+		uchar* row = &bytes[(size_t)y * width * 3];
+		const uchar* source = &texels[(size_t)y * width * pixelBytes];
+
+		if (format == PixelFormat::RGB32F) {
+			floatsToBytes((const float*)source, (size_t)width * 3, row);
+		}
+		else if (format == PixelFormat::RGB8 && byteMax == 255) {
+			memcpy(row, source, (size_t)width * 3);
+		}
+		else {
+			for (int x = 0; x < width; ++x) {
+				Color c = getPixel(x, y);
+				float rgb[3] = { c.r(), c.g(), c.b() };
+				floatsToBytes(rgb, 3, row + x * 3);
+			}
+		}
+	}
+
+	return bytes;
+}
+
+
 void Image::saveImage(const std::string& file_name) const
 {
+	std::vector<uchar> bytes = rgbBytes();					// rounded: 8 bit colors are saved unchanged
+	std::string extension = std::filesystem::path(file_name).extension().string();
+
 	std::ofstream ofs(file_name.c_str(), std::ios::binary);
 
-	// write the header information
+	if (extension == ".qoi" || extension == ".png") {
+		std::vector<uchar> file = extension == ".qoi" ? encodeQoi(bytes.data(), width, height) : encodePng(bytes.data(), width, height);
+		ofs.write((const char*)file.data(), file.size());
+		return;
+	}
+
+	// write the header information, then the image data in one go
 	ofs << "P6" << std::endl;
 	ofs << width << "\t" << height << std::endl;
 	ofs << 255 << std::endl;
-
-	// save the image data one row at a time
-	for (int y = 0; y < height; ++y) {
-		for (int x = 0; x < width; ++x) {
-			Color c = getPixel(x, y);
-			ofs << uchar(255 * c.r()) << uchar(255 * c.g()) << uchar(255 * c.b());
-		}
-	}
+	ofs.write((const char*)bytes.data(), bytes.size());
 }
 
 
-void Image::fillRegion(int w0, int h0, int width, int height, const Color& c) const
+void Image::fillRegion(int w0, int h0, int width, int height, const Color& c)
 {
 	int w1 = w0 + width;
 	int h1 = h0 + height;
@@ -193,19 +671,11 @@ void Image::fillRegion(int w0, int h0, int width, int height, const Color& c) co
 }
 
 
-void Image::makeCanvas()
+void Image::makeCanvas(PixelFormat storage)
 {
-	image = new Color * [height];
-	for (int h = 0; h < height; ++h) {
-		image[h] = new Color[width];
-	}
-}
-
+	format = storage;
+	pixelBytes = formatBytes(storage);
+	texels.assign((size_t)width * height * pixelBytes, 0);
 
-void Image::destroyCanvas() const
-{
-	for (int h = 0; h < height; ++h) {
-		delete[] image[h];
-	}
-	delete[] image;
-}
\ No newline at end of file
+	for (int level = 0; level < 256; level++) byteValues[level] = level / byteMax;
+}
@@ -5,6 +5,7 @@
 // * create a view area of given dimensions
 // * set and retrieve the color of a pixel
 // * save the view area as a PPM image
+// * store the texels in reduced precision (8 bit, half float, one channel), decoded to float when read
 
 
 #ifndef IMAGE_H
@@ -12,7 +13,23 @@
 
 #include "Color.h"
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
+
+/**
+ * How an image stores its texels (every format is read back as float colors)
+ */
+enum class PixelFormat
+{
+	RGB32F,		// three floats (12 bytes): any color, e.g. rendered images
+	RGB16F,		// three half floats (6 bytes): more than 8 bits of precision, e.g. float (PFM) files
+	R16F,		// one half float (2 bytes): the gray value only, read back as r = g = b
+	RGB8,		// three bytes: 8 bit color files, as read
+	R8			// one byte: the gray value only (masks, bump maps), read back as r = g = b
+};
 
 class Image
 {
@@ -22,17 +39,36 @@ public:
 	 *     x in [0, w-1]
 	 *     y in [0, h-1]
 	 */
-	Image(int w, int h);
+	Image(int w, int h, PixelFormat format = PixelFormat::RGB32F);
 
 	/**
-	 * Frees the storage used for various buffers.
-	 */
-	~Image();
+	* Creates an image from a binary PPM file (stored as RGB8) or a PFM file (RGB16F).
+	* 'grayOnly' keeps just the gray value (R8 / R16F), for images read as gray (masks, bump maps):
+	* a gray file (r = g = b) loses nothing, and nonzero gray values stay nonzero.
+	*/
+	Image(const string& filename, bool grayOnly = false);
 
 	/**
-	* Creates a color image from a binary PPM file
+	* Copy of an image, stored in another format
 	*/
-	Image(string filename);
+	Image(const Image& other, PixelFormat format);
+
+	/**
+	 * Returns the storage format, and the bytes of texels it takes.
+	 */
+	PixelFormat getFormat() const;
+	size_t memoryBytes() const;
+
+	/**
+	 * Returns a hash of the dimensions, format and texels (equal images in the same format hash the same).
+	 */
+	uint64_t contentHash() const;
+
+	/**
+	 * Returns the dimensions of the viewable area.
+	 */
+	int getWidth() const;
+	int getHeight() const;
 
 	/**
 	 * Returns the color of the pixel with the given coordinates (x, y).
@@ -65,9 +101,9 @@ public:
 	float gray_wh(float w, float h) const;
 
 	/**
-	 * Sets the pixel with the given coordinates (x, y) to the given color c.
+	 * Sets the pixel with the given coordinates (x, y) to the given color c (rounded to the storage format).
 	 */
-	void setPixel(int x, int y, const Color& c) const;
+	void setPixel(int x, int y, const Color& c);
 
 	/**
 	* Returns a pair (du, dv) that represents the image gradient along
@@ -81,12 +117,28 @@ public:
 	*/
 	pair<float, float> gradient_wh(float w, float h) const;
 
+	/**
+	 * rgb_uv() and gradient() specialized for the storage format, for callers that sample one image many times:
+	 * the format is decided once, when the sampler is chosen, instead of for every texel. Same results, bit for bit.
+	 */
+	using ColorSampler = Color (*)(const Image& image, float u, float v);
+	using GradientSampler = pair<float, float> (*)(const Image& image, float u, float v);
+
+	ColorSampler colorSampler() const;
+	GradientSampler gradientSampler() const;
+
 
 	/**
-	 * Saves a PPM image (in raw, i.e.binary format) to a file with the given name.
+	 * Saves the image to a file with the given name, as 8 bit colors in one write: a QOI file for a '.qoi' name,
+	 * a PNG file for '.png', otherwise a PPM image (in raw, i.e.binary format).
 	 */
 	void saveImage(const std::string& file_name) const;
 
+	/**
+	 * Returns the colors as 8 bit rgb values (3 bytes per pixel, rows top first), rounded as saved.
+	 */
+	std::vector<unsigned char> rgbBytes() const;
+
 	/**
 	 * Erases the canvas. The view area is set to black and border to gray.
 	 */
@@ -97,25 +149,58 @@ private:
 	 * Fills in the given color a rectangular region anchored at (w0, h0) and
 	 * extending *width* units horizontally and *height* units vertically.
 	 */
-	void fillRegion(int w0, int h0, int width, int height, const Color& c) const;
+	void fillRegion(int w0, int h0, int width, int height, const Color& c);
 
 	/**
-	 * Reserves a 2D array for the color buffer of appropriate size (view + border).
+	 * Sets the format and reserves the texels (all zero).
 	 */
-	void makeCanvas();
+	void makeCanvas(PixelFormat storage);
 
 	/**
-	 * Frees the storage used for the color buffer.
+	 * Returns the first byte of the texel at (x, y), wrapped around the edges.
 	 */
-	void destroyCanvas() const;
+	const unsigned char* texel(int x, int y) const;
+
+	/**
+	 * Returns the gray value of the pixel with the given coordinates (straight from the channel of one channel formats).
+	 */
+	float grayPixel(int x, int y) const;
+
+	/**
+	 * getPixel(float, float) and gray_wh() for texels known to be stored as 'Storage'
+	 */
+	template <PixelFormat Storage>
+	Color bilinearColor(float w, float h) const;
+	template <PixelFormat Storage>
+	float bilinearGray(float w, float h) const;
+
+	/**
+	 * The samplers colorSampler() and gradientSampler() choose from
+	 */
+	template <PixelFormat Storage>
+	static Color sampleColor(const Image& image, float u, float v);
+	template <PixelFormat Storage>
+	static pair<float, float> sampleGradient(const Image& image, float u, float v);
+
+	/**
+	 * Reads the texels of a PPM (P6) or PFM (PF / Pf) file whose type token was read.
+	 */
+	void readPpm(std::istream& is, bool grayOnly);
+	void readPfm(std::istream& is, const string& type, bool grayOnly);
 
 private:
 	// the canvas dimensions
 	int width;
 	int height;
 
-	// the color buffer
-	Color** image = nullptr;
+	// the texels, rows top first, in the storage format
+	PixelFormat format = PixelFormat::RGB32F;
+	int pixelBytes = 12;
+	std::vector<unsigned char> texels;
+
+	// 8 bit formats: the value each level stands for (level / the file's channel maximum)
+	float byteMax = 255;
+	std::array<float, 256> byteValues;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,483 @@
+#include "ImageEncoders.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// rows filtered and deflated together by one thread of the PNG encoder (fewer for small images: one band per thread)
+const int BAND_ROWS = 64;
+
+// deflate: furthest back a match may reach, its longest length, and candidates tried per position
+const int WINDOW = 32768;
+const int MAX_MATCH = 258;
+const int MAX_CHAIN = 8;
+
+/*
+* Appends a 32 bit value, most significant byte first (QOI and PNG headers)
+*/
+static void putBigEndian(vector<uint8_t>& out, uint32_t value)
+{
+	for (int shift = 24; shift >= 0; shift -= 8) out.push_back((uint8_t)(value >> shift));
+}
+
+vector<uint8_t> encodeQoi(const uint8_t* rgb, int width, int height)
+{
+	vector<uint8_t> out = { 'q', 'o', 'i', 'f' };
+	putBigEndian(out, width);
+	putBigEndian(out, height);
+	out.push_back(3);										// channels: rgb
+	out.push_back(0);										// sRGB with linear alpha
+
+	//colors as 0xrrggbb (alpha is always 255), the last one written, and the table of recently seen ones
+	auto hash = [](uint32_t c) { return ((c >> 16) * 3 + ((c >> 8) & 255) * 5 + (c & 255) * 7 + 255 * 11) % 64; };
+	array<uint32_t, 64> seen = {};
+	seen.fill(0xffffffff);
+	uint32_t previous = 0;
+	int run = 0;
+
+	size_t pixels = (size_t)width * height;
+	out.reserve(out.size() + pixels * 2);
+
+	for (size_t i = 0; i < pixels; i++)
+	{
+		const uint8_t* p = rgb + i * 3;
+		uint32_t color = (p[0] << 16) | (p[1] << 8) | p[2];
+
+		if (color == previous)
+		{
+			run++;
+			if (run == 62 || i + 1 == pixels)
+			{
+				out.push_back((uint8_t)(0xc0 | (run - 1)));	// QOI_OP_RUN
+				run = 0;
+			}
+			continue;
+		}
+
+		if (run > 0)
+		{
+			out.push_back((uint8_t)(0xc0 | (run - 1)));
+			run = 0;
+		}
+
+		int index = hash(color);
+		if (seen[index] == color)
+		{
+			out.push_back((uint8_t)index);					// QOI_OP_INDEX
+		}
+		else
+		{
+			seen[index] = color;
+
+			//differences from the previous color, wrapping around like bytes do
+			int dr = (int8_t)(p[0] - (previous >> 16)), dg = (int8_t)(p[1] - ((previous >> 8) & 255)), db = (int8_t)(p[2] - (previous & 255));
+			int drg = dr - dg, dbg = db - dg;
+
+			if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+			{
+				out.push_back((uint8_t)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));		// QOI_OP_DIFF
+			}
+			else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+			{
+				out.push_back((uint8_t)(0x80 | (dg + 32)));									// QOI_OP_LUMA
+				out.push_back((uint8_t)((drg + 8) << 4 | (dbg + 8)));
+			}
+			else
+			{
+				out.insert(out.end(), { 0xfe, p[0], p[1], p[2] });							// QOI_OP_RGB
+			}
+		}
+		previous = color;
+	}
+
+	out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });		// end marker
+	return out;
+}
+
+
+/*
+* Writes deflate bits, least significant first (Huffman codes, stored most significant bit first, come bit reversed)
+*/
+struct BitWriter
+{
+	vector<uint8_t>& out;
+	uint64_t bits = 0;
+	int count = 0;
+
+	void put(uint32_t value, int length)
+	{
+		bits |= (uint64_t)value << count;
+		count += length;
+		if (count >= 32)
+		{
+			//whole bytes leave 4 at a time
+			uint8_t bytes[4] = { (uint8_t)bits, (uint8_t)(bits >> 8), (uint8_t)(bits >> 16), (uint8_t)(bits >> 24) };
+			out.insert(out.end(), bytes, bytes + 4);
+			bits >>= 32;
+			count -= 32;
+		}
+	}
+
+	void align()
+	{
+		for (; count > 0; count -= 8)
+		{
+			out.push_back((uint8_t)bits);
+			bits >>= 8;
+		}
+		bits = 0;
+		count = 0;
+	}
+};
+
+/*
+* Symbol of the fixed deflate code for a literal byte, a length symbol (257..285) or the end of a block (256)
+*/
+static void putFixedSymbol(BitWriter& writer, int symbol)
+{
+	//codes bit reversed once, ready to be written least significant bit first
+	static const auto CODES = []() {
+		array<pair<uint16_t, uint8_t>, 288> codes;
+		for (int s = 0; s < 288; s++)
+		{
+			uint32_t code = s < 144 ? 0x30 + s : s < 256 ? 0x190 + s - 144 : s < 280 ? s - 256 : 0xc0 + s - 280;
+			int length = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+
+			uint32_t reversed = 0;
+			for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+			codes[s] = { (uint16_t)reversed, (uint8_t)length };
+		}
+		return codes;
+	}();
+
+	writer.put(CODES[symbol].first, CODES[symbol].second);
+}
+
+/*
+* A match of 'length' bytes 'distance' back, as length and distance symbols with their extra bits
+*/
+static void putMatch(BitWriter& writer, int length, int distance)
+{
+	static const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const int DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+		2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const auto REVERSED_DISTANCE = []() {				// fixed 5 bit distance codes, bit reversed
+		array<uint32_t, 30> codes;
+		for (uint32_t d = 0; d < 30; d++) codes[d] = (d & 1) << 4 | (d & 2) << 2 | (d & 4) | (d & 8) >> 2 | (d & 16) >> 4;
+		return codes;
+	}();
+	static const int DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	int l = (int)(upper_bound(LENGTH_BASE, LENGTH_BASE + 29, length) - LENGTH_BASE) - 1;
+	putFixedSymbol(writer, 257 + l);
+	writer.put(length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+
+	int d = (int)(upper_bound(DISTANCE_BASE, DISTANCE_BASE + 30, distance) - DISTANCE_BASE) - 1;
+	writer.put(REVERSED_DISTANCE[d], 5);
+	writer.put(distance - DISTANCE_BASE[d], DISTANCE_EXTRA[d]);
+}
+
+/*
+* Deflates 'data' as fixed code blocks (not final) followed by an empty stored block, so the output ends on a byte
+* boundary and another band's output can follow it. Matches are found through hash chains of 3 byte prefixes.
+*/
+static vector<uint8_t> deflateBand(const vector<uint8_t>& data)
+{
+	vector<uint8_t> out;
+	out.reserve(data.size() / 2);
+	BitWriter writer{ out };
+	writer.put(0b010, 3);									// not final, fixed codes
+
+	const int HASH_BITS = 15;
+	vector<int> head(1 << HASH_BITS, -1), previous(data.size(), -1);
+	auto hash = [&](size_t i) { return ((data[i] << 16 | data[i + 1] << 8 | data[i + 2]) * 2654435761u) >> (32 - HASH_BITS); };
+
+	size_t i = 0;
+	while (i < data.size())
+	{
+		int bestLength = 0, bestDistance = 0;
+
+		if (i + 3 <= data.size())
+		{
+			//longest match among the most recent positions with the same prefix
+			int limit = (int)min((size_t)MAX_MATCH, data.size() - i);
+			int candidate = head[hash(i)];
+			for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 && (int)i - candidate <= WINDOW; chain++)
+			{
+				//(a candidate that cannot beat the best so far differs at the byte past it)
+				if (data[candidate + bestLength] != data[i + bestLength])
+				{
+					candidate = previous[candidate];
+					continue;
+				}
+
+				int length = 0;
+				while (length < limit && data[candidate + length] == data[i + length]) length++;
+				if (length > bestLength)
+				{
+					bestLength = length;
+					bestDistance = (int)i - candidate;
+					if (length == limit) break;
+				}
+				candidate = previous[candidate];
+			}
+		}
+
+		int advance = bestLength >= 3 ? bestLength : 1;
+		if (bestLength >= 3) putMatch(writer, bestLength, bestDistance);
+		else putFixedSymbol(writer, data[i]);
+
+		//every position passed enters the chains
+		for (size_t end = i + advance; i < end; i++)
+		{
+			if (i + 3 > data.size()) continue;
+			uint32_t h = hash(i);
+			previous[i] = head[h];
+			head[h] = (int)i;
+		}
+	}
+
+	putFixedSymbol(writer, 256);							// end of block
+	writer.put(0b000, 3);									// empty stored block: not final, aligned, length 0
+	writer.align();
+	out.insert(out.end(), { 0x00, 0x00, 0xff, 0xff });
+
+	return out;
+}
+
+/*
+* Adler-32 checksum of zlib streams, and that of two pieces joined (the second 'length2' bytes long)
+*/
+static uint32_t adler32(const uint8_t* data, size_t size)
+{
+	const uint32_t BASE = 65521;
+	uint32_t a = 1, b = 0;
+
+	while (size > 0)
+	{
+		size_t n = min(size, (size_t)5552);					// (largest run before the sums may overflow)
+		for (size_t i = 0; i < n; i++)
+		{
+			a += data[i];
+			b += a;
+		}
+		a %= BASE;
+		b %= BASE;
+		data += n;
+		size -= n;
+	}
+
+	return b << 16 | a;
+}
+
+static uint32_t adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2)
+{
+	const uint32_t BASE = 65521;
+	uint32_t remainder = length2 % BASE;
+	uint32_t sum1 = adler1 & 0xffff;
+	uint32_t sum2 = (uint32_t)(((uint64_t)remainder * sum1) % BASE);
+
+	sum1 += (adler2 & 0xffff) + BASE - 1;
+	sum2 += (adler1 >> 16) + (adler2 >> 16) + BASE - remainder;
+	if (sum1 >= BASE) sum1 -= BASE;
+	if (sum1 >= BASE) sum1 -= BASE;
+	if (sum2 >= 2 * BASE) sum2 -= 2 * BASE;
+	if (sum2 >= BASE) sum2 -= BASE;
+
+	return sum2 << 16 | sum1;
+}
+
+/*
+* CRC-32 of PNG chunks
+*/
+static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+	static const array<uint32_t, 256> TABLE = []() {
+		array<uint32_t, 256> table;
+		for (uint32_t n = 0; n < 256; n++)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		return table;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++) crc = TABLE[(crc ^ data[i]) & 255] ^ (crc >> 8);
+	return ~crc;
+}
+
+/*
+* Sum of bytes taken as signed values, |(int8_t)byte| each (AVX2: 32 bytes at a time)
+*/
+static long long signedSum(const uint8_t* bytes, size_t count)
+{
+	long long sum = 0;
+	size_t i = 0;
+#ifdef __AVX2__
+	__m256i total = _mm256_setzero_si256();
+	for (; i + 32 <= count; i += 32)
+	{
+		__m256i magnitudes = _mm256_abs_epi8(_mm256_loadu_si256((const __m256i*)(bytes + i)));
+		total = _mm256_add_epi64(total, _mm256_sad_epu8(magnitudes, _mm256_setzero_si256()));	// (|-128| = 128 as unsigned)
+	}
+	alignas(32) long long parts[4];
+	_mm256_store_si256((__m256i*)parts, total);
+	sum = parts[0] + parts[1] + parts[2] + parts[3];
+#endif
+	for (; i < count; i++) sum += abs((int8_t)bytes[i]);
+
+	return sum;
+}
+
+/*
+* Row y filtered into 'out' (filter type byte first): the 5 PNG filters are applied together into 'scratch'
+* (6 rows: one per filter, then zeros), and the one whose bytes (as signed values) add up smallest is kept
+*/
+static void filterRow(const uint8_t* rgb, int width, int y, uint8_t* scratch, uint8_t* out)
+{
+	size_t stride = (size_t)width * 3;
+	const uint8_t* row = rgb + y * stride;
+	const uint8_t* above = y > 0 ? row - stride : scratch + 5 * stride;		// (the first row has a row of zeros above)
+
+	uint8_t* filtered[5];
+	for (int f = 0; f < 5; f++) filtered[f] = scratch + f * stride;
+
+	//left, up and up left of byte i (0 past the left edge: the first pixel is done apart)
+	auto apply = [&](size_t i, int left, int up, int upLeft) {
+		int p = left + up - upLeft, pa = abs(p - left), pb = abs(p - up), pc = abs(p - upLeft);
+
+		filtered[0][i] = row[i];
+		filtered[1][i] = (uint8_t)(row[i] - left);
+		filtered[2][i] = (uint8_t)(row[i] - up);
+		filtered[3][i] = (uint8_t)(row[i] - (left + up) / 2);
+		filtered[4][i] = (uint8_t)(row[i] - (pa <= pb && pa <= pc ? left : pb <= pc ? up : upLeft));
+	};
+
+	size_t i = 0;
+	for (; i < min(stride, (size_t)3); i++) apply(i, 0, above[i], 0);
+
+#ifdef __AVX2__
+	for (; i + 32 <= stride; i += 32)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(row + i));
+		__m256i a = _mm256_loadu_si256((const __m256i*)(row + i - 3));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(above + i));
+		__m256i c = _mm256_loadu_si256((const __m256i*)(above + i - 3));
+
+		//average rounded down: the rounded up one, less 1 where the sum is odd
+		__m256i average = _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)));
+
+		//Paeth on 16 bit lanes: pa = |b - c|, pb = |a - c|, pc = |a + b - 2c|, the first smallest picks a, b or c
+		auto paeth = [](__m128i a8, __m128i b8, __m128i c8) {
+			__m256i a = _mm256_cvtepu8_epi16(a8), b = _mm256_cvtepu8_epi16(b8), c = _mm256_cvtepu8_epi16(c8);
+			__m256i pa = _mm256_abs_epi16(_mm256_sub_epi16(b, c));
+			__m256i pb = _mm256_abs_epi16(_mm256_sub_epi16(a, c));
+			__m256i pc = _mm256_abs_epi16(_mm256_sub_epi16(_mm256_add_epi16(a, b), _mm256_add_epi16(c, c)));
+
+			__m256i notA = _mm256_or_si256(_mm256_cmpgt_epi16(pa, pb), _mm256_cmpgt_epi16(pa, pc));
+			__m256i bOrC = _mm256_blendv_epi8(b, c, _mm256_cmpgt_epi16(pb, pc));
+			return _mm256_blendv_epi8(a, bOrC, notA);
+		};
+		__m256i low = paeth(_mm256_castsi256_si128(a), _mm256_castsi256_si128(b), _mm256_castsi256_si128(c));
+		__m256i high = paeth(_mm256_extracti128_si256(a, 1), _mm256_extracti128_si256(b, 1), _mm256_extracti128_si256(c, 1));
+		__m256i predicted = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xd8);		// (packing interleaves the halves)
+
+		_mm256_storeu_si256((__m256i*)(filtered[0] + i), x);
+		_mm256_storeu_si256((__m256i*)(filtered[1] + i), _mm256_sub_epi8(x, a));
+		_mm256_storeu_si256((__m256i*)(filtered[2] + i), _mm256_sub_epi8(x, b));
+		_mm256_storeu_si256((__m256i*)(filtered[3] + i), _mm256_sub_epi8(x, average));
+		_mm256_storeu_si256((__m256i*)(filtered[4] + i), _mm256_sub_epi8(x, predicted));
+	}
+#endif
+	for (; i < stride; i++) apply(i, row[i - 3], above[i], above[i - 3]);
+
+	int best = 0;
+	long long bestCost = -1;
+	for (int f = 0; f < 5; f++)
+	{
+		long long cost = signedSum(filtered[f], stride);
+		if (bestCost < 0 || cost < bestCost)
+		{
+			bestCost = cost;
+			best = f;
+		}
+	}
+
+	out[0] = (uint8_t)best;
+	memcpy(out + 1, filtered[best], stride);
+}
+
+/*
+* Appends a PNG chunk: length, type, data and the CRC of type and data
+*/
+static void putChunk(vector<uint8_t>& out, const char type[4], const uint8_t* data, size_t size)
+{
+	putBigEndian(out, (uint32_t)size);
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + size);
+	putBigEndian(out, crc32(&out[start], size + 4));
+}
+
+vector<uint8_t> encodePng(const uint8_t* rgb, int width, int height, unsigned threads)
+{
+	//bands of rows, each filtered, checksummed and deflated by one thread (the first band on this one)
+	if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+	int bandRows = max(1, min(BAND_ROWS, (height + (int)threads - 1) / (int)threads));
+	int bands = (height + bandRows - 1) / bandRows;
+
+	size_t rowBytes = (size_t)width * 3 + 1;
+	vector<vector<uint8_t>> deflated(bands);
+	vector<uint32_t> checksums(bands);
+	vector<size_t> sizes(bands);
+
+	auto encodeBands = [&](int first, int step) {
+		for (int band = first; band < bands; band += step)
+		{
+			int y0 = band * bandRows, y1 = min(height, y0 + bandRows);
+			vector<uint8_t> filtered((y1 - y0) * rowBytes), scratch(6 * (rowBytes - 1), 0);
+			for (int y = y0; y < y1; y++) filterRow(rgb, width, y, scratch.data(), &filtered[(y - y0) * rowBytes]);
+
+			checksums[band] = adler32(filtered.data(), filtered.size());
+			sizes[band] = filtered.size();
+			deflated[band] = deflateBand(filtered);
+		}
+	};
+
+	int workers = min((int)threads, max(bands, 1));
+	vector<thread> pool;
+	for (int w = 1; w < workers; w++) pool.emplace_back(encodeBands, w, workers);
+	encodeBands(0, workers);
+	for (thread& worker : pool) worker.join();
+
+	//zlib stream: header, the bands in order, a final empty block, the checksum of everything filtered
+	vector<uint8_t> zlib = { 0x78, 0x01 };
+	uint32_t checksum = 1;
+	for (int band = 0; band < bands; band++)
+	{
+		zlib.insert(zlib.end(), deflated[band].begin(), deflated[band].end());
+		checksum = adler32Combine(checksum, checksums[band], sizes[band]);
+	}
+	zlib.insert(zlib.end(), { 0x03, 0x00 });				// final fixed code block holding only its end
+	putBigEndian(zlib, checksum);
+
+	vector<uint8_t> out = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	vector<uint8_t> header;
+	putBigEndian(header, width);
+	putBigEndian(header, height);
+	header.insert(header.end(), { 8, 2, 0, 0, 0 });			// 8 bits per channel, rgb, deflate, adaptive filters, no interlace
+	putChunk(out, "IHDR", header.data(), header.size());
+	putChunk(out, "IDAT", zlib.data(), zlib.size());
+	putChunk(out, "IEND", nullptr, 0);
+
+	return out;
+}
@@ -0,0 +1,26 @@
+#ifndef IMAGEENCODERS_H
+#define IMAGEENCODERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+/*
+* Image file encoders without outside libraries, for frames saved by Image::saveImage().
+* Each takes 8 bit rgb pixels (3 bytes per pixel, rows top first) and returns the whole file.
+*/
+
+/*
+* QOI ("Quite OK Image"): lossless, encoded in a single pass over the pixels (runs, a table of recent colors, small differences)
+*/
+vector<uint8_t> encodeQoi(const uint8_t* rgb, int width, int height);
+
+/*
+* PNG: rows filtered (the filter leaving the smallest values, per row), then deflated in bands of rows on 'threads'
+* threads (0 = one per core). Each band is compressed on its own (matches never reach into the band before) and
+* ends on a byte boundary, so the bands are joined into one zlib stream as they are.
+*/
+vector<uint8_t> encodePng(const uint8_t* rgb, int width, int height, unsigned threads = 0);
+
+#endif
@@ -0,0 +1,94 @@
+#include "IndexedMesh.h"
+#include <array>
+#include <map>
+
+int IndexedMesh::vertexCount() const
+{
+	return (int)px.size();
+}
+
+int IndexedMesh::triangleCount() const
+{
+	return (int)indices.size() / 3;
+}
+
+size_t IndexedMesh::memoryBytes() const
+{
+	size_t floats = px.capacity() + py.capacity() + pz.capacity() + nx.capacity() + ny.capacity() + nz.capacity()
+		+ r.capacity() + g.capacity() + b.capacity();
+
+	return floats * sizeof(float) + indices.capacity() * sizeof(uint32_t);
+}
+
+vector<Vertex> IndexedMesh::toVertices(bool smooth) const
+{
+	vector<Vertex> vertices;
+	vertices.reserve(indices.size());
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		Vertex corners[3];
+		for (int c = 0; c < 3; c++)
+		{
+			uint32_t v = indices[i + c];
+			corners[c].point = Point(px[v], py[v], pz[v], 1);
+			corners[c].vColor = Color(r[v], g[v], b[v]);
+			corners[c].vNormal = Unit(nx[v], ny[v], nz[v]);
+		}
+
+		if (!smooth)
+		{
+			//flat normal (cross product counter clockwise), facing the same way as the vertex normals
+			Vector flat = Vector(corners[0].point, corners[1].point).cross(Vector(corners[0].point, corners[2].point));
+			if (dot(flat, corners[0].vNormal + corners[1].vNormal + corners[2].vNormal) < 0) flat = -flat;
+
+			if (flat.length() > 0)
+			{
+				for (Vertex& corner : corners) corner.vNormal = Unit(flat);
+			}
+		}
+
+		vertices.insert(vertices.end(), corners, corners + 3);
+	}
+
+	return vertices;
+}
+
+IndexedMesh weld(const vector<Triangle>& triangles, bool exact)
+{
+	IndexedMesh mesh;
+	map<array<float, 9>, uint32_t> ids;						// position (and normal, color when exact) -> vertex index
+
+	mesh.indices.reserve(triangles.size() * 3);
+
+	for (const Triangle& t : triangles)
+	{
+		for (const Vertex& v : { t.v1, t.v2, t.v3 })
+		{
+			array<float, 9> key = { v.point.x(), v.point.y(), v.point.z() };
+			if (exact) key = { v.point.x(), v.point.y(), v.point.z(), v.vNormal.x(), v.vNormal.y(), v.vNormal.z(), v.vColor.r(), v.vColor.g(), v.vColor.b() };
+
+			auto [it, added] = ids.try_emplace(key, (uint32_t)mesh.px.size());
+
+			mesh.indices.push_back(it->second);
+
+			if (added)
+			{
+				mesh.px.push_back(v.point.x());
+				mesh.py.push_back(v.point.y());
+				mesh.pz.push_back(v.point.z());
+				mesh.nx.push_back(v.vNormal.x());
+				mesh.ny.push_back(v.vNormal.y());
+				mesh.nz.push_back(v.vNormal.z());
+				mesh.r.push_back(v.vColor.r());
+				mesh.g.push_back(v.vColor.g());
+				mesh.b.push_back(v.vColor.b());
+			}
+		}
+	}
+
+	//vertex count is only known at the end: give back what the arrays grew past it
+	for (vector<float>* arr : { &mesh.px, &mesh.py, &mesh.pz, &mesh.nx, &mesh.ny, &mesh.nz, &mesh.r, &mesh.g, &mesh.b }) arr->shrink_to_fit();
+
+	return mesh;
+}
@@ -0,0 +1,46 @@
+#ifndef INDEXEDMESH_H
+#define INDEXEDMESH_H
+
+#include <cstdint>
+#include <vector>
+#include "Triangle.h"
+#include "Vertex.h"
+using namespace std;
+
+/*
+* Compact mesh where triangles share their vertices (welded by position).
+* Vertex attributes are stored as structure-of-arrays, and each triangle is
+* three consecutive entries of 'indices'.
+*/
+struct IndexedMesh
+{
+	//Data members
+	vector<float> px, py, pz;			// vertex positions
+	vector<float> nx, ny, nz;			// vertex normals
+	vector<float> r, g, b;				// vertex colors
+
+	vector<uint32_t> indices;			// 3 per triangle, counter clockwise like the source triangles
+
+	int vertexCount() const;
+	int triangleCount() const;
+
+	/*
+	* Bytes of CPU memory held by the arrays (capacity, not just size)
+	*/
+	size_t memoryBytes() const;
+
+	/*
+	* Expands the triangles back into a list of vertices (3 per triangle) for openGL.
+	* Smooth meshes keep their vertex normals, flat meshes get each triangle's own normal.
+	*/
+	vector<Vertex> toVertices(bool smooth) const;
+};
+
+/*
+* Builds an indexed mesh from a list of triangles, merging vertices with the same position
+* (the attributes of the first occurrence are kept). With 'exact' only vertices that also have
+* the same normal and color are merged, so every triangle keeps its own attributes (for ray queries).
+*/
+IndexedMesh weld(const vector<Triangle>& triangles, bool exact = false);
+
+#endif
@@ -0,0 +1,87 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char EMPTY_FILE[1] = { 0 };		// data() of an empty file (nothing can be mapped)
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string& filename)
+{
+	HANDLE handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return;
+	file = handle;
+
+	LARGE_INTEGER length;
+	GetFileSizeEx(handle, &length);
+	size_ = (size_t)length.QuadPart;
+
+	if (size_ == 0)
+	{
+		data_ = EMPTY_FILE;
+		return;
+	}
+
+	mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping) data_ = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+}
+
+MappedFile::~MappedFile()
+{
+	if (data_ && data_ != EMPTY_FILE) UnmapViewOfFile(data_);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const string& filename)
+{
+	fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return;
+
+	struct stat info;
+	fstat(fd, &info);
+	size_ = (size_t)info.st_size;
+
+	if (size_ == 0)
+	{
+		data_ = EMPTY_FILE;
+		return;
+	}
+
+	void* view = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view != MAP_FAILED) data_ = (const char*)view;
+}
+
+MappedFile::~MappedFile()
+{
+	if (data_ && data_ != EMPTY_FILE) munmap((void*)data_, size_);
+	if (fd >= 0) close(fd);
+}
+
+#endif
+
+const char* MappedFile::data() const
+{
+	return data_;
+}
+
+size_t MappedFile::size() const
+{
+	return size_;
+}
+
+bool MappedFile::isOpen() const
+{
+	return data_ != nullptr;
+}
@@ -0,0 +1,49 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+using namespace std;
+
+/*
+* Read-only view of a whole file mapped into memory (no copy into a buffer).
+* The view stays valid for the lifetime of the object.
+*/
+class MappedFile
+{
+private:
+	const char* data_ = nullptr;		// start of the mapped bytes (nullptr if the file could not be mapped)
+	size_t size_ = 0;					// number of bytes in the file
+
+#ifdef _WIN32
+	void* file = nullptr;				// file and mapping handles
+	void* mapping = nullptr;
+#else
+	int fd = -1;						// file descriptor
+#endif
+
+public:
+	/*
+	* Maps the given file (check isOpen() for success)
+	*/
+	MappedFile(const string& filename);
+
+	/*
+	* Unmaps the file
+	*/
+	~MappedFile();
+
+	//a mapping has a single owner
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data() const;
+	size_t size() const;
+
+	/*
+	* True if the file exists and was mapped (an empty file is open with size 0)
+	*/
+	bool isOpen() const;
+};
+
+#endif
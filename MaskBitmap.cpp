@@ -0,0 +1,172 @@
+#include "MaskBitmap.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// texels along each side of the pyramid's finest blocks (rectangles about this small are scanned bit by bit)
+const int FIRST_BLOCK = 8;
+
+MaskBitmap::MaskBitmap(const Image& mask)
+	:
+	width(mask.getWidth()),
+	height(mask.getHeight()),
+	words((mask.getWidth() + 63) / 64)
+{
+	bits.assign((size_t)words * height, 0);
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			if (gray(mask.getPixel(x, y)) > 0) bits[(size_t)y * words + x / 64] |= 1ull << (x % 64);
+		}
+	}
+
+	//finest level from the bits, each next one from 2 x 2 blocks of the one before, until one block covers everything
+	Level level{ (width + FIRST_BLOCK - 1) / FIRST_BLOCK, (height + FIRST_BLOCK - 1) / FIRST_BLOCK, FIRST_BLOCK, {}, {} };
+	level.any.assign(level.width * level.height, 0);
+	level.all.assign(level.width * level.height, 0);
+
+	for (int by = 0; by < level.height; by++)
+	{
+		for (int bx = 0; bx < level.width; bx++)
+		{
+			MaskCoverage c = scan(bx * FIRST_BLOCK, by * FIRST_BLOCK, min(width, (bx + 1) * FIRST_BLOCK) - 1, min(height, (by + 1) * FIRST_BLOCK) - 1);
+			level.any[by * level.width + bx] = c != MaskCoverage::None;
+			level.all[by * level.width + bx] = c == MaskCoverage::Full;
+		}
+	}
+	pyramid.push_back(move(level));
+
+	while (pyramid.back().width > 1 || pyramid.back().height > 1)
+	{
+		const Level& fine = pyramid.back();
+		Level coarse{ (fine.width + 1) / 2, (fine.height + 1) / 2, fine.block * 2, {}, {} };
+		coarse.any.assign(coarse.width * coarse.height, 0);
+		coarse.all.assign(coarse.width * coarse.height, 1);
+
+		for (int y = 0; y < fine.height; y++)
+		{
+			for (int x = 0; x < fine.width; x++)
+			{
+				int i = (y / 2) * coarse.width + x / 2;
+				coarse.any[i] |= fine.any[y * fine.width + x];
+				coarse.all[i] &= fine.all[y * fine.width + x];
+			}
+		}
+		pyramid.push_back(move(coarse));
+	}
+}
+
+bool MaskBitmap::visible(float u, float v) const
+{
+	if (bits.empty()) return false;
+
+	//the weights of Image::getPixel(float, float): a texel counts when both of its weights are above 0
+	float w = u * width;
+	float h = v * height;
+
+	float i0 = w - floor(w);
+	float i1 = 1 - i0;
+	float j0 = h - floor(h);
+	float j1 = 1 - j0;
+
+	//the 2 x 2 texels, wrapped around the edges as Image::getPixel does
+	int x0 = (int)floor(w) % width, y0 = (int)floor(h) % height;
+	if (x0 < 0) x0 += width;
+	if (y0 < 0) y0 += height;
+	int x1 = x0 + 1 == width ? 0 : x0 + 1;
+	int y1 = y0 + 1 == height ? 0 : y0 + 1;
+
+	const uint64_t* row0 = &bits[(size_t)y0 * words];
+	const uint64_t* row1 = &bits[(size_t)y1 * words];
+	auto set = [](const uint64_t* row, int x) { return (row[x / 64] >> (x % 64)) & 1; };
+
+	return (i1 > 0 && j1 > 0 && set(row0, x0)) || (i1 > 0 && j0 > 0 && set(row1, x0))
+		|| (i0 > 0 && j1 > 0 && set(row0, x1)) || (i0 > 0 && j0 > 0 && set(row1, x1));
+}
+
+MaskCoverage MaskBitmap::scan(int x0, int y0, int x1, int y1) const
+{
+	bool any = false, all = true;
+
+	//small rectangles bit by bit (exact)
+	if (x1 - x0 < FIRST_BLOCK && y1 - y0 < FIRST_BLOCK)
+	{
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				bool set = (bits[(size_t)y * words + x / 64] >> (x % 64)) & 1;
+				any |= set;
+				all &= set;
+			}
+		}
+	}
+	else
+	{
+		//larger ones through the finest level where they span at most 4 x 4 blocks (the blocks cover more than
+		//the rectangle, so 'None' and 'Full' are always right; some 'Partial' answers could have been either)
+		const Level* level = &pyramid.back();
+		for (const Level& candidate : pyramid)
+		{
+			if (x1 / candidate.block - x0 / candidate.block < 4 && y1 / candidate.block - y0 / candidate.block < 4)
+			{
+				level = &candidate;
+				break;
+			}
+		}
+
+		for (int by = y0 / level->block; by <= y1 / level->block; by++)
+		{
+			for (int bx = x0 / level->block; bx <= x1 / level->block; bx++)
+			{
+				any |= level->any[by * level->width + bx] != 0;
+				all &= level->all[by * level->width + bx] != 0;
+			}
+		}
+	}
+
+	return !any ? MaskCoverage::None : all ? MaskCoverage::Full : MaskCoverage::Partial;
+}
+
+MaskCoverage MaskBitmap::coverage(float u0, float v0, float u1, float v1) const
+{
+	if (bits.empty()) return MaskCoverage::None;
+
+	//texels the lookups may interpolate, split where they wrap around the edges
+	auto ranges = [](float lo, float hi, int size) {
+		int first = (int)floor(lo * size), last = (int)floor(hi * size) + 1;
+		if (last - first + 1 >= size) return vector<pair<int, int>>{ { 0, size - 1 } };
+
+		int start = (first % size + size) % size;
+		int end = start + (last - first);
+		if (end < size) return vector<pair<int, int>>{ { start, end } };
+
+		return vector<pair<int, int>>{ { start, size - 1 }, { 0, end - size } };
+	};
+
+	bool any = false, all = true;
+	for (auto [x0, x1] : ranges(u0, u1, width))
+	{
+		for (auto [y0, y1] : ranges(v0, v1, height))
+		{
+			MaskCoverage c = scan(x0, y0, x1, y1);
+			any |= c != MaskCoverage::None;
+			all &= c == MaskCoverage::Full;
+
+			//a partial rectangle decides the whole answer
+			if (c == MaskCoverage::Partial) return c;
+		}
+	}
+
+	return !any ? MaskCoverage::None : all ? MaskCoverage::Full : MaskCoverage::Partial;
+}
+
+size_t MaskBitmap::memoryBytes() const
+{
+	size_t bytes = bits.capacity() * sizeof(uint64_t);
+	for (const Level& level : pyramid) bytes += level.any.capacity() + level.all.capacity();
+
+	return bytes;
+}
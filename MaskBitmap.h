@@ -0,0 +1,78 @@
+#ifndef MASKBITMAP_H
+#define MASKBITMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Image.h"
+using namespace std;
+
+/*
+* How much of a region of a mask lets hits through
+*/
+enum class MaskCoverage
+{
+	None,								// nothing: every hit in the region is masked out
+	Partial,							// some of it (or cannot tell at the pyramid's resolution): test each hit
+	Full								// all of it: no hit in the region is masked out
+};
+
+/*
+* A mask image reduced at load time to one bit per texel (set = gray value above 0), with a coarse
+* pyramid of blocks recording whether any / all of their texels are set.
+* visible() gives the same answer as Image::gray_uv(u, v) > 0: a bilinear lookup is above 0 exactly
+* when one of the texels it interpolates (with a nonzero weight) is set.
+*/
+class MaskBitmap
+{
+private:
+	/*
+	* One level of the pyramid: a byte per block of block x block texels
+	*/
+	struct Level
+	{
+		int width, height;				// blocks along each axis
+		int block;						// texels along each side of a block
+		vector<uint8_t> any;			// some texel of the block is set
+		vector<uint8_t> all;			// every texel of the block is set
+	};
+
+	int width = 0;						// texels along each axis
+	int height = 0;
+	int words = 0;						// 64 bit words per row
+	vector<uint64_t> bits;				// rows of bits, top first (like the image)
+	vector<Level> pyramid;				// blocks of 8 x 8 texels, then 16 x 16... up to a single block
+
+	/*
+	* Coverage of a rectangle of texels [x0, x1] x [y0, y1] lying inside the mask
+	*/
+	MaskCoverage scan(int x0, int y0, int x1, int y1) const;
+
+public:
+	/*
+	* Empty bitmap (every test fails)
+	*/
+	MaskBitmap() = default;
+
+	/*
+	* Converts a mask image
+	*/
+	explicit MaskBitmap(const Image& mask);
+
+	/*
+	* True when the mask lets a hit at (u, v) through (same as mask.gray_uv(u, v) > 0)
+	*/
+	bool visible(float u, float v) const;
+
+	/*
+	* Coverage of every lookup with u in [u0, u1] and v in [v0, v1] (wrapping like the image lookups)
+	*/
+	MaskCoverage coverage(float u0, float v0, float u1, float v1) const;
+
+	/*
+	* Bytes held by the bits and the pyramid
+	*/
+	size_t memoryBytes() const;
+};
+
+#endif
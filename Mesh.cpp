@@ -1,6 +1,27 @@
 #include "Mesh.h"
+#include "Simplify.h"
+#include "PovLoader.h"
+#include "BlockCompression.h"
 #include <fstream>
 #include <cassert>
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <bit>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <map>
+
+/*
+* Directory of saved hierarchies, named by content hash ("" = always build). Kept in a function so it is
+* set up before any use: global meshes (main.cpp) may be loaded before this file's globals are initialized.
+*/
+static string& bvhCache()
+{
+	static string directory = "mesh_cache";
+	return directory;
+}
 
 void Mesh::setupBuffers() 
 {
@@ -17,24 +38,101 @@ void Mesh::setupBuffers()
 		}
 	}
 
+	//simplified levels follow the full mesh in the same buffer
+	vertices.insert(vertices.end(), lodVertices.begin(), lodVertices.end());
+
 	//-----send the data to OpenGL to load on GPU-----//
-	glGenBuffers(1, &vertexBuffer);					// request buffer
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);	// attach to buffer
-	glBufferData(GL_ARRAY_BUFFER,					// type of buffer
-		vertices.size() * sizeof(Vertex),			// #bytes of data
-		vertices.data(),							// where the data is (and where it starts)
-												// here starts in beginning, so no offset
-		GL_STATIC_DRAW);						// data will not change
+	vertexBuffer.upload(vertices.data(),			// where the data is (and where it starts)
+		vertices.size() * sizeof(Vertex));			// #bytes of data (existing storage is reused when it fits)
+
+	describeAttributes();
+	uploadTextures();
+
+	//the GPU has the geometry now: keep only what ray queries need (swap with empty to really free the memory)
+	//(welding keeps the triangle order, so the hierarchy still applies to the compact copy)
+	if (residency == Residency::RayQueries) compact = weld(triangles, true);
+	else bvh.clear();
+
+	vector<Triangle>().swap(triangles);
+	vector<Vertex>().swap(lodVertices);
+}
+
+void Mesh::streamSource(const string& filename, bool smooth)
+{
+	const size_t BLOCK_BYTES = 16 * 1024 * 1024;			// text read (and parsed) at a time
+
+	this->smooth = smooth;
+	triangles.clear();
+	meshlets.clear();
+	lodVertices.clear();
+	compact = IndexedMesh();
+	bvh.clear();
+	closed = false;
+
+	//size the buffer from a quick first pass, so blocks can be uploaded as soon as they are parsed
+	size_t capacity = countPovTriangles(filename, BLOCK_BYTES) * 3;
+
+	vertexBuffer.upload(nullptr, capacity * sizeof(Vertex));		// reserve only, filled block by block
 
+	vector<Vertex> vertices;								// one block of vertices, reused
+	size_t uploaded = 0;
+
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	streamPov(filename, smooth, BLOCK_BYTES, [&](const vector<Triangle>& block) {
+		vertices.clear();
+
+		for (const Triangle& t : block)
+		{
+			for (const Vertex& v : { t.v1, t.v2, t.v3 })
+			{
+				float p[3] = { v.point.x(), v.point.y(), v.point.z() };
+				for (int c = 0; c < 3; c++)
+				{
+					lo[c] = min(lo[c], p[c]);
+					hi[c] = max(hi[c], p[c]);
+				}
+
+				vertices.push_back(v);
+
+				if (residency == Residency::RayQueries)
+				{
+					compact.indices.push_back((uint32_t)compact.px.size());
+					compact.px.push_back(p[0]);
+					compact.py.push_back(p[1]);
+					compact.pz.push_back(p[2]);
+					compact.nx.push_back(v.vNormal.x());
+					compact.ny.push_back(v.vNormal.y());
+					compact.nz.push_back(v.vNormal.z());
+					compact.r.push_back(v.vColor.r());
+					compact.g.push_back(v.vColor.g());
+					compact.b.push_back(v.vColor.b());
+				}
+			}
+		}
+
+		size_t count = min(vertices.size(), capacity - uploaded);		// file changed since it was counted -> drop the extra
+		glBufferSubData(GL_ARRAY_BUFFER, uploaded * sizeof(Vertex), count * sizeof(Vertex), vertices.data());
+		uploaded += count;
+	});
+
+	lods = { { 0, (int)uploaded, 0 } };
+	if (uploaded > 0) setBounds(Point(lo[0], lo[1], lo[2], 1), Point(hi[0], hi[1], hi[2], 1));
+	if (residency == Residency::RayQueries) buildBvh();
+
+	describeAttributes();
+}
 
+void Mesh::describeAttributes()
+{
 	//-----describe the data-----//
 	// get current active program -- created in init() in 'main.cpp' -- needed to access shader variables
 	//vertex data
 	GLint program;
 	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
 
-	glGenVertexArrays(1, &attribBuffer);    // request layout buffer
-	glBindVertexArray(attribBuffer);        // attach to layout buffer
+	attribBuffer.bind();					// request (first time only) and attach to layout buffer
 
 	// get the id of the attribute variable in (one of the) shaders
 	GLuint posAttr = glGetAttribLocation(program, "vertexCoords");   // "vertexCoords" should be "in" variable
@@ -93,37 +191,132 @@ void Mesh::setupBuffers()
 void Mesh::draw() const
 {
 	//Note: all the data has already been sent by the time this method is called, so we just tell OpenGL to draw it
-	
+	bind();
+
+	//pick the level of detail from the size of the mesh on screen
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	float pixelsPerUnit = viewport[3] / 2.0f * 2;			// clip space [-1, 1] covers the viewport height; vertexShader.glsl scales by 2
+
+	if (!lods.empty()) submitLod(selectLod(pixelsPerUnit));
+}
 
+void Mesh::bind() const
+{
 	// make active the layout buffers (automatically activates associated data buffer)
-	glBindVertexArray(attribBuffer);
+	glBindVertexArray(attribBuffer.name());
+}
+
+void Mesh::submit() const
+{
+	if (lods.empty()) return;		 // nothing loaded
 
 	// draw the vertex data that was loaded and described in the activated buffers
 	glDrawArrays(GL_TRIANGLES,		 // type of primitives to draw
 		0,							 // where to being in buffer: 0 offset, i.e. from beginning
-		triangles.size() * 3		 // total number of vertices (depends on primitive type)
+		lods[0].count				 // total number of vertices of the full mesh (depends on primitive type)
 	);
 }
 
-Mesh::Mesh(string filename)
+int Mesh::selectLod(float pixelsPerUnit) const
 {
-	//open file that has mesh's triangles
-	ifstream ifs(filename);
+	const float MAX_PIXEL_ERROR = 1;						// coarser levels must not move the surface by more than this on screen
 
-	string token;
-	Triangle tri;
+	int level = 0;
+	while (level + 1 < (int)lods.size() && lods[level + 1].error * pixelsPerUnit <= MAX_PIXEL_ERROR) level++;
 
-	while (ifs >> token) {								//	loop through source file
-		if (token == "smooth_triangle")
-		{
-			ifs >> tri;
+	return level;
+}
 
-			tri.setSmooth(true);							// mesh always starts as smooth for openGL project
+void Mesh::submitLod(int level) const
+{
+	lastLod = level;
 
-			triangles.push_back(tri);
-		}
-	}
+	if (level == 0) submit();
+	else glDrawArrays(GL_TRIANGLES, lods[level].first, lods[level].count);
+}
+
+int Mesh::lodTriangles(int level) const
+{
+	return lods[level].count / 3;
+}
+
+int Mesh::drawnLod() const
+{
+	return lastLod;
+}
 
+void Mesh::submitRanges(const vector<GLint>& firsts, const vector<GLsizei>& counts) const
+{
+	glMultiDrawArrays(GL_TRIANGLES, firsts.data(), counts.data(), (GLsizei)firsts.size());
+}
+
+const Sphere& Mesh::boundingSphere() const
+{
+	return bound;
+}
+
+Point Mesh::minCorner() const
+{
+	return boxMin;
+}
+
+Point Mesh::maxCorner() const
+{
+	return boxMax;
+}
+
+const vector<Meshlet>& Mesh::getMeshlets() const
+{
+	return meshlets;
+}
+
+bool Mesh::isClosed() const
+{
+	return closed;
+}
+
+void Mesh::setResidency(Residency policy)
+{
+	residency = policy;
+
+	//only meshes kept for ray queries need the hierarchy (built over the loaded triangles, after the meshlets reordered them)
+	if (residency == Residency::RayQueries && bvh.empty() && !triangles.empty()) buildBvh();
+}
+
+size_t Mesh::cpuBytes() const
+{
+	return triangles.capacity() * sizeof(Triangle) + lodVertices.capacity() * sizeof(Vertex)
+		+ meshlets.capacity() * sizeof(Meshlet) + lods.capacity() * sizeof(LodLevel) + compact.memoryBytes() + bvh.memoryBytes();
+}
+
+size_t Mesh::gpuBytes() const
+{
+	return vertexBuffer.size() + textureData.size() + maskData.size() + bumpData.size();
+}
+
+GLuint Mesh::vertexData() const
+{
+	return vertexBuffer.name();
+}
+
+const RayStats& Mesh::rayStats() const
+{
+	return rayCounters;
+}
+
+const PacketStats& Mesh::packetStats() const
+{
+	return packetCounters;
+}
+
+int Mesh::triangleCount() const
+{
+	return lods.empty() ? 0 : lods[0].count / 3;			// full resolution (the triangle list may not be in memory)
+}
+
+Mesh::Mesh()
+{
 	//hardcode baseline material coefficients
 	mat.ka = 0.4;
 	mat.kd = 0.5;
@@ -131,36 +324,584 @@ Mesh::Mesh(string filename)
 	mat.n = 70;
 }
 
-optional<Hit> Mesh::intersect(const Ray& ray) const
+Mesh::Mesh(string filename)
+	:
+	Mesh()
+{
+	readSource(filename, true);							// mesh always starts as smooth for openGL project
+}
+
+void Mesh::reload(const string& filename)
+{
+	Mesh next(filename);
+
+	//hand the GL objects over to the new mesh, then take everything back
+	next.vertexBuffer = std::move(vertexBuffer);
+	next.attribBuffer = std::move(attribBuffer);
+	next.setResidency(residency);
+
+	*this = std::move(next);
+}
+
+void Mesh::readSource(const string& filename, bool smooth)
+{
+	this->smooth = smooth;
+
+	//parse the mesh's triangles (in parallel, each already smooth or flat)
+	triangles = loadPov(filename, smooth);
+
+	//culling data and levels of detail are computed once here, at load time
+	computeBounds();
+	buildMeshlets();
+	buildLods();
+}
+
+void Mesh::uploadTextures()
+{
+	//each image compressed (or read back from the cache) and uploaded in the matching GL format; no image, no texture
+	auto upload = [](GpuTexture& target, const Image* image, BlockFormat format, GLenum glFormat) {
+		if (image == nullptr)
+		{
+			target.release();
+			return;
+		}
+
+		CompressedImage compressed = cachedCompress(*image, format);
+		target.uploadCompressed(glFormat, compressed.width, compressed.height, compressed.blocks.data(), compressed.blocks.size());
+	};
+
+	upload(textureData, texture, BlockFormat::BC1, GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+	upload(maskData, mask, BlockFormat::BC4, GL_COMPRESSED_RED_RGTC1);
+	upload(bumpData, bumpMap, BlockFormat::BC5, GL_COMPRESSED_RG_RGTC2);
+}
+
+void Mesh::buildBvh()
+{
+	int count = compact.triangleCount() + (int)triangles.size();
+
+	//geometry seen before (by this run or an earlier one) has its hierarchy saved: mapped, not built again
+	uint64_t key = 0;
+	string cacheFile;
+	if (!bvhCache().empty() && count > 0)
+	{
+		key = contentHash();
+		ostringstream name;
+		name << hex << setw(16) << setfill('0') << key << ".bvh";
+		cacheFile = (filesystem::path(bvhCache()) / name.str()).string();
+
+		if (bvh.map(cacheFile, key)) return;
+	}
+
+	bvh.build(count, [&](int triangle, Point corners[3]) { triangleCorners(triangle, corners); });
+
+	if (!cacheFile.empty())
+	{
+		error_code error;
+		filesystem::create_directories(bvhCache(), error);
+		bvh.save(cacheFile, key);						// (a cache that cannot be written only costs the next load a build)
+	}
+}
+
+void Mesh::setBvhCache(const string& directory)
+{
+	bvhCache() = directory;
+}
+
+uint64_t Mesh::contentHash() const
+{
+	int count = compact.triangleCount() + (int)triangles.size();
+	uint64_t hash = hashBytes(&count, sizeof(count));
+
+	for (int triangle = 0; triangle < count; triangle++)
+	{
+		Point corners[3];
+		triangleCorners(triangle, corners);
+
+		float xyz[9];
+		for (int c = 0; c < 3; c++)
+		{
+			xyz[c * 3] = corners[c].x();
+			xyz[c * 3 + 1] = corners[c].y();
+			xyz[c * 3 + 2] = corners[c].z();
+		}
+		hash = hashBytes(xyz, sizeof(xyz), hash);
+	}
+
+	return hash;
+}
+
+bool Mesh::bvhMapped() const
+{
+	return bvh.mapped();
+}
+
+void Mesh::buildLods()
 {
-	//before checking for where intersection is in mesh, first check if it intersects the bounding sphere first
-	optional<Hit> boundHit = bound.intersect(ray);
-	if (!boundHit) return {};										// bound not hit -> mesh never hit
+	const int MIN_LOD_TRIANGLES = 64;						// no point simplifying below this
+	const int MAX_LODS = 5;
 
+	lods = { { 0, (int)triangles.size() * 3, 0 } };
+	lodVertices.clear();
 
-	//loop through all triangles to check for an intersection, finding CLOSEST intersection
-	optional<Hit> minHit;
-	float minT = FLT_MAX;
+	IndexedMesh level = weld(triangles);
+	float error = 0;
 
-	
+	while ((int)lods.size() < MAX_LODS && level.triangleCount() / 2 >= MIN_LOD_TRIANGLES)
+	{
+		float levelError;
+		IndexedMesh coarser = simplify(level, level.triangleCount() / 2, levelError);
+
+		if (coarser.triangleCount() > level.triangleCount() * 3 / 4) break;			// could not simplify further
+
+		error += levelError;														// each level is simplified from the previous one
+		level = std::move(coarser);
+
+		vector<Vertex> vertices = level.toVertices(smooth);
+		lods.push_back({ (int)(triangles.size() * 3 + lodVertices.size()), (int)vertices.size(), error });
+		lodVertices.insert(lodVertices.end(), vertices.begin(), vertices.end());
+	}
+}
+
+void Mesh::computeBounds()
+{
+	if (triangles.empty()) return;
+
+	//varibles for computing bounding sphere
+	float minX = FLT_MAX;
+	float minY = FLT_MAX;
+	float minZ = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxY = -FLT_MAX;
+	float maxZ = -FLT_MAX;
+
+	//gather data for bounding box
 	for (const Triangle& tri : triangles)
 	{
-		optional<Hit> hit = tri.intersect(ray);
+		for (const Vertex& vert : { tri.v1, tri.v2, tri.v3 })
+		{
+			if (vert.point.x() > maxX)	maxX = vert.point.x();
+			if (vert.point.y() > maxY)	maxY = vert.point.y();
+			if (vert.point.z() > maxZ)	maxZ = vert.point.z();
+			if (vert.point.x() < minX)	minX = vert.point.x();
+			if (vert.point.y() < minY)	minY = vert.point.y();
+			if (vert.point.z() < minZ)	minZ = vert.point.z();
+		}
+	}
 
-		if (hit) hit = updateHit(hit);								//check for case where hit is not visible, before checking if it is a new min
-		else continue;												//no hit, continue looking
-		
-		//check for new minimum
-		if (hit && hit->t < minT)
+	setBounds(Point(minX, minY, minZ, 1), Point(maxX, maxY, maxZ, 1));
+}
+
+void Mesh::setBounds(const Point& lo, const Point& hi)
+{
+	boxMin = lo;
+	boxMax = hi;
+
+	//create bounding sphere
+	Vector diagVec(boxMin, boxMax);										//diagonal between boxMin and boxMax of the bounding box
+	float radius = diagVec.length() / 2;
+
+	Vector center = (Vector(boxMin) + Vector(boxMax)) / 2;				//center of bounding sphere -> midpoint of the diagnoal of bounding box
+
+	bound = Sphere(center.point(), radius);
+}
+
+void Mesh::buildMeshlets()
+{
+	const int MESHLET_TRIANGLES = 64;									// triangles per meshlet
+
+	meshlets.clear();
+	if (triangles.empty()) return;
+
+	//sort triangles along a Morton (Z-order) curve of their centroids, so consecutive triangles are close together
+	Vector extent(boxMin, boxMax);
+	auto spread = [](uint32_t x) {										// spread 10 bits so there are two zero bits between each
+		x = (x | (x << 16)) & 0x030000FF;
+		x = (x | (x << 8)) & 0x0300F00F;
+		x = (x | (x << 4)) & 0x030C30C3;
+		x = (x | (x << 2)) & 0x09249249;
+		return x;
+	};
+	auto cell = [](float value, float lo, float size) {					// [lo, lo + size] -> [0, 1023]
+		if (size <= 0) return 0u;
+		return (uint32_t)clamp((value - lo) / size * 1023, 0.0f, 1023.0f);
+	};
+
+	vector<pair<uint32_t, int>> codes;
+	for (int i = 0; i < (int)triangles.size(); i++)
+	{
+		const Triangle& t = triangles[i];
+		float cx = (t.v1.point.x() + t.v2.point.x() + t.v3.point.x()) / 3;
+		float cy = (t.v1.point.y() + t.v2.point.y() + t.v3.point.y()) / 3;
+		float cz = (t.v1.point.z() + t.v2.point.z() + t.v3.point.z()) / 3;
+
+		uint32_t code = (spread(cell(cx, boxMin.x(), extent.x())) << 2) |
+						(spread(cell(cy, boxMin.y(), extent.y())) << 1) |
+						 spread(cell(cz, boxMin.z(), extent.z()));
+		codes.push_back({ code, i });
+	}
+	stable_sort(codes.begin(), codes.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	vector<Triangle> sorted;
+	sorted.reserve(triangles.size());
+	for (const auto& [code, i] : codes) sorted.push_back(triangles[i]);
+	triangles = std::move(sorted);
+
+
+	//a mesh is closed when every edge (pair of welded vertex positions) is used by exactly two triangles
+	map<array<float, 3>, int> ids;
+	map<pair<int, int>, int> edges;
+	auto vertexId = [&](const Point& p) {
+		return ids.try_emplace({ p.x(), p.y(), p.z() }, (int)ids.size()).first->second;
+	};
+
+	for (const Triangle& t : triangles)
+	{
+		int v[3] = { vertexId(t.v1.point), vertexId(t.v2.point), vertexId(t.v3.point) };
+		for (int e = 0; e < 3; e++) edges[minmax(v[e], v[(e + 1) % 3])]++;
+	}
+	closed = all_of(edges.begin(), edges.end(), [](const auto& edge) { return edge.second == 2; });
+
+
+	//group consecutive triangles into meshlets
+	for (int first = 0; first < (int)triangles.size(); first += MESHLET_TRIANGLES)
+	{
+		int last = min(first + MESHLET_TRIANGLES, (int)triangles.size());
+
+		Meshlet m;
+		m.first = first * 3;
+		m.count = (last - first) * 3;
+
+		//bounding sphere: center of the cluster's box, radius to the farthest vertex
+		float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		Vector normalSum;
+		vector<Vector> normals;
+
+		for (int i = first; i < last; i++)
 		{
-			minT = hit->t;
-			minHit = hit;
+			const Triangle& t = triangles[i];
+			for (const Vertex& vert : { t.v1, t.v2, t.v3 })
+			{
+				float p[3] = { vert.point.x(), vert.point.y(), vert.point.z() };
+				for (int c = 0; c < 3; c++)
+				{
+					lo[c] = min(lo[c], p[c]);
+					hi[c] = max(hi[c], p[c]);
+				}
+			}
+
+			//orient the flat normal to agree with the file's vertex normals (winding is not consistent across meshes)
+			Vector n = t.flatNorm;
+			if (dot(n, t.v1.vNormal + t.v2.vNormal + t.v3.vNormal) < 0) n = -n;
+
+			normals.push_back(n);
+			normalSum = normalSum + n;
+		}
+
+		m.center = Point((lo[0] + hi[0]) / 2, (lo[1] + hi[1]) / 2, (lo[2] + hi[2]) / 2, 1);
+		m.radius = 0;
+		for (int i = first; i < last; i++)
+		{
+			const Triangle& t = triangles[i];
+			for (const Vertex& vert : { t.v1, t.v2, t.v3 }) m.radius = max(m.radius, Vector(m.center, vert.point).length());
 		}
+
+		//normal cone: every normal is within acos(minDot) of the axis
+		m.coneAxis = Vector(0, 0, 0);
+		m.coneCutoff = 2;
+		if (normalSum.length() > 0)
+		{
+			m.coneAxis = Unit(normalSum);
+
+			float minDot = 1;
+			for (const Vector& n : normals) minDot = min(minDot, dot(n, m.coneAxis));
+
+			// whole cone faces away once the axis is within (90 - cone angle) of the view direction
+			if (minDot > 0) m.coneCutoff = sqrt(1 - minDot * minDot);
+		}
+
+		meshlets.push_back(m);
 	}
+}
+
+// a packet goes on as single rays below nodes fewer of its lanes than this enter
+const int MIN_PACKET_LANES = 2;
+
+optional<Hit> Mesh::intersect(const Ray& ray) const
+{
+	//before checking for where intersection is in mesh, first check if it enters the box around it
+	float o[3] = { ray.origin().x(), ray.origin().y(), ray.origin().z() };
+	float inv[3] = { 1 / ray.dir().x(), 1 / ray.dir().y(), 1 / ray.dir().z() };
+	if (maskedOut || bvh.empty() || !boxHit(bvh.nodes[0], o, inv, FLT_MAX)) return {};		// box not hit (or all masked out) -> mesh never hit
+
+	rayCounters.rays++;
+
+	//find the CLOSEST intersection, keeping only where it is: its appearance (texture, bump map,
+	//spherical mapping) is resolved once, for that triangle only
+	float minT, minU, minV;
+	int closest = maskedHits ? closestTriangle<true>(ray, minT, minU, minV) : closestTriangle<false>(ray, minT, minU, minV);
+
+	if (closest < 0) return {};										//failed to find any intersection
+
+	rayCounters.shaded++;
+	return (this->*hitKernel)(triangleHit(ray, closest, minT, minU, minV));
+}
+
+void Mesh::intersect(const RayPacket& packet, optional<Hit> hits[RayPacket::SIZE]) const
+{
+	for (int lane = 0; lane < RayPacket::SIZE; lane++) hits[lane].reset();
+	if (maskedOut || bvh.empty()) return;
+
+	//rays missing the box around the mesh stop here, as for single rays
+	float maxT[RayPacket::SIZE];
+	fill(maxT, maxT + RayPacket::SIZE, FLT_MAX);
+
+	unsigned entering = boxHits(packet, bvh.nodes[0].lo, bvh.nodes[0].hi, maxT, packet.active);
+	if (entering == 0) return;
+
+	rayCounters.rays += popcount(entering);
+
+	int closest[RayPacket::SIZE];
+	float minT[RayPacket::SIZE], minU[RayPacket::SIZE], minV[RayPacket::SIZE];
+	if (maskedHits) closestTriangles<true>(packet, closest, minT, minU, minV);
+	else closestTriangles<false>(packet, closest, minT, minU, minV);
+
+	//appearance of each lane's closest hit, as for single rays
+	for (int lane = 0; lane < RayPacket::SIZE; lane++)
+	{
+		if (closest[lane] < 0) continue;
+
+		rayCounters.shaded++;
+		hits[lane] = (this->*hitKernel)(triangleHit(packet.ray(lane), closest[lane], minT[lane], minU[lane], minV[lane]));
+	}
+}
+
+template <bool Masked>
+int Mesh::closestTriangle(const Ray& ray, float& minT, float& minU, float& minV) const
+{
+	int closest = -1;
+	minT = FLT_MAX;
+
+	if (!bvh.empty()) traverse<Masked>(ray, 0, closest, minT, minU, minV);
+
+	return closest;
+}
+
+template <bool Masked>
+void Mesh::traverse(const Ray& ray, int root, int& closest, float& minT, float& minU, float& minV) const
+{
+	float o[3] = { ray.origin().x(), ray.origin().y(), ray.origin().z() };
+	float d[3] = { ray.dir().x(), ray.dir().y(), ray.dir().z() };
+	float inv[3] = { 1 / d[0], 1 / d[1], 1 / d[2] };
+
+	int stack[64];
+	int top = 0;
+	stack[top++] = root;
+
+	while (top > 0)
+	{
+		int index = stack[--top];
+		const BvhNode& node = bvh.nodes[index];
+
+		//boxes entered past the closest hit so far cannot hold a closer one
+		if (!boxHit(node, o, inv, minT)) continue;
+
+		if (node.count == 0)
+		{
+			//nearer child on top, so its hits can rule out the other child
+			int nearChild = index + 1, farChild = node.first;
+			if (along(bvh.nodes[farChild], d) < along(bvh.nodes[nearChild], d)) swap(nearChild, farChild);
+
+			stack[top++] = farChild;
+			stack[top++] = nearChild;
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			int triangle = bvh.order[i];
+
+			Point corners[3];
+			triangleCorners(triangle, corners);
+
+			float t, u, v;
+			if (!intersectTriangle(ray, corners, t, u, v)) continue;
+
+			//masked out parts do not hide what is behind them (cheap test, unlike the full appearance)
+			if constexpr (Masked)
+			{
+				if (!maskBits.visible(u, v)) continue;
+			}
+
+			rayCounters.candidates++;
+
+			//ties go to the lowest triangle, whatever order the hierarchy visits them in
+			if (t > minT || (t == minT && triangle > closest)) continue;
 
-	if (minHit)	return minHit;
-	
-	return {};	//failed to find any intersection
+			closest = triangle;
+			minT = t;
+			minU = u;
+			minV = v;
+		}
+	}
+}
+
+template <bool Masked>
+void Mesh::closestTriangles(const RayPacket& packet, int closest[RayPacket::SIZE],
+							float minT[RayPacket::SIZE], float minU[RayPacket::SIZE], float minV[RayPacket::SIZE]) const
+{
+	fill(closest, closest + RayPacket::SIZE, -1);
+	fill(minT, minT + RayPacket::SIZE, FLT_MAX);
+
+	if (bvh.empty() || packet.active == 0) return;
+	packetCounters.packets++;
+
+	//rays going different ways want different child orders: trace them one by one
+	if (!packet.coherent())
+	{
+		for (unsigned lanes = packet.active; lanes; lanes &= lanes - 1)
+		{
+			int lane = countr_zero(lanes);
+			traverse<Masked>(packet.ray(lane), 0, closest[lane], minT[lane], minU[lane], minV[lane]);
+			packetCounters.singleRays++;
+		}
+		return;
+	}
+
+	//children are ordered along the first ray (the others point about the same way)
+	int lead = countr_zero(packet.active);
+	float d[3] = { packet.dx[lead], packet.dy[lead], packet.dz[lead] };
+
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0)
+	{
+		int index = stack[--top];
+		const BvhNode& node = bvh.nodes[index];
+
+		unsigned lanes = boxHits(packet, node.lo, node.hi, minT, packet.active);
+		if (lanes == 0) continue;
+
+		packetCounters.nodeVisits++;
+		packetCounters.activeLanes += popcount(lanes);
+
+		//the packet has diverged here: the few rays left go on alone rather than keep the other lanes idle
+		if (popcount(lanes) < MIN_PACKET_LANES)
+		{
+			for (; lanes; lanes &= lanes - 1)
+			{
+				int lane = countr_zero(lanes);
+				traverse<Masked>(packet.ray(lane), index, closest[lane], minT[lane], minU[lane], minV[lane]);
+				packetCounters.singleRays++;
+			}
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			int nearChild = index + 1, farChild = node.first;
+			if (along(bvh.nodes[farChild], d) < along(bvh.nodes[nearChild], d)) swap(nearChild, farChild);
+
+			stack[top++] = farChild;
+			stack[top++] = nearChild;
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			int triangle = bvh.order[i];
+
+			Point corners[3];
+			triangleCorners(triangle, corners);
+
+			float t[RayPacket::SIZE], u[RayPacket::SIZE], v[RayPacket::SIZE];
+			for (unsigned hits = triangleHits(packet, corners, lanes, t, u, v); hits; hits &= hits - 1)
+			{
+				int lane = countr_zero(hits);
+
+				if constexpr (Masked)
+				{
+					if (!maskBits.visible(u[lane], v[lane])) continue;
+				}
+
+				rayCounters.candidates++;
+				if (t[lane] > minT[lane] || (t[lane] == minT[lane] && triangle > closest[lane])) continue;
+
+				closest[lane] = triangle;
+				minT[lane] = t[lane];
+				minU[lane] = u[lane];
+				minV[lane] = v[lane];
+			}
+		}
+	}
+}
+
+void Mesh::triangleCorners(int triangle, Point corners[3]) const
+{
+	//after upload only the compact copy is left to test against
+	if (triangle < compact.triangleCount())
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			uint32_t v = compact.indices[triangle * 3 + c];
+			corners[c] = Point(compact.px[v], compact.py[v], compact.pz[v], 1);
+		}
+		return;
+	}
+
+	const Triangle& tri = triangles[triangle - compact.triangleCount()];
+	corners[0] = tri.v1.point;
+	corners[1] = tri.v2.point;
+	corners[2] = tri.v3.point;
+}
+
+bool Mesh::intersectTriangle(const Ray& ray, const Point corners[3], float& t, float& u, float& v) const
+{
+	//same solution as Triangle::intersect (EQ 6)
+	Vector e1(corners[0], corners[1]);
+	Vector e2(corners[0], corners[2]);
+	Vector P = ray.dir().cross(e2);
+
+	float det = dot(P, e1);
+	if (det == 0) return false;										// ray is parallel to the triangle
+
+	Vector T(corners[0], ray.origin());
+	Vector Q = T.cross(e1);
+
+	t = dot(Q, e2) / det;
+	if (t < ZERO) return false;										// behind the ray (or too close to it)
+
+	u = dot(P, T) / det;
+	v = dot(Q, ray.dir()) / det;
+	return u >= 0 && v >= 0 && 1 - u - v >= 0;						// triangle missed otherwise (w as triangleHit() computes it: u + v <= 1 can leave it below 0)
+}
+
+Hit Mesh::triangleHit(const Ray& ray, int triangle, float t, float u, float v) const
+{
+	float w = 1 - u - v;
+
+	//triangle list: vertex colors and normals are interpolated
+	if (triangle >= compact.triangleCount())
+	{
+		const Triangle& tri = triangles[triangle - compact.triangleCount()];
+
+		Color weigColor = w * tri.v1.vColor + u * tri.v2.vColor + v * tri.v3.vColor;
+		Unit weigNorm(w * tri.v1.vNormal + u * tri.v2.vNormal + v * tri.v3.vNormal);
+
+		return Hit{ ray.point(t), weigNorm, weigColor, t, mat, u, v };
+	}
+
+	//compact copy: the same interpolation, from the attributes each corner kept
+	const uint32_t* ids = &compact.indices[triangle * 3];
+	auto vertexColor = [&](int c) { return Color(compact.r[ids[c]], compact.g[ids[c]], compact.b[ids[c]]); };
+	auto vertexNormal = [&](int c) { return Vector(compact.nx[ids[c]], compact.ny[ids[c]], compact.nz[ids[c]]); };
+
+	Color weigColor = w * vertexColor(0) + u * vertexColor(1) + v * vertexColor(2);
+	Unit weigNorm(w * vertexNormal(0) + u * vertexNormal(1) + v * vertexNormal(2));
+
+	return Hit{ ray.point(t), weigNorm, weigColor, t, mat, u, v };
 }
 
 optional<Hit> Mesh::viableT(float t, const Ray& ray) const
@@ -178,9 +919,13 @@ Unit Mesh::bumpNormal(const Point& pt, const Unit& N, float u, float v) const
 	if (bumpMap == nullptr) return N;			//no bump map, return regular normal
 
 	//else was a bump map
-	//compute U, V, then perturbed normal
 	auto [du, dv] = bumpMap->gradient(u, v);
+	return perturbNormal(N, du, dv);
+}
 
+Unit Mesh::perturbNormal(const Unit& N, float du, float dv) const
+{
+	//compute U, V, then perturbed normal
 
 	Vector yAxis(0, 1, 0);
 	Vector U = yAxis.cross(N);	
@@ -191,12 +936,85 @@ Unit Mesh::bumpNormal(const Point& pt, const Unit& N, float u, float v) const
 
 	Vector norm = N + du * U + dv * V;
 	return Unit(norm);
-
-	
-	return Unit();
 }
 
 optional<Hit> Mesh::updateHit(optional<Hit> hit) const
+{
+	return (this->*hitKernel)(*hit);
+}
+
+void Mesh::selectKernels()
+{
+	//direct mapping kernels, indexed by [textured][masked][bumped]
+	static const HitKernel DIRECT[2][2][2] = {
+		{ { &Mesh::directHit<false, false, false>, &Mesh::directHit<false, false, true> },
+		  { &Mesh::directHit<false, true, false>, &Mesh::directHit<false, true, true> } },
+		{ { &Mesh::directHit<true, false, false>, &Mesh::directHit<true, false, true> },
+		  { &Mesh::directHit<true, true, false>, &Mesh::directHit<true, true, true> } } };
+
+	if (mapMode == "direct") mapping = MapMode::Direct;
+	else if (mapMode == "spherical") mapping = MapMode::Spherical;
+	else mapping = MapMode::None;
+
+	switch (mapping)
+	{
+		case MapMode::Direct:
+			hitKernel = DIRECT[texture != nullptr][masked()][bumpMap != nullptr];		// (a mask hiding nothing is skipped)
+			break;
+		case MapMode::Spherical:
+			hitKernel = &Mesh::sphericalHit;
+			break;
+		default:
+			hitKernel = &Mesh::plainHit;
+			break;
+	}
+
+	textureSampler = texture ? texture->colorSampler() : nullptr;
+	bumpSampler = bumpMap ? bumpMap->gradientSampler() : nullptr;
+
+	maskedHits = mapping == MapMode::Direct && masked();
+	maskedOut = maskedHits && maskCoverage == MaskCoverage::None;
+}
+
+optional<Hit> Mesh::plainHit(const Hit& hit) const
+{
+	//no mapping chosen, just return regular hit to see interpolated colors
+	return Hit{ hit.inter, hit.normal, hit.color, hit.t, mat, hit.u, hit.v };
+}
+
+optional<Hit> Mesh::sphericalHit(const Hit& hit) const
+{
+	Ray boundRay(hit.inter, hit.normal);					//from hit on triangle in direction of the normal at this intersection
+	optional<Hit> sphereHit = bound.intersect(boundRay);
+	sphereHit->t = hit.t;									//keep t from triangle's intersection, not the sphere so can still compare for closest intersected triangle in mesh
+
+	return sphereHit;
+}
+
+template <bool Textured, bool Masked, bool Bumped>
+optional<Hit> Mesh::directHit(const Hit& hit) const
+{
+	//similar to image mapping for other shapes, except we already know t is viable, and know u,v
+	if constexpr (Masked)
+	{
+		if (!maskBits.visible(hit.u, hit.v)) return {};		//object not visible
+	}
+
+	//the images through the samplers picked for their storage formats
+	Color obColor = color;
+	if constexpr (Textured) obColor = textureSampler(*texture, hit.u, hit.v);
+
+	Unit normal = hit.normal;
+	if constexpr (Bumped)
+	{
+		auto [du, dv] = bumpSampler(*bumpMap, hit.u, hit.v);
+		normal = perturbNormal(hit.normal, du, dv);
+	}
+
+	return Hit{ hit.inter, normal, obColor, hit.t, mat, hit.u, hit.v };
+}
+
+optional<Hit> Mesh::updateHitDynamic(optional<Hit> hit) const
 {
 	if (mapMode == "direct")
 	{
@@ -212,7 +1030,7 @@ optional<Hit> Mesh::updateHit(optional<Hit> hit) const
 			Unit normal = bumpNormal(hit->inter, hit->normal, hit->u, hit->v);
 
 			//Create hit object and return it
-			return Hit{ hit->inter, normal, obColor, hit->t, mat };
+			return Hit{ hit->inter, normal, obColor, hit->t, mat, hit->u, hit->v };
 		}
 
 		return {};												//object not visible
@@ -228,7 +1046,7 @@ optional<Hit> Mesh::updateHit(optional<Hit> hit) const
 	}
 
 	//no mapping chosen, just return regular hit to see interpolated colors
-	return Hit{ hit->inter, hit->normal, hit->color, hit->t, mat };
+	return Hit{ hit->inter, hit->normal, hit->color, hit->t, mat, hit->u, hit->v };
 }
 
 Color Mesh::selectColor(float u, float v) const
@@ -244,13 +1062,13 @@ bool Mesh::isVisible(float u, float v) const
 {
 	if (this->mask == nullptr) return true;		//if no mask, point is visible by default
 
-	//if is mask, find color at given coordinates in the mask (value greater than 0 = visible)
-	return mask->gray_uv(u, v) > 0;
+	//if is mask, test the bit of its texels at the given coordinates (same answer as its gray value being greater than 0)
+	return maskBits.visible(u, v);
 }
 
 ostream& operator<< (ostream& os, const Mesh& m)
 {
-	cout << "Mesh: " << m.triangles.size() << " triangles" << endl;
+	cout << "Mesh: " << m.triangleCount() << " triangles" << endl;		// (only listed below while not yet uploaded)
 
 	for (const Triangle& tri : m.triangles)
 	{
@@ -263,78 +1081,35 @@ ostream& operator<< (ostream& os, const Mesh& m)
 
 istream& operator>>(istream& is, Mesh& m)
 {
-	/*
 	//variables for reading input
 	string token;
 
 	string mode;
 	string source;
-	Triangle tri;
+	float scale;
+	Vector translate;
 
 
 	is >> token >> source;								// get 'source,' then path to source file
 	is >> mode;											// get 'flat' or 'smooth' keyword for mesh
 	is >> m.mapMode;									// read in mapping mode: direct or spherical
 
-	is >> token >> m.scaleMesh;								// read in 'scale' and scale factor
-	is >> token >> m.transMesh;							// read in 'translate' and the translation 'vector'
-
+	is >> token >> scale;								// read in 'scale' and scale factor
+	is >> token >> translate;							// read in 'translate' and the translation 'vector'
 
-	//varibles for computing bounding sphere
-	float minX = FLT_MAX;
-	float minY = FLT_MAX;
-	float minZ = FLT_MAX;
-	float maxX = FLT_MIN;
-	float maxY = FLT_MIN;
-	float maxZ = FLT_MIN;
+	//scale and translation are kept as the shape's transform (applied by the scene), not baked into the triangles
+	m.scale(scale, scale, scale);
+	m.move(translate.x(), translate.y(), translate.z());
 
 	//read triangles from mesh source file
-	ifstream ifs(source);
-
-	while (ifs >> token) {								//	loop through source file
-		if (token == "smooth_triangle")
-		{
-			ifs >> tri;
-
-			if (mode == "smooth") tri.setSmooth(true);		// mesh is smooth, so triangles have averaged normals
-			else tri.setSmooth(false);						// mesh is flat, so each vertex's normal is the triangle's flat normal
-
-			//tri.resize(scale, translate);					// scale and translate each triangle
-
-			//gather data for bounding sphere
-			for (const Point& vert : tri.vertices)
-			{
-				if (vert.x() > maxX)	maxX = vert.x();
-				if (vert.y() > maxY)	maxY = vert.y();
-				if (vert.z() > maxZ)	maxZ = vert.z();
-				if (vert.x() < minX)	minX = vert.x();
-				if (vert.y() < minY)	minY = vert.y();
-				if (vert.z() < minZ)	minZ = vert.z();
-			}
-
-			m.triangles.push_back(tri);
-		}
-	}
+	m.readSource(source, mode == "smooth");
 
-	//create bounding sphere
-	Point boxMinPt(minX, minY, minZ, 1);					
-	Point boxMaxPt(maxX, maxY, maxZ, 1);
-	Vector diagVec(boxMinPt, boxMaxPt);									//diagonal between boxMinPt and boxMaxPt of the bounding box
-	float radius = diagVec.length() / 2;
-
-	Vector center = (Vector(boxMinPt) + Vector(boxMaxPt)) / 2;			//center of bounding sphere -> midpoint of the diagnoal of bounding box
-
-	
-	m.bound = Sphere(center.point(), radius);
 
 	//read appearance of shape
 	if (m.mapMode == "spherical") m.bound.readApperance(is);			//spherical mapping mode, sphere returns color, material, normal
 	else m.readApperance(is);
-	*/
-	return is;
-
-}
-
-
 
+	m.selectKernels();
 
+	return is;
+}
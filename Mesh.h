@@ -4,31 +4,210 @@
 #include "Shape.h"
 #include "Triangle.h"
 #include "Sphere.h"
+#include "Meshlet.h"
+#include "IndexedMesh.h"
+#include "GpuResources.h"
+#include "Bvh.h"
+#include "RayPacket.h"
 #include <vector>
 
+/*
+* Range of the vertex buffer holding one level of detail of a mesh
+*/
+struct LodLevel
+{
+	int first;							// first vertex of the level in the vertex buffer
+	int count;							// number of vertices (3 per triangle)
+	float error;						// how far (in mesh units) the level may stray from the full resolution surface
+};
+
+/*
+* What a mesh keeps in CPU memory once its geometry is uploaded to the GPU
+*/
+enum class Residency
+{
+	GpuOnly,							// nothing but the culling data (enough for drawing)
+	RayQueries							// also a compact copy of the vertices (welded, indexed) for intersect()
+};
+
+/*
+* Ray queries counted by Mesh::intersect() (for benchmarks: not synchronized between threads)
+*/
+struct RayStats
+{
+	long long rays = 0;					// rays tested against the triangles (bounding box hit)
+	long long candidates = 0;			// visible triangle hits found along the way
+	long long shaded = 0;				// hits whose appearance was resolved (at most one per ray: the closest)
+};
+
+/*
+* How a mesh maps its appearance onto hits (read as 'none', 'direct' or 'spherical')
+*/
+enum class MapMode
+{
+	None,								// interpolated vertex colors
+	Direct,								// images addressed by the triangle's (u, v)
+	Spherical							// appearance of the bounding sphere, hit along the normal
+};
+
 class Mesh : public Shape
 {
 private:
-	GLuint vertexBuffer;				//data buffer
-	GLuint attribBuffer;				//layout description buffer for data
+	using HitKernel = optional<Hit> (Mesh::*)(const Hit& hit) const;
 
-	vector<Triangle> triangles;			//triangles that make up the mesh
+	GpuBuffer vertexBuffer;				//data buffer (deleted with the mesh)
+	VertexArray attribBuffer;			//layout description buffer for data
+	GpuTexture textureData;				// the texture, mask and bump map block compressed on the GPU (uploaded with the geometry)
+	GpuTexture maskData;
+	GpuTexture bumpData;
+
+	vector<Triangle> triangles;			//triangles that make up the mesh (released once uploaded)
+	IndexedMesh compact;				// vertices and indices kept after upload for ray queries (see Residency)
+	Bvh bvh;							// the triangles' bounding volume hierarchy, for ray queries (built only for RayQueries meshes)
+	Residency residency = Residency::GpuOnly;
 	Sphere bound;						// bounding sphere
-	string mapMode;						// mapMode: 'direct' mapping, 'spherical' mapping, or 'none'
-	float scaleMesh;					// amount by which to scale up each triangle of mesh (all meshes fit in 1x1x1 cube by default)
-	Vector transMesh;					// vector by which to translate entire mesh
+	Point boxMin;						// corners of the axis aligned bounding box
+	Point boxMax;
+	string mapMode;						// mapMode: 'direct' mapping, 'spherical' mapping, or 'none' (as read)
+	MapMode mapping = MapMode::None;	// same, resolved once at load
+	HitKernel hitKernel = &Mesh::plainHit;	// resolves a hit's appearance, chosen at load for the mapping and images (see selectKernels())
+	Image::ColorSampler textureSampler = nullptr;		// texture and bump map lookups for their storage formats (chosen with the kernel)
+	Image::GradientSampler bumpSampler = nullptr;
+	bool maskedHits = false;			// direct mapping with a mask: masked out hits are skipped while looking for the closest
+	bool maskedOut = false;				// direct mapping with a mask that hides everything: never hit
+
+	vector<Meshlet> meshlets;			// clusters of nearby triangles (consecutive in the vertex buffer)
+	bool closed = false;				// every edge shared by exactly two triangles -> back faces are never seen
+
+	bool smooth = true;					// smooth (vertex normals) or flat (triangle normals) shading
+	vector<LodLevel> lods;				// level 0 is the full mesh, each next level has about half the triangles
+	vector<Vertex> lodVertices;			// vertices of levels 1.. (uploaded after the full mesh)
+	mutable int lastLod = 0;			// level picked by the most recent draw()
+	mutable RayStats rayCounters;		// updated by intersect()
+	mutable PacketStats packetCounters;	// updated by intersect() for packets
+
+	/*
+	* Reads the triangles of a mesh source file, making each one smooth or flat
+	*/
+	void readSource(const string& filename, bool smooth);
+
+	/*
+	* Computes the bounding box and bounding sphere from the triangles
+	*/
+	void computeBounds();
+
+	/*
+	* Sets the bounding box to the given corners and the bounding sphere around it
+	*/
+	void setBounds(const Point& lo, const Point& hi);
+
+	/*
+	* Describes the layout of the vertex buffer to the active program's attributes
+	*/
+	void describeAttributes();
+
+	/*
+	* Uploads the shape's images block compressed (texture BC1, mask BC4, bump map gradient BC5),
+	* through the compressed image cache
+	*/
+	void uploadTextures();
+
+	/*
+	* Reorders the triangles so nearby ones are consecutive, then groups them into
+	* meshlets with a bounding sphere and normal cone each. Also determines if the mesh is closed.
+	*/
+	void buildMeshlets();
+
+	/*
+	* Corners of a triangle for ray queries: those of the compact copy first, then those of the triangle list
+	* (only one of them holds the mesh, depending on whether it was uploaded)
+	*/
+	void triangleCorners(int triangle, Point corners[3]) const;
+
+	/*
+	* True if the ray crosses the triangle with the given corners, with the distance along the ray
+	* and barycentric coords (of corners 1 and 2) where it does
+	*/
+	bool intersectTriangle(const Ray& ray, const Point corners[3], float& t, float& u, float& v) const;
+
+	/*
+	* Builds the hit on a triangle (position, interpolated normal and color) before mapping (see updateHit())
+	*/
+	Hit triangleHit(const Ray& ray, int triangle, float t, float u, float v) const;
+
+	/*
+	* Builds the bounding volume hierarchy over the triangles (of the compact copy or the triangle list),
+	* or maps the one saved in the cache for the same geometry (saving it there when it had to be built)
+	*/
+	void buildBvh();
+
+	/*
+	* Closest triangle the ray crosses (-1 if none), skipping masked out hits when Masked
+	*/
+	template <bool Masked>
+	int closestTriangle(const Ray& ray, float& minT, float& minU, float& minV) const;
+
+	/*
+	* Visits the hierarchy below 'root' with one ray, updating the closest triangle found so far (and its t, u, v)
+	*/
+	template <bool Masked>
+	void traverse(const Ray& ray, int root, int& closest, float& minT, float& minU, float& minV) const;
+
+	/*
+	* Same as closestTriangle() for each lane of a packet, visiting the hierarchy once for all of them.
+	* Incoherent packets, and lanes left on their own in a subtree, are finished as single rays.
+	*/
+	template <bool Masked>
+	void closestTriangles(const RayPacket& packet, int closest[RayPacket::SIZE],
+						  float minT[RayPacket::SIZE], float minU[RayPacket::SIZE], float minV[RayPacket::SIZE]) const;
+
+	/*
+	* Picks the hit kernel for the mapping mode and the images the shape was given, so that
+	* resolving a hit never compares mode names or tests for missing images
+	*/
+	void selectKernels();
+
+	/*
+	* Hit kernels: no mapping, spherical mapping, and direct mapping specialized on which images the shape has
+	*/
+	optional<Hit> plainHit(const Hit& hit) const;
+	optional<Hit> sphericalHit(const Hit& hit) const;
+	template <bool Textured, bool Masked, bool Bumped>
+	optional<Hit> directHit(const Hit& hit) const;
+
+	/*
+	* Normal perturbed by the bump map's gradient (du, dv) at the hit
+	*/
+	Unit perturbNormal(const Unit& N, float du, float dv) const;
+
+	/*
+	* Builds the chain of simplified levels of detail (50%, 25%, 12.5%... of the triangles)
+	*/
+	void buildLods();
 
 public:
 	/*
-	* Default constructor
+	* Default constructor (empty mesh with baseline material)
 	*/
-	Mesh() = default;
+	Mesh();
 
 	/*
 	* Constructor 
 	*/
 	Mesh(string filename);
 
+	//a mesh owns its GL buffers (released by the destructor), so it can be moved but not copied
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+	Mesh(Mesh&&) noexcept = default;
+	Mesh& operator=(Mesh&&) noexcept = default;
+
+	/*
+	* Replaces the mesh with the one in a source file, keeping its GL buffers
+	* so the next setupBuffers() can reuse their storage
+	*/
+	void reload(const string& filename);
+
 
 	/*
 	* Return C++ 'optional' of 'Hit' object representing
@@ -37,6 +216,11 @@ public:
 	*/
 	optional<Hit> intersect(const Ray& ray) const override;
 
+	/*
+	* Closest hit of each ray of a packet (same results as intersect() one ray at a time)
+	*/
+	void intersect(const RayPacket& packet, optional<Hit> hits[RayPacket::SIZE]) const;
+
 	/*
 	* Method to determine if given t results in a viable hit.
 	* Returns nullopt if not viable
@@ -60,6 +244,12 @@ public:
 	*/
 	optional<Hit> updateHit(optional<Hit> hit) const;
 
+	/*
+	* Same result as updateHit(), deciding the mapping mode and image lookups anew for every hit
+	* (the reference benchShading() compares the load time kernels against)
+	*/
+	optional<Hit> updateHitDynamic(optional<Hit> hit) const;
+
 	/*
 	* Override from Shape.h
 	*/
@@ -71,14 +261,15 @@ public:
 	bool isVisible(float u, float v) const;
 
 	/*
-	* Overload of cout for Sphere, with access to private data members.
-	* Format: 'Sphere: Point(1,2,3) 456 Mat(ka,kd,ks,n)'
+	* Overload of cout for Mesh, with access to private data members.
+	* Format: 'Mesh: 123 triangles' followed by each triangle
 	*/
 	friend ostream& operator<<(ostream& os, const Mesh& m);
 
 	/*
-	* Overload of cin for Sphere, with access to private data members.
-	* Note: assume 'sphere' word has already been consumed when this method is called,
+	* Overload of cin for Mesh, with access to private data members.
+	* Format: 'source <file> smooth|flat direct|spherical|none scale <s> translate <x, y, z> <appearance> end'
+	* Note: assume 'mesh' word has already been consumed when this method is called,
 	* within Scene class
 	*/
 	friend istream& operator>>(istream& is, Mesh& m);
@@ -89,9 +280,99 @@ public:
 	void draw() const override;
 
 	/*
-	* Uploads mesh's geometry and describes its attributes
+	* Makes the mesh's layout buffer active (split from draw() so a scene can skip redundant binds)
+	*/
+	void bind() const;
+
+	/*
+	* Issues the draw call for the mesh, assuming its layout buffer is already bound
+	*/
+	void submit() const;
+
+	/*
+	* Issues one draw for several vertex ranges of the mesh (e.g. the meshlets that survived culling)
+	*/
+	void submitRanges(const vector<GLint>& firsts, const vector<GLsizei>& counts) const;
+
+	/*
+	* Returns the coarsest level of detail whose error stays under a pixel, given how many
+	* pixels one unit of the mesh covers on screen
+	*/
+	int selectLod(float pixelsPerUnit) const;
+
+	/*
+	* Issues the draw call for one level of detail, assuming the layout buffer is already bound
+	*/
+	void submitLod(int level) const;
+
+	/*
+	* Number of triangles of a level of detail, and the level used by the most recent draw()
+	*/
+	int lodTriangles(int level) const;
+	int drawnLod() const;
+
+	/*
+	* Directory where meshes save their ray query hierarchies, to map them instead of building them
+	* when the same geometry is loaded again ("mesh_cache" by default, "" = always build).
+	* GPU-only meshes never build one, so they neither hash their geometry nor touch the cache.
+	*/
+	static void setBvhCache(const string& directory);
+
+	/*
+	* Hash of the geometry as ray queries see it (every triangle's corners, in order), naming its saved hierarchy
+	*/
+	uint64_t contentHash() const;
+
+	/*
+	* True when the ray query hierarchy was mapped from the cache rather than built
+	*/
+	bool bvhMapped() const;
+
+	/*
+	* Ray query counters since the mesh was loaded
+	*/
+	const RayStats& rayStats() const;
+	const PacketStats& packetStats() const;
+
+	/*
+	* Accessors for the culling data computed at load time
+	*/
+	const Sphere& boundingSphere() const;
+	Point minCorner() const;
+	Point maxCorner() const;
+	const vector<Meshlet>& getMeshlets() const;
+	bool isClosed() const;
+	int triangleCount() const;
+
+	/*
+	* Chooses what stays in CPU memory after setupBuffers() (GpuOnly by default).
+	* RayQueries builds (or maps) the hierarchy intersect() needs: choose it before setupBuffers() frees the triangle list.
+	*/
+	void setResidency(Residency policy);
+
+	/*
+	* Bytes of geometry the mesh holds in CPU memory, and allocated for its GPU vertex buffer and textures
+	*/
+	size_t cpuBytes() const;
+	size_t gpuBytes() const;
+
+	/*
+	* Name of the vertex buffer (3 Vertex per triangle, every level of detail), for shaders that read it directly
+	*/
+	GLuint vertexData() const;
+
+	/*
+	* Uploads mesh's geometry and describes its attributes, then releases the CPU copy of
+	* the geometry (keeping only the compact vertices if the residency asks for ray queries)
 	*/
 	void setupBuffers();
+
+	/*
+	* Loads a mesh source file straight into a vertex buffer (instead of the constructor + setupBuffers()).
+	* The file is parsed and uploaded in fixed-size blocks, so the full triangle list is never in memory;
+	* meshlets and levels of detail are not built for a streamed mesh, and its compact copy is not welded.
+	*/
+	void streamSource(const string& filename, bool smooth);
 };
 
 #endif
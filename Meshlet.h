@@ -0,0 +1,24 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include "Point.h"
+#include "Vector.h"
+
+/*
+* Cluster of nearby triangles of a mesh that are stored consecutively in the vertex buffer,
+* so they can be culled (and drawn) as one unit.
+*/
+struct Meshlet
+{
+	//Data members
+	int first;				// first vertex of the cluster in the vertex buffer
+	int count;				// number of vertices (3 per triangle)
+
+	Point center;			// bounding sphere of the cluster
+	float radius;
+
+	Vector coneAxis;		// average facing direction of the cluster's triangles
+	float coneCutoff;		// cluster faces away from a view direction d when dot(coneAxis, d) > coneCutoff (> 1 = never)
+};
+
+#endif
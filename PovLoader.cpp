@@ -0,0 +1,201 @@
+#include "PovLoader.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+// chunks smaller than this are not worth a thread
+const size_t MIN_CHUNK_BYTES = 64 * 1024;
+
+static bool isSpace(char ch)
+{
+	return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+/*
+* Parses '<x, y, z>' starting at p, returns the position after '>' (nullptr if malformed)
+*/
+static const char* parseTriple(const char* p, const char* end, float out[3])
+{
+	while (p < end && *p != '<') p++;
+	if (p == end) return nullptr;
+	p++;															// skip '<'
+
+	for (int i = 0; i < 3; i++)
+	{
+		while (p < end && (isSpace(*p) || *p == ',')) p++;
+
+		auto [next, ec] = from_chars(p, end, out[i]);
+		if (ec != errc()) return nullptr;
+		p = next;
+	}
+
+	while (p < end && *p != '>') p++;
+	return p < end ? p + 1 : nullptr;
+}
+
+const char* KEYWORD = "smooth_triangle";
+const size_t KEYWORD_LENGTH = strlen(KEYWORD);
+
+/*
+* Returns the start of the next 'smooth_triangle' keyword at or after p (end if there is none).
+* Must be a whole word, e.g. not part of 'smoooth_triangle'.
+*/
+static const char* findKeyword(const char* p, const char* begin, const char* end)
+{
+	while (p < end)
+	{
+		p = search(p, end, KEYWORD, KEYWORD + KEYWORD_LENGTH);
+		if (p == end) break;
+
+		const char* after = p + KEYWORD_LENGTH;
+		if ((p == begin || isSpace(p[-1])) && (after == end || isSpace(*after))) return p;
+
+		p = after;
+	}
+
+	return end;
+}
+
+/*
+* Calls 'function' with consecutive line-aligned blocks of the file, reading at most about
+* 'blockBytes' at a time (a block grows only if a single line is longer than that)
+*/
+template <typename Function>
+static void forEachBlock(const string& filename, size_t blockBytes, Function function)
+{
+	ifstream ifs(filename, ios::binary);
+	vector<char> buffer(blockBytes);
+	size_t carry = 0;											// bytes of an unfinished line kept from the previous block
+
+	while (ifs)
+	{
+		ifs.read(buffer.data() + carry, buffer.size() - carry);
+		size_t filled = carry + ifs.gcount();
+		bool last = !ifs;										// reached the end of the file
+
+		const char* begin = buffer.data();
+		const char* end = begin + filled;
+		const char* split = end;
+
+		if (!last)
+		{
+			//stop after the last complete line
+			while (split > begin && split[-1] != '\n') split--;
+
+			if (split == begin)									// one line fills the whole block, make room and read more
+			{
+				carry = filled;
+				buffer.resize(buffer.size() * 2);
+				continue;
+			}
+		}
+
+		if (split > begin) function(begin, split);
+
+		carry = end - split;
+		memmove(buffer.data(), split, carry);
+	}
+}
+
+void parseTriangles(const char* begin, const char* end, bool smooth, vector<Triangle>& out)
+{
+	const char* p = begin;
+
+	while ((p = findKeyword(p, begin, end)) < end)
+	{
+		//three vertex, normal pairs followed by 'rgb <r, g, b>'
+		float values[7][3];
+		const char* cursor = p + KEYWORD_LENGTH;
+		for (int i = 0; i < 7 && cursor; i++) cursor = parseTriple(cursor, end, values[i]);
+		if (!cursor) break;
+
+		Point points[3];
+		Vector normals[3];
+		for (int i = 0; i < 3; i++)
+		{
+			points[i] = Point(values[2 * i][0], values[2 * i][1], values[2 * i][2], 1);
+			normals[i] = Vector(values[2 * i + 1][0], values[2 * i + 1][1], values[2 * i + 1][2]);
+		}
+
+		Triangle tri;
+		tri.set(points, normals, Color(values[6][0], values[6][1], values[6][2]));
+		tri.setSmooth(smooth);												// vertex colors (and flat normals) computed here, in parallel
+
+		out.push_back(tri);
+		p = cursor;
+	}
+}
+
+void parseParallel(const char* begin, const char* end, bool smooth, unsigned threads, vector<Triangle>& out)
+{
+	size_t bytes = end - begin;
+
+	if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+	size_t chunks = min((size_t)threads, bytes / MIN_CHUNK_BYTES + 1);
+
+	//chunk boundaries, each moved forward to the start of the next line
+	vector<const char*> bounds = { begin };
+	for (size_t c = 1; c < chunks; c++)
+	{
+		const char* split = max(bounds.back(), begin + bytes * c / chunks);
+		split = find(split, end, '\n');
+		bounds.push_back(split == end ? end : split + 1);
+	}
+	bounds.push_back(end);
+
+	//parse each chunk on its own thread (the first on this one, straight into 'out')
+	vector<vector<Triangle>> parts(chunks);
+	vector<thread> workers;
+
+	for (size_t c = 1; c < chunks; c++)
+	{
+		workers.emplace_back(parseTriangles, bounds[c], bounds[c + 1], smooth, ref(parts[c]));
+	}
+	parseTriangles(bounds[0], bounds[1], smooth, out);
+
+	for (thread& worker : workers) worker.join();
+
+	//merge in file order
+	size_t total = out.size();
+	for (size_t c = 1; c < chunks; c++) total += parts[c].size();
+
+	out.reserve(total);
+	for (size_t c = 1; c < chunks; c++) out.insert(out.end(), parts[c].begin(), parts[c].end());
+}
+
+vector<Triangle> loadPov(const string& filename, bool smooth, unsigned threads)
+{
+	MappedFile file(filename);
+	if (!file.isOpen() || file.size() == 0) return {};
+
+	vector<Triangle> triangles;
+	parseParallel(file.data(), file.data() + file.size(), smooth, threads, triangles);
+
+	return triangles;
+}
+
+size_t countPovTriangles(const string& filename, size_t blockBytes)
+{
+	size_t count = 0;
+
+	forEachBlock(filename, blockBytes, [&](const char* begin, const char* end) {
+		for (const char* p = begin; (p = findKeyword(p, begin, end)) < end; p += KEYWORD_LENGTH) count++;
+	});
+
+	return count;
+}
+
+void streamPov(const string& filename, bool smooth, size_t blockBytes, const function<void(const vector<Triangle>&)>& sink)
+{
+	vector<Triangle> block;
+
+	forEachBlock(filename, blockBytes, [&](const char* begin, const char* end) {
+		block.clear();
+		parseParallel(begin, end, smooth, 0, block);
+
+		if (!block.empty()) sink(block);
+	});
+}
@@ -0,0 +1,41 @@
+#ifndef POVLOADER_H
+#define POVLOADER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "Triangle.h"
+using namespace std;
+
+/*
+* Parses every 'smooth_triangle' (one per line, as in the files of pov/) found in the text [begin, end),
+* appending the triangles to 'out' with their vertex colors and normals already set
+* for a smooth or flat mesh (see Triangle::setSmooth).
+*/
+void parseTriangles(const char* begin, const char* end, bool smooth, vector<Triangle>& out);
+
+/*
+* Splits the text [begin, end) into line-aligned chunks that are parsed on 'threads' threads
+* (0 = one per core), appending the triangles to 'out' in text order
+*/
+void parseParallel(const char* begin, const char* end, bool smooth, unsigned threads, vector<Triangle>& out);
+
+/*
+* Reads the triangles of a .pov mesh file. The mapped file is split into line-aligned chunks that
+* are parsed on 'threads' threads (0 = one per core) and merged back in file order.
+*/
+vector<Triangle> loadPov(const string& filename, bool smooth, unsigned threads = 0);
+
+/*
+* Counts the triangles of a .pov mesh file without parsing them, reading about 'blockBytes' at a time
+*/
+size_t countPovTriangles(const string& filename, size_t blockBytes);
+
+/*
+* Reads a .pov mesh file about 'blockBytes' at a time, calling 'sink' with the triangles of each
+* line-aligned block (the vector is reused between calls). Only one block of text and of
+* triangles is ever in memory, so the file may be larger than RAM.
+*/
+void streamPov(const string& filename, bool smooth, size_t blockBytes, const function<void(const vector<Triangle>&)>& sink);
+
+#endif
@@ -0,0 +1,301 @@
+#include "RayPacket.h"
+#include "utils.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+void RayPacket::set(int lane, const Ray& ray)
+{
+	ox[lane] = ray.origin().x();
+	oy[lane] = ray.origin().y();
+	oz[lane] = ray.origin().z();
+
+	dx[lane] = ray.dir().x();
+	dy[lane] = ray.dir().y();
+	dz[lane] = ray.dir().z();
+
+	ix[lane] = 1 / dx[lane];								// +-infinity along axes the ray is parallel to
+	iy[lane] = 1 / dy[lane];
+	iz[lane] = 1 / dz[lane];
+
+	active |= 1u << lane;
+}
+
+Ray RayPacket::ray(int lane) const
+{
+	return Ray(Point(ox[lane], oy[lane], oz[lane], 1), Vector(dx[lane], dy[lane], dz[lane]));
+}
+
+int RayPacket::count() const
+{
+	return popcount(active);
+}
+
+bool RayPacket::coherent() const
+{
+	int first = countr_zero(active);
+
+	for (int lane = first + 1; lane < SIZE; lane++)
+	{
+		if (!(active & (1u << lane))) continue;
+
+		if (signbit(ix[lane]) != signbit(ix[first]) || signbit(iy[lane]) != signbit(iy[first]) || signbit(iz[lane]) != signbit(iz[first])) return false;
+	}
+
+	return true;
+}
+
+RayPacket RayPacket::transformed(const Mat4& m) const
+{
+	RayPacket moved;
+	moved.active = active;
+
+	for (int lane = 0; lane < SIZE; lane++)
+	{
+		float x = ox[lane], y = oy[lane], z = oz[lane];
+		moved.ox[lane] = m[0] * x + m[4] * y + m[8] * z + m[12];
+		moved.oy[lane] = m[1] * x + m[5] * y + m[9] * z + m[13];
+		moved.oz[lane] = m[2] * x + m[6] * y + m[10] * z + m[14];
+
+		x = dx[lane], y = dy[lane], z = dz[lane];
+		float mx = m[0] * x + m[4] * y + m[8] * z;
+		float my = m[1] * x + m[5] * y + m[9] * z;
+		float mz = m[2] * x + m[6] * y + m[10] * z;
+		float length = sqrt((float)((double)mx * mx + (double)my * my + (double)mz * mz));	// (as Unit normalizes, so lanes match single rays)
+
+		moved.dx[lane] = mx / length;
+		moved.dy[lane] = my / length;
+		moved.dz[lane] = mz / length;
+		moved.ix[lane] = 1 / moved.dx[lane];
+		moved.iy[lane] = 1 / moved.dy[lane];
+		moved.iz[lane] = 1 / moved.dz[lane];
+	}
+
+	return moved;
+}
+
+bool RayPacket::cone(float axis[3], float& cosAngle, float& sinAngle) const
+{
+	if (active == 0) return false;
+	int first = countr_zero(active);
+
+	float sum[3] = { 0, 0, 0 };
+	for (int lane = 0; lane < SIZE; lane++)
+	{
+		if (!(active & (1u << lane))) continue;
+		if (ox[lane] != ox[first] || oy[lane] != oy[first] || oz[lane] != oz[first]) return false;
+
+		sum[0] += dx[lane];
+		sum[1] += dy[lane];
+		sum[2] += dz[lane];
+	}
+
+	float length = sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+	if (length == 0) return false;
+
+	for (int c = 0; c < 3; c++) axis[c] = sum[c] / length;
+
+	cosAngle = 1;
+	for (int lane = 0; lane < SIZE; lane++)
+	{
+		if (active & (1u << lane)) cosAngle = min(cosAngle, dx[lane] * axis[0] + dy[lane] * axis[1] + dz[lane] * axis[2]);
+	}
+
+	cosAngle -= 1e-4f;										// a little wider, so rounding never leaves a ray outside
+	if (cosAngle <= 0) return false;
+
+	sinAngle = sqrt(1 - cosAngle * cosAngle);
+	return true;
+}
+
+double PacketStats::laneUtilization() const
+{
+	return nodeVisits ? (double)activeLanes / (nodeVisits * RayPacket::SIZE) : 0;
+}
+
+PacketStats& PacketStats::operator+=(const PacketStats& other)
+{
+	packets += other.packets;
+	nodeVisits += other.nodeVisits;
+	activeLanes += other.activeLanes;
+	singleRays += other.singleRays;
+
+	return *this;
+}
+
+#ifdef __AVX__
+
+unsigned boxHits(const RayPacket& packet, const float lo[3], const float hi[3], const float maxT[RayPacket::SIZE], unsigned mask)
+{
+	//slabs: distances to both planes of each axis, entering at the latest near plane, leaving at the earliest far one
+	__m256 tEnter = _mm256_setzero_ps();
+	__m256 tExit = _mm256_loadu_ps(maxT);
+
+	const float* origins[3] = { packet.ox, packet.oy, packet.oz };
+	const float* inverses[3] = { packet.ix, packet.iy, packet.iz };
+
+	for (int c = 0; c < 3; c++)
+	{
+		__m256 o = _mm256_loadu_ps(origins[c]);
+		__m256 inv = _mm256_loadu_ps(inverses[c]);
+
+		__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(lo[c]), o), inv);
+		__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(hi[c]), o), inv);
+
+		tEnter = _mm256_max_ps(tEnter, _mm256_min_ps(t0, t1));
+		tExit = _mm256_min_ps(tExit, _mm256_max_ps(t0, t1));
+	}
+
+	return mask & _mm256_movemask_ps(_mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ));
+}
+
+unsigned triangleHits(const RayPacket& packet, const Point corners[3], unsigned mask,
+					  float t[RayPacket::SIZE], float u[RayPacket::SIZE], float v[RayPacket::SIZE])
+{
+	//the edges are the same for every lane
+	__m256 e1x = _mm256_set1_ps(corners[1].x() - corners[0].x());
+	__m256 e1y = _mm256_set1_ps(corners[1].y() - corners[0].y());
+	__m256 e1z = _mm256_set1_ps(corners[1].z() - corners[0].z());
+	__m256 e2x = _mm256_set1_ps(corners[2].x() - corners[0].x());
+	__m256 e2y = _mm256_set1_ps(corners[2].y() - corners[0].y());
+	__m256 e2z = _mm256_set1_ps(corners[2].z() - corners[0].z());
+
+	__m256 dx = _mm256_loadu_ps(packet.dx), dy = _mm256_loadu_ps(packet.dy), dz = _mm256_loadu_ps(packet.dz);
+
+	//P = dir x e2, det = P . e1
+	__m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+	__m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+	__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+	__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, e1x), _mm256_mul_ps(py, e1y)), _mm256_mul_ps(pz, e1z));
+
+	//T = origin - corner 0, Q = T x e1
+	__m256 tx = _mm256_sub_ps(_mm256_loadu_ps(packet.ox), _mm256_set1_ps(corners[0].x()));
+	__m256 ty = _mm256_sub_ps(_mm256_loadu_ps(packet.oy), _mm256_set1_ps(corners[0].y()));
+	__m256 tz = _mm256_sub_ps(_mm256_loadu_ps(packet.oz), _mm256_set1_ps(corners[0].z()));
+	__m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+	__m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+	__m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+
+	__m256 hitT = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qx, e2x), _mm256_mul_ps(qy, e2y)), _mm256_mul_ps(qz, e2z)), det);
+	__m256 hitU = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, tx), _mm256_mul_ps(py, ty)), _mm256_mul_ps(pz, tz)), det);
+	__m256 hitV = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qx, dx), _mm256_mul_ps(qy, dy)), _mm256_mul_ps(qz, dz)), det);
+
+	__m256 zero = _mm256_setzero_ps();
+	__m256 inside = _mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_NEQ_OQ), _mm256_cmp_ps(hitT, _mm256_set1_ps(ZERO), _CMP_GE_OQ));
+	inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(hitU, zero, _CMP_GE_OQ), _mm256_cmp_ps(hitV, zero, _CMP_GE_OQ)));
+	inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(1), hitU), hitV), zero, _CMP_GE_OQ));	// (w, as the scalar test)
+
+	_mm256_storeu_ps(t, hitT);
+	_mm256_storeu_ps(u, hitU);
+	_mm256_storeu_ps(v, hitV);
+
+	return mask & _mm256_movemask_ps(inside);
+}
+
+unsigned sphereHits(const RayPacket& packet, float cx, float cy, float cz, float radius2, float nearest, unsigned mask, float t[RayPacket::SIZE])
+{
+	__m256 dx = _mm256_loadu_ps(packet.dx), dy = _mm256_loadu_ps(packet.dy), dz = _mm256_loadu_ps(packet.dz);
+	__m256 ocX = _mm256_sub_ps(_mm256_loadu_ps(packet.ox), _mm256_set1_ps(cx));
+	__m256 ocY = _mm256_sub_ps(_mm256_loadu_ps(packet.oy), _mm256_set1_ps(cy));
+	__m256 ocZ = _mm256_sub_ps(_mm256_loadu_ps(packet.oz), _mm256_set1_ps(cz));
+
+	__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, ocX), _mm256_mul_ps(dy, ocY)), _mm256_mul_ps(dz, ocZ));
+	__m256 px = _mm256_sub_ps(ocX, _mm256_mul_ps(b, dx));
+	__m256 py = _mm256_sub_ps(ocY, _mm256_mul_ps(b, dy));
+	__m256 pz = _mm256_sub_ps(ocZ, _mm256_mul_ps(b, dz));
+	__m256 disc = _mm256_sub_ps(_mm256_set1_ps(radius2), _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)), _mm256_mul_ps(pz, pz)));
+
+	__m256 zero = _mm256_setzero_ps();
+	__m256 minT = _mm256_set1_ps(nearest);
+	__m256 root = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+	__m256 t1 = _mm256_sub_ps(_mm256_sub_ps(zero, b), root);
+	__m256 t2 = _mm256_add_ps(_mm256_sub_ps(zero, b), root);
+
+	//first root far enough along the ray
+	__m256 hitT = _mm256_blendv_ps(t2, t1, _mm256_cmp_ps(t1, minT, _CMP_GE_OQ));
+	__m256 hit = _mm256_and_ps(_mm256_cmp_ps(disc, zero, _CMP_GE_OQ), _mm256_cmp_ps(hitT, minT, _CMP_GE_OQ));
+
+	_mm256_storeu_ps(t, hitT);
+	return mask & _mm256_movemask_ps(hit);
+}
+
+#else
+
+unsigned boxHits(const RayPacket& packet, const float lo[3], const float hi[3], const float maxT[RayPacket::SIZE], unsigned mask)
+{
+	unsigned hits = 0;
+
+	for (int lane = 0; lane < RayPacket::SIZE; lane++)
+	{
+		float o[3] = { packet.ox[lane], packet.oy[lane], packet.oz[lane] };
+		float inv[3] = { packet.ix[lane], packet.iy[lane], packet.iz[lane] };
+		float tEnter = 0, tExit = maxT[lane];
+
+		for (int c = 0; c < 3; c++)
+		{
+			float t0 = (lo[c] - o[c]) * inv[c];
+			float t1 = (hi[c] - o[c]) * inv[c];
+
+			tEnter = max(tEnter, min(t0, t1));
+			tExit = min(tExit, max(t0, t1));
+		}
+
+		if (tEnter <= tExit) hits |= 1u << lane;
+	}
+
+	return mask & hits;
+}
+
+unsigned triangleHits(const RayPacket& packet, const Point corners[3], unsigned mask,
+					  float t[RayPacket::SIZE], float u[RayPacket::SIZE], float v[RayPacket::SIZE])
+{
+	float e1x = corners[1].x() - corners[0].x(), e1y = corners[1].y() - corners[0].y(), e1z = corners[1].z() - corners[0].z();
+	float e2x = corners[2].x() - corners[0].x(), e2y = corners[2].y() - corners[0].y(), e2z = corners[2].z() - corners[0].z();
+	unsigned hits = 0;
+
+	for (int lane = 0; lane < RayPacket::SIZE; lane++)
+	{
+		float dx = packet.dx[lane], dy = packet.dy[lane], dz = packet.dz[lane];
+
+		float px = dy * e2z - dz * e2y, py = dz * e2x - dx * e2z, pz = dx * e2y - dy * e2x;
+		float det = px * e1x + py * e1y + pz * e1z;
+
+		float tx = packet.ox[lane] - corners[0].x(), ty = packet.oy[lane] - corners[0].y(), tz = packet.oz[lane] - corners[0].z();
+		float qx = ty * e1z - tz * e1y, qy = tz * e1x - tx * e1z, qz = tx * e1y - ty * e1x;
+
+		t[lane] = (qx * e2x + qy * e2y + qz * e2z) / det;
+		u[lane] = (px * tx + py * ty + pz * tz) / det;
+		v[lane] = (qx * dx + qy * dy + qz * dz) / det;
+
+		if (det != 0 && t[lane] >= ZERO && u[lane] >= 0 && v[lane] >= 0 && u[lane] + v[lane] <= 1) hits |= 1u << lane;
+	}
+
+	return mask & hits;
+}
+
+unsigned sphereHits(const RayPacket& packet, float cx, float cy, float cz, float radius2, float nearest, unsigned mask, float t[RayPacket::SIZE])
+{
+	unsigned hits = 0;
+
+	for (int lane = 0; lane < RayPacket::SIZE; lane++)
+	{
+		float dx = packet.dx[lane], dy = packet.dy[lane], dz = packet.dz[lane];
+		float ocX = packet.ox[lane] - cx, ocY = packet.oy[lane] - cy, ocZ = packet.oz[lane] - cz;
+
+		float b = dx * ocX + dy * ocY + dz * ocZ;
+		float px = ocX - b * dx, py = ocY - b * dy, pz = ocZ - b * dz;
+		float disc = radius2 - (px * px + py * py + pz * pz);
+
+		float root = sqrt(max(disc, 0.0f));
+		t[lane] = -b - root >= nearest ? -b - root : -b + root;
+
+		if (disc >= 0 && t[lane] >= nearest) hits |= 1u << lane;
+	}
+
+	return mask & hits;
+}
+
+#endif
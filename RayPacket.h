@@ -0,0 +1,98 @@
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include "Point.h"
+#include "Ray.h"
+#include "Transform.h"
+using namespace std;
+
+/*
+* Rays traced together, one SIMD lane each (structure-of-arrays), e.g. a 4x2 tile of camera pixels.
+* Coherent rays visit mostly the same acceleration structure nodes, so each node is fetched and
+* tested once for the whole packet.
+*/
+struct RayPacket
+{
+	static const int SIZE = 8;			// lanes (one AVX register of floats)
+
+	float ox[SIZE] = {}, oy[SIZE] = {}, oz[SIZE] = {};	// origins
+	float dx[SIZE] = {}, dy[SIZE] = {}, dz[SIZE] = {};	// unit directions
+	float ix[SIZE] = {}, iy[SIZE] = {}, iz[SIZE] = {};	// 1 / direction, for box tests
+	unsigned active = 0;				// bit n set: lane n holds a ray
+
+	/*
+	* Puts a ray in a lane (and marks the lane active)
+	*/
+	void set(int lane, const Ray& ray);
+
+	/*
+	* The ray of a lane
+	*/
+	Ray ray(int lane) const;
+
+	/*
+	* Number of active lanes
+	*/
+	int count() const;
+
+	/*
+	* True when every active ray's direction has the same signs (they then cross boxes in the same order)
+	*/
+	bool coherent() const;
+
+	/*
+	* The packet with every ray moved by the matrix (directions renormalized), e.g. into a shape's space
+	*/
+	RayPacket transformed(const Mat4& m) const;
+
+	/*
+	* When every active ray starts at the same origin (e.g. a pinhole camera's), the cone around them:
+	* its unit axis, and the cosine and sine of the widest angle between a ray and the axis.
+	* False for rays from several origins, or spreading over 90 degrees.
+	*/
+	bool cone(float axis[3], float& cosAngle, float& sinAngle) const;
+};
+
+
+/*
+* How well packets used their lanes (for benchmarks: not synchronized between threads)
+*/
+struct PacketStats
+{
+	long long packets = 0;				// packets traced
+	long long nodeVisits = 0;			// acceleration structure nodes visited by a packet
+	long long activeLanes = 0;			// lanes that hit the node, summed over those visits
+	long long singleRays = 0;			// rays finished alone: their packet was incoherent or had diverged
+
+	/*
+	* Fraction of the lanes doing useful work at each node visit (1 = every lane, every time)
+	*/
+	double laneUtilization() const;
+
+	PacketStats& operator+=(const PacketStats& other);
+};
+
+
+/*
+* Lane kernels: test the rays of the lanes in 'mask' against one box, triangle or sphere,
+* and return the lanes that hit it (bit n = lane n). They use AVX when it is enabled, and
+* compute exactly what the single ray versions do.
+*/
+
+/*
+* Lanes whose ray enters the box (lo, hi) before their 'maxT'
+*/
+unsigned boxHits(const RayPacket& packet, const float lo[3], const float hi[3], const float maxT[RayPacket::SIZE], unsigned mask);
+
+/*
+* Lanes whose ray crosses the triangle (same solution as Mesh::intersectTriangle), with the distance and barycentric coords
+*/
+unsigned triangleHits(const RayPacket& packet, const Point corners[3], unsigned mask,
+					  float t[RayPacket::SIZE], float u[RayPacket::SIZE], float v[RayPacket::SIZE]);
+
+/*
+* Lanes whose ray hits the sphere at least 'nearest' along it (same solution as ShapeArrays), with the distance
+*/
+unsigned sphereHits(const RayPacket& packet, float cx, float cy, float cz, float radius2, float nearest, unsigned mask, float t[RayPacket::SIZE]);
+
+#endif
@@ -0,0 +1,127 @@
+#include "RingBuffer.h"
+#include <chrono>
+#include <utility>
+
+RingBuffer::RingBuffer(size_t frameBytes)
+	:
+	frameBytes(frameBytes)
+{
+	if (!GLEW_ARB_buffer_storage) return;					// no persistent mapping -> stays invalid
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;	// coherent: no explicit flushes needed
+
+	glGenBuffers(1, &id);
+	glBindBuffer(GL_ARRAY_BUFFER, id);
+	glBufferStorage(GL_ARRAY_BUFFER, frameBytes * FRAMES, nullptr, flags);
+
+	mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, frameBytes * FRAMES, flags);
+	if (mapped == nullptr)
+	{
+		glDeleteBuffers(1, &id);
+		id = 0;
+	}
+
+	frame = FRAMES - 1;										// first beginFrame() moves to section 0
+}
+
+RingBuffer::~RingBuffer()
+{
+	for (GLsync& fence : fences)
+	{
+		if (fence) glDeleteSync(fence);
+	}
+
+	if (id) glDeleteBuffers(1, &id);						// also unmaps it
+}
+
+RingBuffer::RingBuffer(RingBuffer&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+RingBuffer& RingBuffer::operator=(RingBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		swap(id, other.id);									// other's destructor frees what this held
+		swap(mapped, other.mapped);
+		swap(frameBytes, other.frameBytes);
+		swap(frame, other.frame);
+		swap(used, other.used);
+		swap(fences, other.fences);
+		swap(counters, other.counters);
+	}
+
+	return *this;
+}
+
+bool RingBuffer::valid() const
+{
+	return mapped != nullptr;
+}
+
+void RingBuffer::beginFrame()
+{
+	if (!valid()) return;
+
+	frame = (frame + 1) % FRAMES;
+	used = 0;
+	counters.frames++;
+
+	GLsync& fence = fences[frame];
+	if (!fence) return;										// section never used yet
+
+	//poll first: usually the GPU finished this section two frames ago
+	GLenum status = glClientWaitSync(fence, 0, 0);
+
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		counters.stalls++;
+
+		auto start = chrono::steady_clock::now();
+		while (status == GL_TIMEOUT_EXPIRED)
+		{
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);		// 1 ms at a time, flushing so the fence can signal
+		}
+
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		counters.stallMs += elapsed.count();
+	}
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+RingBuffer::Allocation RingBuffer::allocate(size_t bytes, size_t alignment)
+{
+	size_t start = (used + alignment - 1) / alignment * alignment;
+
+	if (!valid() || start + bytes > frameBytes)
+	{
+		counters.overflows++;
+		return { nullptr, 0 };
+	}
+
+	used = start + bytes;
+	counters.bytesWritten += bytes;
+
+	size_t offset = frame * frameBytes + start;
+	return { mapped + offset, offset };
+}
+
+void RingBuffer::endFrame()
+{
+	if (!valid()) return;
+
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLuint RingBuffer::name() const
+{
+	return id;
+}
+
+const RingStats& RingBuffer::stats() const
+{
+	return counters;
+}
@@ -0,0 +1,97 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <cstddef>
+#include <GL/glew.h>
+using namespace std;
+
+/*
+* Counters of a ring buffer, accumulated since it was created
+*/
+struct RingStats
+{
+	size_t bytesWritten = 0;			// bytes handed out by allocate()
+	int frames = 0;						// frames begun
+	int stalls = 0;						// frames whose section was still in use, so the CPU blocked until the GPU was done with it
+	double stallMs = 0;					// total time spent blocked
+	int overflows = 0;					// allocations that did not fit in the frame's section
+};
+
+
+/*
+* Buffer for data written by the CPU every frame (per-instance data, deformed vertices...).
+* It is split into one section per frame in flight and persistently mapped, so writes go straight
+* into GPU visible memory: no driver copies, and no implicit syncs since a fence guards each section
+* (only waited on when the GPU is 3 frames behind).
+*
+* Needs GL 4.4 / ARB_buffer_storage: check valid() and fall back to regular uploads otherwise.
+*/
+class RingBuffer
+{
+public:
+	static const int FRAMES = 3;		// sections (frames the CPU may run ahead of the GPU)
+
+	/*
+	* Location of an allocation: where to write it, and its offset in the buffer for glBindBufferRange etc.
+	*/
+	struct Allocation
+	{
+		void* data;						// nullptr when the allocation did not fit
+		size_t offset;
+	};
+
+private:
+	GLuint id = 0;
+	char* mapped = nullptr;				// start of the persistent mapping (whole buffer)
+	size_t frameBytes = 0;				// size of one section
+
+	int frame = 0;						// section written this frame
+	size_t used = 0;					// bytes allocated in the current section
+	GLsync fences[FRAMES] = {};			// signalled once the GPU has finished the frame that used each section
+
+	RingStats counters;
+
+public:
+	/*
+	* Creates an unusable ring (valid() is false)
+	*/
+	RingBuffer() = default;
+
+	/*
+	* Creates and maps a buffer of FRAMES sections of 'frameBytes' each (requires an openGL context)
+	*/
+	RingBuffer(size_t frameBytes);
+
+	~RingBuffer();
+
+	//owns the GL buffer and fences, so it is moved but never copied
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+	RingBuffer(RingBuffer&& other) noexcept;
+	RingBuffer& operator=(RingBuffer&& other) noexcept;
+
+	/*
+	* True when the buffer could be created and mapped
+	*/
+	bool valid() const;
+
+	/*
+	* Moves to the next section, waiting for the GPU to finish with it if necessary
+	*/
+	void beginFrame();
+
+	/*
+	* Reserves 'bytes' in the current section, starting at a multiple of 'alignment'
+	*/
+	Allocation allocate(size_t bytes, size_t alignment);
+
+	/*
+	* Marks the end of the commands that use the current section (call after the frame's draws)
+	*/
+	void endFrame();
+
+	GLuint name() const;
+	const RingStats& stats() const;
+};
+
+#endif
@@ -0,0 +1,697 @@
+#include "Scene.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+Scene::~Scene()
+{
+	clear();
+}
+
+void Scene::clear()
+{
+	for (Shape* shape : shapes) delete shape;
+
+	shapes.clear();
+	shapeNodes.clear();
+	meshes.clear();
+	instances.clear();
+	meshEffects.clear();
+	for (DrawItem& item : drawList)
+	{
+		if (item.query) glDeleteQueries(1, &item.query);
+		if (item.fragmentQuery) glDeleteQueries(1, &item.fragmentQuery);
+	}
+	drawList.clear();
+	transforms.clear();
+	rayShapes.clear();
+	stats = FrameStats();
+
+	if (boxBuffer) glDeleteBuffers(1, &boxBuffer);
+	if (boxLayout) glDeleteVertexArrays(1, &boxLayout);
+	boxBuffer = 0;
+	boxLayout = 0;
+}
+
+void Scene::load(const string& filename)
+{
+	clear();
+
+	ifstream ifs(filename);
+
+	string token;
+	vector<int> groups = { -1 };						// stack of open groups (-1 -> shapes are roots)
+	int effect = -1;									// effect for the following shapes
+
+	while (ifs >> token)
+	{
+		if (token[0] == '#')
+		{
+			getline(ifs, token);						// comment, skip rest of line
+		}
+		else if (token == "group")
+		{
+			Vector trans, scale, rot;
+			ifs >> token >> trans >> token >> scale >> token >> rot;
+
+			int node = transforms.add(groups.back(), { trans.x(), trans.y(), trans.z() },
+													  { scale.x(), scale.y(), scale.z() },
+													  { rot.x(), rot.y(), rot.z() });
+			groups.push_back(node);
+		}
+		else if (token == "end_group")
+		{
+			if (groups.size() > 1) groups.pop_back();
+		}
+		else if (token == "effect")
+		{
+			ifs >> effect;
+		}
+		else if (token == "instance")
+		{
+			int mesh;
+			float scale;
+			Vector trans, rot;
+			ifs >> mesh >> token >> trans >> token >> scale >> token >> rot;
+
+			if (mesh < 0 || mesh >= (int)meshes.size()) continue;		// no such mesh read yet: ignored
+
+			int node = transforms.add(groups.back(), { trans.x(), trans.y(), trans.z() }, { scale, scale, scale }, { rot.x(), rot.y(), rot.z() });
+			instances.push_back({ mesh, node, effect });
+		}
+		else if (token == "mesh" || token == "sphere")
+		{
+			Shape* shape;
+
+			if (token == "mesh")
+			{
+				Mesh* mesh = new Mesh();
+				ifs >> *mesh;
+				mesh->setResidency(Residency::RayQueries);		// scene shapes stay available to ray queries
+
+				meshes.push_back(mesh);
+				meshEffects.push_back(effect);
+				shape = mesh;
+			}
+			else
+			{
+				Sphere* sphere = new Sphere();
+				ifs >> *sphere;
+				shape = sphere;
+			}
+
+			//each shape is a leaf node under the innermost open group
+			int node = transforms.add(groups.back(), shape->translation(), shape->scaling(), shape->rotation());
+
+			shapes.push_back(shape);
+			shapeNodes.push_back(node);
+		}
+	}
+
+	rebuild();
+}
+
+void Scene::rebuild()
+{
+	transforms.update();
+
+	//ray queries see each instance as one more shape (pointing to its mesh)
+	vector<Shape*> placements = shapes;
+	for (const MeshInstance& instance : instances) placements.push_back(meshes[instance.mesh]);
+
+	rayShapes.build(placements, placementMatrices());
+}
+
+vector<Mat4> Scene::placementMatrices() const
+{
+	vector<Mat4> world;
+	for (int node : shapeNodes) world.push_back(transforms.world[node]);
+	for (const MeshInstance& instance : instances) world.push_back(transforms.world[instance.node]);
+
+	return world;
+}
+
+// meshes with at least this many triangles get an occlusion query (cheaper meshes are always drawn)
+const int OCCLUSION_MIN_TRIANGLES = 2000;
+
+// uniform buffer binding point of the shader's Instance block
+const GLuint INSTANCE_BINDING = 0;
+
+// effect that discards fragments: the back of a mesh can show through it, so meshlets facing away are kept
+const int DISCARD_EFFECT = 2;
+
+/*
+* Rotation and scaling applied by vertexShader.glsl (must match it), which maps world space to clip space
+*/
+static Mat4 viewMatrix(float angle)
+{
+	Mat4 rotY{ cos(angle), 0, sin(angle), 0,
+			   0, 1, 0, 0,
+			   -sin(angle), 0, cos(angle), 0,
+			   0, 0, 0, 1 };
+
+	return multiply(rotY, compose({ 0, 0, 0 }, { 2, 2, 2 }, { 0, 0, 0 }));
+}
+
+void Scene::setupBuffers()
+{
+	GLint program;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+	drawList.clear();
+	boxProgram = program;
+
+	// the program each draw will actually use (see prepare()): draws that always discard get the discard program
+	auto makeItem = [&](Mesh* mesh, int effect, int node, int meshIndex) {
+		GLuint used = (effect == DISCARD_EFFECT && discardProgram) ? discardProgram : (GLuint)program;
+		DrawItem item{ 0, used, mesh, effect, node, meshIndex };
+
+		// program in the top bits, then mesh, then state: sorting groups draws that share the expensive changes
+		item.key = ((uint64_t)item.program << 48) | ((uint64_t)meshIndex << 16) | (uint16_t)(item.effect + 1);
+
+		if (mesh->triangleCount() >= OCCLUSION_MIN_TRIANGLES) glGenQueries(1, &item.query);
+		if (measureOverdraw) glGenQueries(1, &item.fragmentQuery);
+
+		return item;
+	};
+
+	for (int i = 0; i < (int)shapes.size(); i++)
+	{
+		auto it = find(meshes.begin(), meshes.end(), shapes[i]);
+		if (it == meshes.end()) continue;							// not a mesh, nothing to draw
+
+		int meshIndex = it - meshes.begin();
+		Mesh* mesh = *it;
+		mesh->setupBuffers();
+
+		drawList.push_back(makeItem(mesh, meshEffects[meshIndex], shapeNodes[i], meshIndex));
+	}
+
+	//instances draw their mesh's buffers (sorted right next to its other draws)
+	for (const MeshInstance& instance : instances) drawList.push_back(makeItem(meshes[instance.mesh], instance.effect, instance.node, instance.mesh));
+
+	sort(drawList.begin(), drawList.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+
+	//room for one model and normal matrix per draw and per occlusion box each frame, each at the uniform buffer alignment
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	uniformAlignment = max(uniformAlignment, 16);
+	ring = RingBuffer(2 * max((size_t)drawList.size(), (size_t)1) * max((size_t)uniformAlignment, 2 * sizeof(Mat4)));
+
+
+	//unit cube [-1, 1] (12 triangles) for occlusion tests, only positions are needed
+	const float c[8][3] = { {-1,-1,-1}, {1,-1,-1}, {1,1,-1}, {-1,1,-1}, {-1,-1,1}, {1,-1,1}, {1,1,1}, {-1,1,1} };
+	const int faces[36] = { 0,1,2, 0,2,3, 4,6,5, 4,7,6, 0,4,5, 0,5,1, 3,2,6, 3,6,7, 0,3,7, 0,7,4, 1,5,6, 1,6,2 };
+
+	vector<float> box;
+	for (int i : faces) box.insert(box.end(), { c[i][0], c[i][1], c[i][2] });
+
+	glGenBuffers(1, &boxBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+	glBufferData(GL_ARRAY_BUFFER, box.size() * sizeof(float), box.data(), GL_STATIC_DRAW);
+
+	glGenVertexArrays(1, &boxLayout);
+	glBindVertexArray(boxLayout);
+
+	GLuint posAttr = glGetAttribLocation(program, "vertexCoords");
+	glVertexAttribPointer(posAttr, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (GLvoid*)0);
+	glEnableVertexAttribArray(posAttr);
+}
+
+void Scene::draw(int currFunc, float angle, GLuint program)
+{
+	beginFrame(program);
+
+	Mat4 viewProj = viewMatrix(angle);
+	Frustum frustum(viewProj);
+
+	submitPass(currFunc, viewProj, frustum, DrawFilter::All);
+
+	endFrame(currFunc);
+}
+
+void Scene::drawPrepassed(int currFunc, float angle, GLuint depthProgram)
+{
+	beginFrame(depthProgram);
+
+	Mat4 viewProj = viewMatrix(angle);
+	Frustum frustum(viewProj);
+
+	//1: depth only, for every draw that does not discard (heavy meshes' occlusion queries are issued here too)
+	prepassCounter.begin();
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	submitPass(currFunc, viewProj, frustum, DrawFilter::Opaque);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	prepassCounter.end();
+
+	//2: the effects, run only for the fragment left nearest in each pixel
+	programOverride = 0;
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+
+	effectCounter.begin();
+	for (int i : drawn)
+	{
+		const DrawItem& item = drawList[i];
+		const Mat4& model = transforms.world[item.node];
+		int effect = item.effect < 0 ? currFunc : item.effect;
+
+		prepare(item, currFunc, model);
+		submitVisible(item, effect, model, viewProj, frustum);
+	}
+	effectCounter.end();
+
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+
+	//3: discarding draws cannot be in the prepass (their holes would be filled), they are drawn as usual
+	submitPass(currFunc, viewProj, frustum, DrawFilter::Discarding);
+
+	stats.prepassInvocations = prepassCounter.result();
+	stats.effectInvocations = effectCounter.result();
+
+	endFrame(currFunc);
+}
+
+void Scene::beginFrame(GLuint program)
+{
+	stats = FrameStats();
+	programOverride = program;
+	if (measureOverdraw) stats.fragments.assign(drawList.size(), -1);
+
+	currProgram = 0;
+	currMesh = nullptr;
+	currEffect = -1;
+	modelVar = -1;
+	choiceVar = -1;
+	ringModelVar = -1;
+	objectVar = -1;
+	ringModel = -1;
+
+	stallsBefore = ring.stats().stalls;
+	bytesBefore = ring.stats().bytesWritten;
+	ring.beginFrame();
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	halfHeight = viewport[3] / 2.0f;
+}
+
+void Scene::submitPass(int currFunc, const Mat4& viewProj, const Frustum& frustum, DrawFilter filter)
+{
+	drawn.clear();
+
+	//light meshes first (sorted order), so they are in the depth buffer when heavy meshes are tested against them
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (DrawItem& item : drawList)
+		{
+			bool heavy = item.query != 0;
+			if (heavy != (pass == 1)) continue;
+
+			int effect = item.effect < 0 ? currFunc : item.effect;
+			if (filter != DrawFilter::All && (effect == DISCARD_EFFECT) != (filter == DrawFilter::Discarding)) continue;
+
+			const Mat4& model = transforms.world[item.node];
+			const Sphere& bound = item.mesh->boundingSphere();
+
+			//whole mesh outside of the view volume -> skip it
+			if (!frustum.intersects(transformPoint(model, bound.getCenter()), bound.getRadius() * maxScale(model)))
+			{
+				stats.culledInstances++;
+				continue;
+			}
+
+			if (!heavy)
+			{
+				if (measureOverdraw)
+				{
+					glBeginQuery(GL_SAMPLES_PASSED, item.fragmentQuery);
+					stats.fragments[&item - drawList.data()] = 0;					// issued this frame, read back below
+				}
+
+				prepare(item, currFunc, model);
+				submitVisible(item, effect, model, viewProj, frustum);
+				drawn.push_back(&item - drawList.data());
+
+				if (measureOverdraw) glEndQuery(GL_SAMPLES_PASSED);
+				continue;
+			}
+
+			//read back last frame's query if ready (never wait for it)
+			if (item.queryPending)
+			{
+				GLuint available = 0;
+				glGetQueryObjectuiv(item.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+				if (available)
+				{
+					GLuint anySamples = 0;
+					glGetQueryObjectuiv(item.query, GL_QUERY_RESULT, &anySamples);
+					item.occluded = !anySamples;
+					item.queryPending = false;
+				}
+			}
+
+			//hidden and still waiting for a result -> nothing to draw or test this frame
+			if (item.occluded && item.queryPending)
+			{
+				stats.occludedInstances++;
+				continue;
+			}
+
+			bool issueQuery = !item.queryPending;
+			bool countFragments = measureOverdraw && !issueQuery;		// only one occlusion query can be active at a time
+			if (issueQuery) glBeginQuery(GL_ANY_SAMPLES_PASSED, item.query);
+			if (countFragments)
+			{
+				glBeginQuery(GL_SAMPLES_PASSED, item.fragmentQuery);
+				stats.fragments[&item - drawList.data()] = 0;
+			}
+
+			if (item.occluded)
+			{
+				submitBox(item, model);										// only the box, to see if the mesh has become visible
+				stats.occludedInstances++;
+			}
+			else
+			{
+				prepare(item, currFunc, model);
+				submitVisible(item, effect, model, viewProj, frustum);		// mesh itself tells if it is still visible
+				drawn.push_back(&item - drawList.data());
+			}
+
+			if (issueQuery)
+			{
+				glEndQuery(GL_ANY_SAMPLES_PASSED);
+				item.queryPending = true;
+			}
+			if (countFragments) glEndQuery(GL_SAMPLES_PASSED);
+		}
+	}
+
+}
+
+void Scene::endFrame(int currFunc)
+{
+	//fragment counts are needed right away (statistics only, so waiting for the GPU is fine)
+	if (measureOverdraw)
+	{
+		for (int i = 0; i < (int)drawList.size(); i++)
+		{
+			if (stats.fragments[i] < 0) continue;					// culled, occluded or not measurable this frame
+
+			GLuint fragments = 0;
+			glGetQueryObjectuiv(drawList[i].fragmentQuery, GL_QUERY_RESULT, &fragments);
+			stats.fragments[i] = fragments;
+		}
+	}
+
+	ring.endFrame();
+	stats.ringStalls = ring.stats().stalls - stallsBefore;
+	stats.ringBytes = ring.stats().bytesWritten - bytesBefore;
+
+	// leave the shared uniforms as display() set them for anything drawn afterwards
+	if (currProgram != 0)
+	{
+		Mat4 identity = identityMatrix();
+		glUniformMatrix4fv(modelVar, 1, GL_FALSE, identity.data());
+		glUniformMatrix4fv(normalModelVar, 1, GL_FALSE, identity.data());
+		glUniform1i(ringModelVar, 0);
+		glUniform1i(objectVar, 1);
+		glUniform1i(choiceVar, currFunc);
+	}
+}
+
+void Scene::useProgram(GLuint program)
+{
+	if (program == currProgram) return;
+
+	glUseProgram(program);
+	currProgram = program;
+	stats.programChanges++;
+
+	// uniform locations belong to the program, look them up again
+	modelVar = glGetUniformLocation(currProgram, "model");
+	normalModelVar = glGetUniformLocation(currProgram, "normalModel");
+	choiceVar = glGetUniformLocation(currProgram, "currFunc");
+	ringModelVar = glGetUniformLocation(currProgram, "ringModel");
+	objectVar = glGetUniformLocation(currProgram, "objectId");
+	currEffect = -1;
+	ringModel = -1;
+
+	GLuint block = glGetUniformBlockIndex(currProgram, "Instance");
+	if (block != GL_INVALID_INDEX) glUniformBlockBinding(currProgram, block, INSTANCE_BINDING);
+}
+
+void Scene::setModel(const Mat4& model)
+{
+	Mat4 normal = normalMatrix(model);
+	RingBuffer::Allocation slot = ring.allocate(2 * sizeof(Mat4), uniformAlignment);
+
+	if (slot.data)
+	{
+		memcpy(slot.data, model.data(), sizeof(Mat4));			// straight into the mapped buffer, the GPU reads it from there
+		memcpy((char*)slot.data + sizeof(Mat4), normal.data(), sizeof(Mat4));
+		glBindBufferRange(GL_UNIFORM_BUFFER, INSTANCE_BINDING, ring.name(), slot.offset, 2 * sizeof(Mat4));
+	}
+	else
+	{
+		glUniformMatrix4fv(modelVar, 1, GL_FALSE, model.data());
+		glUniformMatrix4fv(normalModelVar, 1, GL_FALSE, normal.data());
+	}
+
+	int useRing = slot.data != nullptr;
+	if (useRing != ringModel)
+	{
+		glUniform1i(ringModelVar, useRing);
+		ringModel = useRing;
+	}
+}
+
+void Scene::prepare(const DrawItem& item, int currFunc, const Mat4& model)
+{
+	int effect = item.effect < 0 ? currFunc : item.effect;
+
+	if (programOverride) useProgram(programOverride);
+	else if (effect == DISCARD_EFFECT && discardProgram) useProgram(discardProgram);		// only program that can discard (draws following currFunc)
+	else useProgram(item.program);
+
+	glUniform1i(objectVar, (int)(&item - drawList.data()) + 1);
+
+	if (item.mesh != currMesh)
+	{
+		item.mesh->bind();
+		currMesh = item.mesh;
+		stats.meshChanges++;
+	}
+
+	if (effect != currEffect)
+	{
+		glUniform1i(choiceVar, effect);
+		currEffect = effect;
+		stats.stateChanges++;
+	}
+
+	setModel(model);
+}
+
+void Scene::submitVisible(const DrawItem& item, int effect, const Mat4& model, const Mat4& viewProj, const Frustum& frustum)
+{
+	const vector<Meshlet>& meshlets = item.mesh->getMeshlets();
+
+	if (meshlets.empty())							// no meshlets (e.g. streamed mesh), draw it whole
+	{
+		item.mesh->submit();
+		stats.trianglesFull += item.mesh->triangleCount();
+		stats.trianglesDrawn += item.mesh->triangleCount();
+		stats.drawCalls++;
+		return;
+	}
+
+	Mat4 toClip = multiply(viewProj, model);
+	float radiusScale = maxScale(model);
+
+	stats.trianglesFull += item.mesh->triangleCount();
+
+	//small on screen -> a simplified level is drawn whole
+	int level = item.mesh->selectLod(halfHeight * maxScale(toClip));
+	if (level > 0)
+	{
+		item.mesh->submitLod(level);
+		stats.trianglesDrawn += item.mesh->lodTriangles(level);
+		stats.drawCalls++;
+		return;
+	}
+
+	// back facing meshlets are only hidden for closed meshes, and when the effect does not cut holes in the front
+	bool coneCulling = item.mesh->isClosed() && effect != DISCARD_EFFECT;
+
+	firsts.clear();
+	counts.clear();
+
+	for (const Meshlet& m : meshlets)
+	{
+		stats.totalMeshlets++;
+
+		if (!frustum.intersects(transformPoint(model, m.center), m.radius * radiusScale))
+		{
+			stats.culledMeshlets++;
+			continue;
+		}
+
+		// camera looks down +z in clip space, so a cone whose axis points (enough) along +z faces away
+		if (coneCulling && m.coneCutoff <= 1)
+		{
+			Vector axis = transformVector(toClip, m.coneAxis);
+			if (axis.length() > 0 && axis.z() / axis.length() > m.coneCutoff)
+			{
+				stats.culledMeshlets++;
+				continue;
+			}
+		}
+
+		//merge with the previous range when consecutive in the vertex buffer
+		if (!firsts.empty() && firsts.back() + counts.back() == m.first) counts.back() += m.count;
+		else
+		{
+			firsts.push_back(m.first);
+			counts.push_back(m.count);
+		}
+	}
+
+	if (firsts.empty()) return;
+
+	for (GLsizei count : counts) stats.trianglesDrawn += count / 3;
+
+	if (firsts.size() == 1 && counts[0] == item.mesh->triangleCount() * 3) item.mesh->submit();
+	else item.mesh->submitRanges(firsts, counts);
+
+	stats.drawCalls++;
+}
+
+void Scene::submitBox(const DrawItem& item, const Mat4& model)
+{
+	Point lo = item.mesh->minCorner();
+	Point hi = item.mesh->maxCorner();
+
+	// unit cube scaled/moved onto the mesh's bounding box
+	Mat4 boxModel = multiply(model, compose({ (lo.x() + hi.x()) / 2, (lo.y() + hi.y()) / 2, (lo.z() + hi.z()) / 2 },
+											{ (hi.x() - lo.x()) / 2, (hi.y() - lo.y()) / 2, (hi.z() - lo.z()) / 2 },
+											{ 0, 0, 0 }));
+
+	useProgram(programOverride ? programOverride : boxProgram);		// (the discard program could drop the box's fragments)
+	setModel(boxModel);
+
+	glBindVertexArray(boxLayout);
+	currMesh = nullptr;
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);		// test against the depth buffer without changing anything
+	glDepthMask(GL_FALSE);
+
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+}
+
+void Scene::setDiscardProgram(GLuint program)
+{
+	discardProgram = program;
+}
+
+void Scene::setMeasureOverdraw(bool measure)
+{
+	measureOverdraw = measure;
+
+	for (DrawItem& item : drawList)
+	{
+		if (measure && !item.fragmentQuery) glGenQueries(1, &item.fragmentQuery);
+	}
+}
+
+int Scene::drawCount() const
+{
+	return (int)drawList.size();
+}
+
+int Scene::drawnMesh(int draw) const
+{
+	return drawList[draw].meshIndex;
+}
+
+int Scene::placementCount() const
+{
+	return (int)(shapes.size() + instances.size());
+}
+
+int Scene::instanceCount() const
+{
+	return (int)instances.size();
+}
+
+void Scene::place(int placement, const array<float, 3>& trans, const array<float, 3>& scale, const array<float, 3>& rot)
+{
+	int node = placement < (int)shapes.size() ? shapeNodes[placement] : instances[placement - shapes.size()].node;
+
+	transforms.tx[node] = trans[0], transforms.ty[node] = trans[1], transforms.tz[node] = trans[2];
+	transforms.sx[node] = scale[0], transforms.sy[node] = scale[1], transforms.sz[node] = scale[2];
+	transforms.rx[node] = rot[0], transforms.ry[node] = rot[1], transforms.rz[node] = rot[2];
+}
+
+void Scene::refit()
+{
+	transforms.update();
+	rayShapes.refit(placementMatrices());
+}
+
+optional<Hit> Scene::intersect(const Ray& ray) const
+{
+	return rayShapes.intersect(ray);
+}
+
+void Scene::intersect(const RayPacket& packet, optional<Hit> hits[RayPacket::SIZE]) const
+{
+	rayShapes.intersect(packet, hits);
+}
+
+optional<Hit> Scene::intersectVirtual(const Ray& ray) const
+{
+	return rayShapes.intersectVirtual(ray);
+}
+
+const ShapeArrays& Scene::rayArrays() const
+{
+	return rayShapes;
+}
+
+bool Scene::empty() const
+{
+	return shapes.empty();
+}
+
+const FrameStats& Scene::frameStats() const
+{
+	return stats;
+}
+
+ostream& operator<<(ostream& os, const FrameStats& stats)
+{
+	os << "Frame: " << stats.drawCalls << " draw calls, "
+	   << stats.programChanges << " program changes, "
+	   << stats.meshChanges << " mesh changes, "
+	   << stats.stateChanges << " state changes, "
+	   << stats.culledInstances << " meshes culled, "
+	   << stats.occludedInstances << " meshes occluded, "
+	   << stats.culledMeshlets << "/" << stats.totalMeshlets << " meshlets culled, "
+	   << stats.trianglesDrawn << "/" << stats.trianglesFull << " triangles drawn, "
+	   << stats.ringBytes << " bytes through the ring buffer (" << stats.ringStalls << " stalls)";
+
+	if (stats.prepassInvocations >= 0)
+	{
+		os << ", depth prepass: " << stats.prepassInvocations << " fragments, " << stats.effectInvocations << " shaded by effects ("
+		   << stats.prepassInvocations - stats.effectInvocations << " effect invocations avoided)";
+	}
+
+	return os;
+}
@@ -0,0 +1,317 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Shape.h"
+#include "Mesh.h"
+#include "Sphere.h"
+#include "Transform.h"
+#include "Frustum.h"
+#include "RingBuffer.h"
+#include "ShapeArrays.h"
+using namespace std;
+
+
+/*
+* Counters gathered while submitting one frame of draws
+*/
+struct FrameStats
+{
+	int drawCalls = 0;					// glDrawArrays calls
+	int programChanges = 0;				// glUseProgram calls
+	int meshChanges = 0;				// layout buffer binds
+	int stateChanges = 0;				// per-draw state (effect choice) updates
+
+	int culledInstances = 0;			// meshes outside of the view volume
+	int occludedInstances = 0;			// heavy meshes hidden behind others (occlusion query of an earlier frame)
+	int culledMeshlets = 0;				// meshlets outside of the view volume or facing away
+	int totalMeshlets = 0;				// meshlets of the meshes that were not culled as a whole
+
+	int trianglesDrawn = 0;				// triangles submitted (after culling and level of detail)
+	int trianglesFull = 0;				// triangles the meshes have at full resolution
+
+	size_t ringBytes = 0;				// per-draw data written to the ring buffer
+	int ringStalls = 0;					// times the CPU waited for the GPU to release a ring buffer section
+
+	vector<int> fragments;				// fragments each draw wrote (-1 = not measured), filled while measuring overdraw
+
+	long long prepassInvocations = -1;	// fragment shader runs of the depth prepass (what the effects would have cost), -1 = not counted
+	long long effectInvocations = -1;	// fragment shader runs of the effects after the prepass
+
+	//display stats in format: 'Frame: 3 draw calls, 1 program changes, 2 mesh changes, 1 state changes, ...'
+	friend ostream& operator<<(ostream& os, const FrameStats& stats);
+};
+
+
+/*
+* One mesh draw, sorted by key so that program changes are rarest, then mesh binds, then state changes
+*/
+struct DrawItem
+{
+	uint64_t key;						// program | mesh | state, packed from most to least significant
+	GLuint program;						// shader program used for the draw
+	const Mesh* mesh;					// geometry to draw
+	int effect;							// effect used for the draw (-1 = use the globally chosen effect)
+	int node;							// index of the draw's node in the transform hierarchy
+
+	int meshIndex;						// index of the mesh in file order
+	GLuint query = 0;					// occlusion query (only for heavy meshes, 0 otherwise)
+	GLuint fragmentQuery = 0;			// counts the fragments of the draw while measuring overdraw
+	bool queryPending = false;			// query issued but its result not read back yet
+	bool occluded = false;				// result of the most recent query
+};
+
+
+/*
+* Another placement of a mesh read earlier from the scene file: it shares the mesh's geometry, ray
+* query hierarchy, appearance and GL buffers, and only adds a transform node (and a draw)
+*/
+struct MeshInstance
+{
+	int mesh;							// mesh placed (file order)
+	int node;							// index of the instance's node in the transform hierarchy
+	int effect;							// effect used for its draw (-1 = use the globally chosen effect)
+};
+
+
+/*
+* Which draws a pass submits: all of them, only those whose effect never discards, or only those that do
+*/
+enum class DrawFilter
+{
+	All,
+	Opaque,
+	Discarding
+};
+
+
+/*
+* Collection of shapes read from a scene file, along with a flat transform hierarchy
+* and a pre-sorted list of draws for openGL.
+*
+* Scene file format (one entry per keyword, '#' starts a comment line):
+*	group translate <x, y, z> scale <x, y, z> rotate <x, y, z>		(children until 'end_group' inherit the transform)
+*	end_group
+*	effect n														(effect used by the following shapes, -1 = global choice)
+*	mesh source <file> smooth|flat direct|spherical|none scale <s> translate <x, y, z> <appearance> end
+*	sphere center <x, y, z> radius <r> <appearance> end
+*	instance <n> translate <x, y, z> scale <s> rotate <x, y, z>		(the n-th mesh above, from 0, placed once more)
+*
+* Note: only meshes are drawn by openGL, spheres are kept for ray queries (see intersect()).
+* Placements are numbered shapes first (file order), then instances (file order); see place().
+*/
+class Scene
+{
+private:
+	vector<Shape*> shapes;				// every shape read from the scene file (owned by the scene)
+	vector<int> shapeNodes;				// transform node of each shape
+	vector<Mesh*> meshes;				// the meshes among 'shapes', in file order
+	vector<MeshInstance> instances;		// extra placements of those meshes (the meshes are loaded once)
+
+	TransformHierarchy transforms;		// local/world transforms of groups and shapes
+	ShapeArrays rayShapes;				// the shapes sorted by type for ray queries (rebuilt by load())
+	vector<DrawItem> drawList;			// draws, sorted once after the buffers are set up
+	vector<int> meshEffects;			// effect chosen in the file for each mesh
+
+	FrameStats stats;					// counters from the most recent draw()
+	bool measureOverdraw = false;		// count the fragments of every draw (waits for the GPU at the end of the frame)
+	GLuint programOverride = 0;			// program used instead of each draw's own (e.g. a G-buffer pass)
+	GLuint discardProgram = 0;			// program for draws whose effect discards (the draws' own programs cannot)
+	GLuint boxProgram = 0;				// program the draw list was built with (never discards), for occlusion boxes
+
+	vector<int> drawn;					// draws the most recent pass submitted (not culled or occluded)
+	InvocationCounter prepassCounter;	// fragment shader runs of the depth prepass / of the effects after it
+	InvocationCounter effectCounter;
+	int stallsBefore;					// ring buffer counters at the start of the frame
+	size_t bytesBefore;
+
+	GLuint boxBuffer = 0;				// unit cube drawn in place of occluded meshes to find out when they reappear
+	GLuint boxLayout = 0;
+
+	RingBuffer ring;					// per-draw model and normal matrices, written each frame (read by the shader's Instance block)
+	GLint uniformAlignment = 256;		// required alignment of uniform buffer ranges
+
+	//state of the draw submission in progress, so draws only change what differs from the previous draw
+	GLuint currProgram;
+	const Mesh* currMesh;
+	int currEffect;
+	GLint modelVar;
+	GLint normalModelVar;
+	GLint choiceVar;
+	GLint ringModelVar;
+	GLint objectVar;
+	int ringModel;						// current value of the shader's 'ringModel' (-1 = unknown)
+	float halfHeight;					// half the viewport height in pixels (clip space units -> pixels)
+
+	vector<GLint> firsts;				// ranges of the visible meshlets of a draw (reused between draws)
+	vector<GLsizei> counts;
+
+	/*
+	* Resets the frame's counters and submission state; 'program' (if nonzero) replaces every draw's program
+	*/
+	void beginFrame(GLuint program);
+
+	/*
+	* Culls and submits the draws the filter selects (light meshes, then heavy ones with their occlusion queries)
+	*/
+	void submitPass(int currFunc, const Mat4& viewProj, const Frustum& frustum, DrawFilter filter);
+
+	/*
+	* Collects the frame's counters and restores the shared uniforms
+	*/
+	void endFrame(int currFunc);
+
+	/*
+	* World matrices of every placement: the shapes, then the instances
+	*/
+	vector<Mat4> placementMatrices() const;
+
+	/*
+	* Makes the program current and looks up its uniforms (if it is not current already)
+	*/
+	void useProgram(GLuint program);
+
+	/*
+	* Sets the model matrix (and its normal matrix) of the next draw: through the ring buffer when there is one
+	* (and it has room), otherwise as a plain uniform
+	*/
+	void setModel(const Mat4& model);
+
+	/*
+	* Makes the program/mesh/effect of the item current and sets its model matrix
+	*/
+	void prepare(const DrawItem& item, int currFunc, const Mat4& model);
+
+	/*
+	* Draws the level of detail of the item that suits its size on screen; at full
+	* resolution only the meshlets inside the view volume and not facing away are drawn
+	*/
+	void submitVisible(const DrawItem& item, int effect, const Mat4& model, const Mat4& viewProj, const Frustum& frustum);
+
+	/*
+	* Draws the item's bounding box (no color/depth writes) to test if it is still hidden
+	*/
+	void submitBox(const DrawItem& item, const Mat4& model);
+
+public:
+	/*
+	* Creates an empty scene
+	*/
+	Scene() = default;
+
+	/*
+	* Frees every shape of the scene
+	*/
+	~Scene();
+
+	//scenes own their shapes, so they are not copied
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	/*
+	* Reads shapes and groups from a scene file (replacing the current contents)
+	*/
+	void load(const string& filename);
+
+	/*
+	* Uploads every mesh's geometry and builds the sorted draw list (requires the program to be active)
+	*/
+	void setupBuffers();
+
+	/*
+	* Submits the sorted draw list, only changing program/mesh/state when the next draw needs it.
+	* Meshes (and meshlets) outside of the view for the given rotation 'angle' are skipped, and heavy
+	* meshes are drawn last, skipping those an occlusion query found hidden in an earlier frame.
+	* 'currFunc' is the effect used by draws that do not choose their own. A nonzero 'program'
+	* replaces the program of every draw (it must use vertexShader.glsl).
+	*/
+	void draw(int currFunc, float angle, GLuint program = 0);
+
+	/*
+	* Same as draw(), but first fills the depth buffer with 'depthProgram', then runs the effects with
+	* GL_EQUAL depth testing, so each pixel's effect runs once. Draws with a discarding effect are drawn
+	* last, the usual way (with the discard program).
+	*/
+	void drawPrepassed(int currFunc, float angle, GLuint depthProgram);
+
+	/*
+	* Program used for draws whose effect discards fragments (0 = the draws' own program).
+	* Set it before setupBuffers(), which sorts the draws by the program they use.
+	*/
+	void setDiscardProgram(GLuint program);
+
+	/*
+	* Turns counting the fragments each draw writes on or off (see FrameStats::fragments).
+	* Draws are numbered in draw list order, starting at 1 (the shaders' 'objectId').
+	*/
+	void setMeasureOverdraw(bool measure);
+
+	/*
+	* Number of draws in the draw list, and the mesh (file order) drawn by one of them
+	*/
+	int drawCount() const;
+	int drawnMesh(int draw) const;
+
+	/*
+	* Number of placements (shapes and instances), and the mesh instances among them
+	*/
+	int placementCount() const;
+	int instanceCount() const;
+
+	/*
+	* Gives a placement (see the file format) new local transform components, e.g. for per-frame motion.
+	* Draws and ray queries follow once refit() is called.
+	*/
+	void place(int placement, const array<float, 3>& trans, const array<float, 3>& scale, const array<float, 3>& rot);
+
+	/*
+	* Resolves the world matrices of the moved placements and refits the ray query structures to them
+	* (their hierarchies are kept: for rigid motion, not for a new scene)
+	*/
+	void refit();
+
+	/*
+	* Same as refit(), building the ray query structures anew (after motion that scattered the placements)
+	*/
+	void rebuild();
+
+	/*
+	* Closest hit of a world space ray among every shape (spheres included), intersected one type at a time
+	*/
+	optional<Hit> intersect(const Ray& ray) const;
+
+	/*
+	* Closest hit of each ray of a packet (same results as one ray at a time, with shared work)
+	*/
+	void intersect(const RayPacket& packet, optional<Hit> hits[RayPacket::SIZE]) const;
+
+	/*
+	* Same query through each shape's virtual intersect() (for comparison, see benchScene())
+	*/
+	optional<Hit> intersectVirtual(const Ray& ray) const;
+
+	/*
+	* Shapes as sorted for ray queries
+	*/
+	const ShapeArrays& rayArrays() const;
+
+	/*
+	* True when no scene file has been loaded
+	*/
+	bool empty() const;
+
+	/*
+	* Deletes every shape and transform
+	*/
+	void clear();
+
+	/*
+	* Counters from the most recent frame
+	*/
+	const FrameStats& frameStats() const;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "Shape.h"
+#include <utility>
 
 Shape::~Shape()
 {
@@ -7,6 +8,44 @@ Shape::~Shape()
 	delete bumpMap;
 }
 
+Shape::Shape(Shape&& other) noexcept
+	:
+	color(other.color),
+	texture(exchange(other.texture, nullptr)),
+	mat(other.mat),
+	mask(exchange(other.mask, nullptr)),
+	maskBits(std::move(other.maskBits)),
+	maskCoverage(other.maskCoverage),
+	bumpMap(exchange(other.bumpMap, nullptr)),
+	transComp(other.transComp),
+	scaleComp(other.scaleComp),
+	rotateComp(other.rotateComp)
+{
+}
+
+Shape& Shape::operator=(Shape&& other) noexcept
+{
+	if (this != &other)
+	{
+		delete texture;
+		delete mask;
+		delete bumpMap;
+
+		color = other.color;
+		texture = exchange(other.texture, nullptr);
+		mat = other.mat;
+		mask = exchange(other.mask, nullptr);
+		maskBits = std::move(other.maskBits);			// (std::move: Shape::move translates the shape)
+		maskCoverage = other.maskCoverage;
+		bumpMap = exchange(other.bumpMap, nullptr);
+		transComp = other.transComp;
+		scaleComp = other.scaleComp;
+		rotateComp = other.rotateComp;
+	}
+
+	return *this;
+}
+
 void Shape::readApperance(istream& is)
 {
 	string token;
@@ -34,12 +73,14 @@ void Shape::readApperance(istream& is)
 		else if (token == "bump_map")
 		{
 			is >> token;
-			this->bumpMap = new Image(token);		// shape's bump map texture
+			this->bumpMap = new Image(token, true);	// shape's bump map texture (gray values only)
 		}
 		else if (token == "mask")
 		{
 			is >> token;
-			this->mask = new Image(token);			// shape's mask texture
+			this->mask = new Image(token, true);		// shape's mask texture (gray values only)
+			this->maskBits = MaskBitmap(*mask);		// reduced to bits once, so hits only test a bit
+			this->maskCoverage = maskBits.coverage(0, 0, 1, 1);
 		}
 	}
 }
@@ -92,6 +133,26 @@ void Shape::rotate(float rx, float ry, float rz)
 	rotateComp[2] += rz;
 }
 
+const array<float, 3>& Shape::translation() const
+{
+	return transComp;
+}
+
+const array<float, 3>& Shape::scaling() const
+{
+	return scaleComp;
+}
+
+const array<float, 3>& Shape::rotation() const
+{
+	return rotateComp;
+}
+
+bool Shape::masked() const
+{
+	return mask != nullptr && maskCoverage != MaskCoverage::Full;
+}
+
 void Shape::updateMaterial(float dka, float dkd, float dks, int dn)
 {
 	mat.ka += dka;
@@ -1,6 +1,7 @@
 #ifndef SHAPE_H
 #define SHAPE_H
 
+#include <array>
 #include <iostream>
 #include <optional>
 #include <vector>
@@ -9,6 +10,7 @@
 #include "Material.h"
 #include "Shape.h"
 #include "Image.h"
+#include "MaskBitmap.h"
 #include "utils.h"
 #include <GL/glew.h>
 #include <GL/freeglut.h>
@@ -26,16 +28,26 @@ protected:
 	Image* texture = nullptr;		// represent a texture for texture mapping 
 	Material mat;
 	Image* mask = nullptr;			// represent mask for shape (what part of surface to be visible)
+	MaskBitmap maskBits;			// the mask as one bit per texel, which visibility tests read (built at load)
+	MaskCoverage maskCoverage = MaskCoverage::Full;	// how much of the whole mask lets hits through (Full without a mask)
 	Image* bumpMap = nullptr;		// represent bump map for shape
 	
-	vector<float> transComp = { 0, 0, 0 };				// vector to keep track of shape's translation along axes
-	vector<float> scaleComp = { 1, 1, 1 };				// "" scaling along axes
-	vector<float> rotateComp = { 0, 0, 0 };				// "" rotation along axes
+	array<float, 3> transComp = { 0, 0, 0 };			// keep track of shape's translation along axes (fixed size, no heap allocation)
+	array<float, 3> scaleComp = { 1, 1, 1 };			// "" scaling along axes
+	array<float, 3> rotateComp = { 0, 0, 0 };			// "" rotation along axes
 public:
+	Shape() = default;
+
 	/*
-	* Deconstructor of shape class
+	* Deconstructor of shape class (virtual, since scenes own shapes through base pointers)
 	*/
-	~Shape();
+	virtual ~Shape();
+
+	//shapes own their images, so they are moved (handing the images over) rather than copied
+	Shape(const Shape&) = delete;
+	Shape& operator=(const Shape&) = delete;
+	Shape(Shape&& other) noexcept;
+	Shape& operator=(Shape&& other) noexcept;
 
 	/*
 	* Abstract method for finding an intersection between a shape and a given ray (if there exists one).
@@ -107,6 +119,19 @@ public:
 	*/
 	void rotate(float rx, float ry, float rz);
 
+	/*
+	* Accessors for the shape's local transform components (used to build the scene's transform hierarchy)
+	*/
+	const array<float, 3>& translation() const;
+	const array<float, 3>& scaling() const;
+	const array<float, 3>& rotation() const;
+
+	/*
+	* True when a mask hides parts of the shape (its hits cannot be decided by geometry alone);
+	* not for a mask that hides nothing
+	*/
+	bool masked() const;
+
 	/*
 	* Update's a shape's material coefficients
 	*/
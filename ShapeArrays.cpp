@@ -0,0 +1,484 @@
+#include "ShapeArrays.h"
+#include "Sphere.h"
+#include "Mesh.h"
+#include "utils.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+void ShapeArrays::build(const vector<Shape*>& sceneShapes, const vector<Mat4>& worldMatrices)
+{
+	clear();
+
+	for (size_t i = 0; i < sceneShapes.size(); i++)
+	{
+		const Shape* shape = sceneShapes[i];
+		int index = (int)shapes.size();
+
+		shapes.push_back(shape);
+		world.emplace_back();
+		inverse.emplace_back();
+
+		//shapes are sorted once here, so queries never ask an object what it is
+		const Sphere* sphere = dynamic_cast<const Sphere*>(shape);
+		const Mesh* mesh = dynamic_cast<const Mesh*>(shape);
+
+		if (sphere && !sphere->masked())
+		{
+			sphereShape.push_back(index);
+			cx.emplace_back();
+			cy.emplace_back();
+			cz.emplace_back();
+			radius2.emplace_back();
+			nearest.emplace_back();
+			sphereScale.emplace_back();
+
+			place(index, worldMatrices[i], (int)sphereShape.size() - 1);
+		}
+		else
+		{
+			if (mesh) meshShape.push_back(index);
+			else otherShape.push_back(index);
+
+			place(index, worldMatrices[i], -1);
+		}
+	}
+
+	instanceTree.buildBoxes((int)meshShape.size(), [&](int instance, float lo[3], float hi[3]) { instanceBounds(instance, lo, hi); });
+}
+
+void ShapeArrays::refit(const vector<Mat4>& worldMatrices)
+{
+	for (int i = 0, s = 0; i < (int)shapes.size(); i++)
+	{
+		bool isSphere = s < (int)sphereShape.size() && sphereShape[s] == i;
+		place(i, worldMatrices[i], isSphere ? s++ : -1);
+	}
+
+	instanceTree.refit([&](int instance, float lo[3], float hi[3]) { instanceBounds(instance, lo, hi); });
+}
+
+void ShapeArrays::place(int i, const Mat4& worldMatrix, int s)
+{
+	world[i] = worldMatrix;
+	inverse[i] = inverseAffine(worldMatrix);
+
+	if (s < 0) return;
+
+	const Sphere* sphere = static_cast<const Sphere*>(shapes[i]);
+	Point center = transformPoint(worldMatrix, sphere->getCenter());
+	float scale = maxScale(worldMatrix);
+	float radius = sphere->getRadius() * scale;
+
+	cx[s] = center.x();
+	cy[s] = center.y();
+	cz[s] = center.z();
+	radius2[s] = radius * radius;
+	nearest[s] = ZERO * scale;
+	sphereScale[s] = scale;
+}
+
+void ShapeArrays::instanceBounds(int instance, float lo[3], float hi[3]) const
+{
+	int i = meshShape[instance];
+	const Mesh* mesh = static_cast<const Mesh*>(shapes[i]);
+	Point corners[2] = { mesh->minCorner(), mesh->maxCorner() };
+
+	fill(lo, lo + 3, INFINITY);
+	fill(hi, hi + 3, -INFINITY);
+
+	//box around the 8 corners of the mesh's own box, once moved
+	for (int corner = 0; corner < 8; corner++)
+	{
+		Point p = transformPoint(world[i], Point(corners[corner & 1].x(), corners[(corner >> 1) & 1].y(), corners[corner >> 2].z(), 1));
+		float xyz[3] = { p.x(), p.y(), p.z() };
+
+		for (int c = 0; c < 3; c++)
+		{
+			lo[c] = min(lo[c], xyz[c]);
+			hi[c] = max(hi[c], xyz[c]);
+		}
+	}
+}
+
+Ray ShapeArrays::toLocal(int i, const Ray& ray) const
+{
+	return Ray(transformPoint(inverse[i], ray.origin()), transformVector(inverse[i], ray.dir()));
+}
+
+Hit ShapeArrays::toWorld(int i, Hit hit, const Ray& ray) const
+{
+	const Mat4& inv = inverse[i];
+	const Unit& n = hit.normal;
+
+	hit.inter = transformPoint(world[i], hit.inter);
+	hit.normal = Unit(inv[0] * n.x() + inv[1] * n.y() + inv[2] * n.z(),		// normals go through the inverse transpose
+					  inv[4] * n.x() + inv[5] * n.y() + inv[6] * n.z(),
+					  inv[8] * n.x() + inv[9] * n.y() + inv[10] * n.z());
+	hit.t = Vector(ray.origin(), hit.inter).length();
+
+	return hit;
+}
+
+pair<float, int> ShapeArrays::closestSphere(const Ray& ray) const
+{
+	/*
+	* Same equation as Sphere::intersect, with a unit direction and b halved:
+	*	t = -b -/+ sqrt(b^2 - c), b = dir . (origin - center), c = |origin - center|^2 - r^2
+	* the first root far enough along the ray is the sphere's hit. b^2 - c is computed as r^2 minus the squared
+	* distance from the center to the ray's line, which keeps its precision in floats when r is small
+	* compared to the distance (b^2 and c are then both large and nearly cancel).
+	*/
+	float ox = ray.origin().x(), oy = ray.origin().y(), oz = ray.origin().z();
+	float dx = ray.dir().x(), dy = ray.dir().y(), dz = ray.dir().z();
+
+	int count = (int)cx.size();
+	float bestT = INFINITY;
+	int best = -1;
+	int i = 0;
+
+#ifdef __AVX__
+	__m256 originX = _mm256_set1_ps(ox), originY = _mm256_set1_ps(oy), originZ = _mm256_set1_ps(oz);
+	__m256 dirX = _mm256_set1_ps(dx), dirY = _mm256_set1_ps(dy), dirZ = _mm256_set1_ps(dz);
+	__m256 miss = _mm256_set1_ps(INFINITY);
+	__m256 zero = _mm256_setzero_ps();
+
+	__m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256 bestTs = miss;								// closest distance and sphere index seen by each lane
+	__m256 bestIndices = _mm256_set1_ps(-1);			// (as floats: exact below 2^24 spheres, and AVX has no integer blends)
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 ocX = _mm256_sub_ps(originX, _mm256_loadu_ps(&cx[i]));
+		__m256 ocY = _mm256_sub_ps(originY, _mm256_loadu_ps(&cy[i]));
+		__m256 ocZ = _mm256_sub_ps(originZ, _mm256_loadu_ps(&cz[i]));
+
+		__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dirX, ocX), _mm256_mul_ps(dirY, ocY)), _mm256_mul_ps(dirZ, ocZ));
+		__m256 px = _mm256_sub_ps(ocX, _mm256_mul_ps(b, dirX));
+		__m256 py = _mm256_sub_ps(ocY, _mm256_mul_ps(b, dirY));
+		__m256 pz = _mm256_sub_ps(ocZ, _mm256_mul_ps(b, dirZ));
+		__m256 disc = _mm256_sub_ps(_mm256_loadu_ps(&radius2[i]),
+									_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)), _mm256_mul_ps(pz, pz)));
+
+		__m256 root = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+		__m256 t1 = _mm256_sub_ps(_mm256_sub_ps(zero, b), root);
+		__m256 t2 = _mm256_add_ps(_mm256_sub_ps(zero, b), root);
+		__m256 minT = _mm256_loadu_ps(&nearest[i]);
+
+		__m256 t = _mm256_blendv_ps(miss, t2, _mm256_cmp_ps(t2, minT, _CMP_GE_OQ));
+		t = _mm256_blendv_ps(t, t1, _mm256_cmp_ps(t1, minT, _CMP_GE_OQ));
+		t = _mm256_blendv_ps(miss, t, _mm256_cmp_ps(disc, zero, _CMP_GE_OQ));
+
+		__m256 closer = _mm256_cmp_ps(t, bestTs, _CMP_LT_OQ);
+		bestTs = _mm256_blendv_ps(bestTs, t, closer);
+		bestIndices = _mm256_blendv_ps(bestIndices, _mm256_add_ps(lanes, _mm256_set1_ps((float)i)), closer);
+	}
+
+	//closest of the 8 lanes (lowest index on ties, like the scalar loop)
+	alignas(32) float laneT[8], laneIndex[8];
+	_mm256_store_ps(laneT, bestTs);
+	_mm256_store_ps(laneIndex, bestIndices);
+
+	for (int lane = 0; lane < 8; lane++)
+	{
+		int index = (int)laneIndex[lane];
+		if (index >= 0 && (laneT[lane] < bestT || (laneT[lane] == bestT && index < best)))
+		{
+			bestT = laneT[lane];
+			best = index;
+		}
+	}
+#endif
+
+	//remaining spheres (all of them without AVX)
+	for (; i < count; i++)
+	{
+		float ocX = ox - cx[i], ocY = oy - cy[i], ocZ = oz - cz[i];
+
+		float b = dx * ocX + dy * ocY + dz * ocZ;
+		float px = ocX - b * dx, py = ocY - b * dy, pz = ocZ - b * dz;
+		float disc = radius2[i] - (px * px + py * py + pz * pz);
+		if (disc < 0) continue;
+
+		float root = sqrt(disc);
+		float t = -b - root;
+		if (t < nearest[i]) t = -b + root;
+
+		if (t >= nearest[i] && t < bestT)
+		{
+			bestT = t;
+			best = i;
+		}
+	}
+
+	return { bestT, best };
+}
+
+optional<Hit> ShapeArrays::intersect(const Ray& ray) const
+{
+	optional<Hit> closest;
+
+	//mesh instances: down the instance hierarchy, then the mesh's own (non-virtual) intersect in its space
+	if (!instanceTree.empty())
+	{
+		float o[3] = { ray.origin().x(), ray.origin().y(), ray.origin().z() };
+		float d[3] = { ray.dir().x(), ray.dir().y(), ray.dir().z() };
+		float inv[3] = { 1 / d[0], 1 / d[1], 1 / d[2] };
+
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			int index = stack[--top];
+			const BvhNode& node = instanceTree.nodes[index];
+
+			//instances entered past the closest hit so far cannot hold a closer one
+			if (!boxHit(node, o, inv, closest ? closest->t : INFINITY)) continue;
+
+			if (node.count == 0)
+			{
+				int nearChild = index + 1, farChild = node.first;
+				if (along(instanceTree.nodes[farChild], d) < along(instanceTree.nodes[nearChild], d)) swap(nearChild, farChild);
+
+				stack[top++] = farChild;
+				stack[top++] = nearChild;
+				continue;
+			}
+
+			for (int k = node.first; k < node.first + node.count; k++)
+			{
+				int i = meshShape[instanceTree.order[k]];
+				const Mesh* mesh = static_cast<const Mesh*>(shapes[i]);
+
+				optional<Hit> hit = mesh->Mesh::intersect(toLocal(i, ray));
+				if (!hit) continue;
+
+				Hit worldHit = toWorld(i, *hit, ray);
+				if (!closest || worldHit.t < closest->t) closest = worldHit;
+			}
+		}
+	}
+
+	for (int i : otherShape)
+	{
+		optional<Hit> hit = shapes[i]->intersect(toLocal(i, ray));
+		if (!hit) continue;
+
+		Hit worldHit = toWorld(i, *hit, ray);
+		if (!closest || worldHit.t < closest->t) closest = worldHit;
+	}
+
+	//spheres: all tested at once, only the closest one (if nothing else is closer) is shaded
+	auto [t, sphere] = closestSphere(ray);
+
+	if (sphere >= 0 && (!closest || t < closest->t))
+	{
+		optional<Hit> hit = sphereHit(sphere, t, ray);
+		if (hit) closest = hit;
+	}
+
+	return closest;
+}
+
+void ShapeArrays::intersect(const RayPacket& packet, optional<Hit> hits[RayPacket::SIZE]) const
+{
+	vector<Ray> rays;										// world space ray of each lane (those of idle lanes are unused)
+	for (int lane = 0; lane < RayPacket::SIZE; lane++)
+	{
+		hits[lane].reset();
+		rays.push_back(packet.ray(lane));
+	}
+
+	auto keepCloser = [&](int lane, const Hit& hit) {
+		if (!hits[lane] || hit.t < hits[lane]->t) hits[lane] = hit;
+	};
+
+	//mesh instances: the packet down the instance hierarchy, then moved into the space of the
+	//instances its lanes reach (only those lanes)
+	if (!instanceTree.empty() && packet.active)
+	{
+		int first = countr_zero(packet.active);
+		float d[3] = { packet.dx[first], packet.dy[first], packet.dz[first] };
+
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			int index = stack[--top];
+			const BvhNode& node = instanceTree.nodes[index];
+
+			float maxT[RayPacket::SIZE];
+			for (int lane = 0; lane < RayPacket::SIZE; lane++) maxT[lane] = hits[lane] ? hits[lane]->t : INFINITY;
+
+			unsigned lanes = boxHits(packet, node.lo, node.hi, maxT, packet.active);
+			if (lanes == 0) continue;
+
+			if (node.count == 0)
+			{
+				int nearChild = index + 1, farChild = node.first;
+				if (along(instanceTree.nodes[farChild], d) < along(instanceTree.nodes[nearChild], d)) swap(nearChild, farChild);
+
+				stack[top++] = farChild;
+				stack[top++] = nearChild;
+				continue;
+			}
+
+			for (int k = node.first; k < node.first + node.count; k++)
+			{
+				int i = meshShape[instanceTree.order[k]];
+
+				RayPacket local = packet.transformed(inverse[i]);
+				local.active = lanes;
+
+				optional<Hit> localHits[RayPacket::SIZE];
+				static_cast<const Mesh*>(shapes[i])->intersect(local, localHits);
+
+				for (int lane = 0; lane < RayPacket::SIZE; lane++)
+				{
+					if (localHits[lane]) keepCloser(lane, toWorld(i, *localHits[lane], rays[lane]));
+				}
+			}
+		}
+	}
+
+	for (int i : otherShape)
+	{
+		for (unsigned lanes = packet.active; lanes; lanes &= lanes - 1)
+		{
+			int lane = countr_zero(lanes);
+
+			optional<Hit> hit = shapes[i]->intersect(toLocal(i, rays[lane]));
+			if (hit) keepCloser(lane, toWorld(i, *hit, rays[lane]));
+		}
+	}
+
+	//spheres: each one against every lane at once, keeping each lane's closest
+	float bestT[RayPacket::SIZE];
+	int best[RayPacket::SIZE];
+	fill(bestT, bestT + RayPacket::SIZE, INFINITY);
+	fill(best, best + RayPacket::SIZE, -1);
+
+	//rays from one point (camera packets) only test the spheres that reach into the cone around them
+	float axis[3], cosAngle, sinAngle;
+	bool cone = packet.cone(axis, cosAngle, sinAngle);
+	int first = countr_zero(packet.active);
+
+	for (int s = 0; s < (int)cx.size(); s++)
+	{
+		if (cone)
+		{
+			float ocX = cx[s] - packet.ox[first], ocY = cy[s] - packet.oy[first], ocZ = cz[s] - packet.oz[first];
+			float dist2 = ocX * ocX + ocY * ocY + ocZ * ocZ;
+			float along = ocX * axis[0] + ocY * axis[1] + ocZ * axis[2];
+
+			//outside: the angle to the center is wider than the cone's plus the sphere's own (seen from the origin)
+			if (dist2 > radius2[s] && along < cosAngle * sqrt(dist2 - radius2[s]) - sinAngle * sqrt(radius2[s])) continue;
+		}
+
+		float t[RayPacket::SIZE];
+		for (unsigned lanes = sphereHits(packet, cx[s], cy[s], cz[s], radius2[s], nearest[s], packet.active, t); lanes; lanes &= lanes - 1)
+		{
+			int lane = countr_zero(lanes);
+			if (t[lane] >= bestT[lane]) continue;
+
+			bestT[lane] = t[lane];
+			best[lane] = s;
+		}
+	}
+
+	for (int lane = 0; lane < RayPacket::SIZE; lane++)
+	{
+		if (best[lane] < 0 || (hits[lane] && bestT[lane] >= hits[lane]->t)) continue;
+
+		optional<Hit> hit = sphereHit(best[lane], bestT[lane], rays[lane]);
+		if (hit) hits[lane] = hit;
+	}
+}
+
+optional<Hit> ShapeArrays::sphereHit(int sphere, float t, const Ray& ray) const
+{
+	int i = sphereShape[sphere];
+	const Sphere* shape = static_cast<const Sphere*>(shapes[i]);
+
+	optional<Hit> hit = shape->Sphere::viableT(t / sphereScale[sphere], toLocal(i, ray));
+	if (!hit) return {};
+
+	return toWorld(i, *hit, ray);
+}
+
+optional<Hit> ShapeArrays::intersectVirtual(const Ray& ray) const
+{
+	optional<Hit> closest;
+
+	for (size_t i = 0; i < shapes.size(); i++)
+	{
+		optional<Hit> hit = shapes[i]->intersect(toLocal((int)i, ray));
+		if (!hit) continue;
+
+		Hit worldHit = toWorld((int)i, *hit, ray);
+		if (!closest || worldHit.t < closest->t) closest = worldHit;
+	}
+
+	return closest;
+}
+
+int ShapeArrays::sphereCount() const
+{
+	return (int)sphereShape.size();
+}
+
+int ShapeArrays::meshCount() const
+{
+	return (int)meshShape.size();
+}
+
+int ShapeArrays::otherCount() const
+{
+	return (int)otherShape.size();
+}
+
+size_t ShapeArrays::instanceTreeBytes() const
+{
+	return instanceTree.memoryBytes();
+}
+
+PacketStats ShapeArrays::packetStats() const
+{
+	//instances share their mesh's counters: each mesh is counted once
+	vector<const Shape*> meshes;
+	for (int i : meshShape) meshes.push_back(shapes[i]);
+
+	sort(meshes.begin(), meshes.end());
+	meshes.erase(unique(meshes.begin(), meshes.end()), meshes.end());
+
+	PacketStats total;
+	for (const Shape* mesh : meshes) total += static_cast<const Mesh*>(mesh)->packetStats();
+
+	return total;
+}
+
+void ShapeArrays::clear()
+{
+	shapes.clear();
+	world.clear();
+	inverse.clear();
+
+	cx.clear();
+	cy.clear();
+	cz.clear();
+	radius2.clear();
+	nearest.clear();
+	sphereScale.clear();
+	sphereShape.clear();
+
+	meshShape.clear();
+	instanceTree.clear();
+	otherShape.clear();
+}
@@ -0,0 +1,127 @@
+#ifndef SHAPEARRAYS_H
+#define SHAPEARRAYS_H
+
+#include <optional>
+#include <utility>
+#include <vector>
+#include "Bvh.h"
+#include "Hit.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "Shape.h"
+#include "Transform.h"
+using namespace std;
+
+/*
+* A scene's shapes laid out by type for ray queries, so that the intersection loop runs once per type
+* instead of making virtual calls per object:
+*	spheres		world space centers and squared radii in contiguous arrays, tested 8 at a time (AVX)
+*	meshes		instance list with world and inverse matrices, under a hierarchy of their world space boxes
+*				(the top level: each instance's mesh has its own, in its space), intersected through non-virtual calls
+*	others		masked spheres (visibility depends on the hit point), through the virtual path
+*
+* Only the closest sphere is shaded. Spheres are moved to world space with their node's largest
+* scaling, so they assume uniform scaling like the rest of the scene.
+* Shapes are not owned, and one shape may be listed several times (instances of a mesh at other transforms):
+* the arrays are rebuilt whenever the scene is loaded, and refit() follows shapes that moved.
+*/
+class ShapeArrays
+{
+private:
+	vector<const Shape*> shapes;		// every shape, in scene order
+	vector<Mat4> world;					// world matrix of each shape...
+	vector<Mat4> inverse;				// ...and its inverse (world -> shape space)
+
+	//spheres, structure-of-arrays
+	vector<float> cx, cy, cz;			// world space center
+	vector<float> radius2;				// world space radius, squared
+	vector<float> nearest;				// smallest distance counted as a hit (ZERO in the sphere's own units)
+	vector<float> sphereScale;			// world units per sphere unit
+	vector<int> sphereShape;			// index of each sphere in 'shapes'
+
+	vector<int> meshShape;				// index of each mesh instance in 'shapes'
+	Bvh instanceTree;					// hierarchy over the mesh instances' world space boxes (items index 'meshShape')
+	vector<int> otherShape;				// index of every shape left to the virtual path
+
+	/*
+	* Moves shape i to its world matrix (and sphere s, its index in the sphere arrays, if it is one)
+	*/
+	void place(int i, const Mat4& worldMatrix, int s);
+
+	/*
+	* World space box around a mesh instance (index in 'meshShape')
+	*/
+	void instanceBounds(int instance, float lo[3], float hi[3]) const;
+
+	/*
+	* Ray in the space of shape i (direction renormalized, so distances are in the shape's units)
+	*/
+	Ray toLocal(int i, const Ray& ray) const;
+
+	/*
+	* Moves a hit found on shape i (with its local ray) back to world space, distance included
+	*/
+	Hit toWorld(int i, Hit hit, const Ray& ray) const;
+
+	/*
+	* Distance to the closest sphere along the ray and its index in the sphere arrays (-1 = none)
+	*/
+	pair<float, int> closestSphere(const Ray& ray) const;
+
+	/*
+	* Shades the hit at distance t on a sphere (index in the sphere arrays) through its own, non-virtual viableT()
+	*/
+	optional<Hit> sphereHit(int sphere, float t, const Ray& ray) const;
+
+public:
+	/*
+	* Sorts the shapes by type and computes their world space data ('world' = world matrix of each shape)
+	*/
+	void build(const vector<Shape*>& sceneShapes, const vector<Mat4>& worldMatrices);
+
+	/*
+	* Moves every shape to its new world matrix (same order as in build()), refitting the instance
+	* hierarchy instead of building it again: for rigid motion from one frame to the next
+	*/
+	void refit(const vector<Mat4>& worldMatrices);
+
+	/*
+	* Closest hit of a world space ray, one loop per type of shape
+	*/
+	optional<Hit> intersect(const Ray& ray) const;
+
+	/*
+	* Same query, one virtual intersect() per shape (the reference the arrays are measured against)
+	*/
+	optional<Hit> intersectVirtual(const Ray& ray) const;
+
+	/*
+	* Closest hit of each ray of a packet (same results as intersect() one ray at a time):
+	* each sphere is tested against the 8 rays at once, and meshes traverse their hierarchy per packet
+	*/
+	void intersect(const RayPacket& packet, optional<Hit> hits[RayPacket::SIZE]) const;
+
+	/*
+	* Number of spheres, mesh instances and other shapes held
+	*/
+	int sphereCount() const;
+	int meshCount() const;
+	int otherCount() const;
+
+	/*
+	* Bytes held by the instance hierarchy
+	*/
+	size_t instanceTreeBytes() const;
+
+	/*
+	* Packet counters of the meshes, summed (once per mesh, however many instances it has)
+	*/
+	PacketStats packetStats() const;
+
+	/*
+	* Forgets every shape
+	*/
+	void clear();
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include "Simplify.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <queue>
+
+// weight of the planes that keep open borders in place (borders have no surface on one side to hold them)
+const double BOUNDARY_WEIGHT = 10;
+
+/*
+* Symmetric 4x4 matrix summing the squared distances to a set of planes
+*/
+struct Quadric
+{
+	double a2 = 0, ab = 0, ac = 0, ad = 0;
+	double b2 = 0, bc = 0, bd = 0;
+	double c2 = 0, cd = 0;
+	double d2 = 0;
+
+	//add plane a*x + b*y + c*z + d = 0 (a, b, c normalized)
+	void addPlane(double a, double b, double c, double d, double w)
+	{
+		a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+		b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+		c2 += w * c * c; cd += w * c * d;
+		d2 += w * d * d;
+	}
+
+	void operator+=(const Quadric& q)
+	{
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+	}
+
+	//sum of squared distances of (x, y, z) to the planes
+	double error(double x, double y, double z) const
+	{
+		return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+			 + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+			 + c2 * z * z + 2 * cd * z
+			 + d2;
+	}
+};
+
+/*
+* Candidate collapse of 'remove' onto 'keep', valid while both vertices are unchanged since it was queued
+*/
+struct Collapse
+{
+	double cost;
+	int keep;
+	int remove;
+	int keepStamp;
+	int removeStamp;
+
+	bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+IndexedMesh simplify(const IndexedMesh& mesh, int targetTriangles, float& error)
+{
+	int n = mesh.vertexCount();
+	int m = mesh.triangleCount();
+
+	vector<double> x(mesh.px.begin(), mesh.px.end());
+	vector<double> y(mesh.py.begin(), mesh.py.end());
+	vector<double> z(mesh.pz.begin(), mesh.pz.end());
+
+	vector<int> faces(mesh.indices.begin(), mesh.indices.end());
+	vector<bool> faceAlive(m, true);
+	vector<bool> vertexAlive(n, true);
+	vector<int> stamp(n, 0);
+	vector<vector<int>> vertexFaces(n);
+	vector<Quadric> quadrics(n);
+
+	auto faceNormal = [&](int f, int moved, double mx, double my, double mz, double out[3]) {
+		double p[3][3];
+		for (int c = 0; c < 3; c++)
+		{
+			int v = faces[3 * f + c];
+			p[c][0] = v == moved ? mx : x[v];
+			p[c][1] = v == moved ? my : y[v];
+			p[c][2] = v == moved ? mz : z[v];
+		}
+		double e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+		double e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+		out[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		out[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		out[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	};
+
+	//quadric of each vertex: planes of the triangles around it
+	map<pair<int, int>, int> edgeFaces;
+	for (int f = 0; f < m; f++)
+	{
+		double nrm[3];
+		faceNormal(f, -1, 0, 0, 0, nrm);
+		double len = sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]);
+
+		for (int c = 0; c < 3; c++)
+		{
+			int v = faces[3 * f + c];
+			vertexFaces[v].push_back(f);
+			edgeFaces[minmax(v, faces[3 * f + (c + 1) % 3])]++;
+
+			if (len > 0)
+			{
+				double a = nrm[0] / len, b = nrm[1] / len, cc = nrm[2] / len;
+				quadrics[v].addPlane(a, b, cc, -(a * x[v] + b * y[v] + cc * z[v]), 1);
+			}
+		}
+	}
+
+	//open borders: add a plane through the edge, perpendicular to its triangle
+	for (int f = 0; f < m; f++)
+	{
+		double nrm[3];
+		faceNormal(f, -1, 0, 0, 0, nrm);
+
+		for (int c = 0; c < 3; c++)
+		{
+			int v0 = faces[3 * f + c];
+			int v1 = faces[3 * f + (c + 1) % 3];
+			if (edgeFaces[minmax(v0, v1)] != 1) continue;
+
+			double e[3] = { x[v1] - x[v0], y[v1] - y[v0], z[v1] - z[v0] };
+			double p[3] = { e[1] * nrm[2] - e[2] * nrm[1], e[2] * nrm[0] - e[0] * nrm[2], e[0] * nrm[1] - e[1] * nrm[0] };
+			double len = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+			if (len == 0) continue;
+
+			double a = p[0] / len, b = p[1] / len, cc = p[2] / len;
+			double d = -(a * x[v0] + b * y[v0] + cc * z[v0]);
+			quadrics[v0].addPlane(a, b, cc, d, BOUNDARY_WEIGHT);
+			quadrics[v1].addPlane(a, b, cc, d, BOUNDARY_WEIGHT);
+		}
+	}
+
+
+	//queue every edge, collapsing onto whichever endpoint has the lower error
+	priority_queue<Collapse, vector<Collapse>, greater<Collapse>> heap;
+	auto queueEdge = [&](int v0, int v1) {
+		Quadric q = quadrics[v0];
+		q += quadrics[v1];
+
+		double onto0 = q.error(x[v0], y[v0], z[v0]);
+		double onto1 = q.error(x[v1], y[v1], z[v1]);
+
+		if (onto0 <= onto1) heap.push({ max(onto0, 0.0), v0, v1, stamp[v0], stamp[v1] });
+		else heap.push({ max(onto1, 0.0), v1, v0, stamp[v1], stamp[v0] });
+	};
+
+	for (const auto& [edge, count] : edgeFaces) queueEdge(edge.first, edge.second);
+
+
+	int liveFaces = m;
+	double maxCost = 0;
+
+	while (liveFaces > targetTriangles && !heap.empty())
+	{
+		Collapse c = heap.top();
+		heap.pop();
+
+		if (!vertexAlive[c.keep] || !vertexAlive[c.remove]) continue;
+		if (stamp[c.keep] != c.keepStamp || stamp[c.remove] != c.removeStamp) continue;		// outdated entry
+
+		//reject collapses that would flip (or flatten) a remaining triangle
+		bool flips = false;
+		for (int f : vertexFaces[c.remove])
+		{
+			if (!faceAlive[f]) continue;
+			if (faces[3 * f] == c.keep || faces[3 * f + 1] == c.keep || faces[3 * f + 2] == c.keep) continue;		// collapses away
+
+			double before[3], after[3];
+			faceNormal(f, -1, 0, 0, 0, before);
+			faceNormal(f, c.remove, x[c.keep], y[c.keep], z[c.keep], after);
+
+			double d = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+			if (d <= 0) { flips = true; break; }
+		}
+		if (flips) continue;
+
+		//collapse: triangles on the edge disappear, the rest move over to 'keep'
+		for (int f : vertexFaces[c.remove])
+		{
+			if (!faceAlive[f]) continue;
+
+			bool onEdge = false;
+			for (int k = 0; k < 3; k++) onEdge |= faces[3 * f + k] == c.keep;
+
+			if (onEdge)
+			{
+				faceAlive[f] = false;
+				liveFaces--;
+				continue;
+			}
+
+			for (int k = 0; k < 3; k++)
+			{
+				if (faces[3 * f + k] == c.remove) faces[3 * f + k] = c.keep;
+			}
+			vertexFaces[c.keep].push_back(f);
+		}
+
+		vertexAlive[c.remove] = false;
+		vertexFaces[c.remove].clear();
+		quadrics[c.keep] += quadrics[c.remove];
+		stamp[c.keep]++;
+		maxCost = max(maxCost, c.cost);
+
+		//drop dead triangles from the kept vertex, then requeue its edges with the merged quadric
+		vector<int>& around = vertexFaces[c.keep];
+		around.erase(remove_if(around.begin(), around.end(), [&](int f) { return !faceAlive[f]; }), around.end());
+		sort(around.begin(), around.end());
+		around.erase(unique(around.begin(), around.end()), around.end());
+
+		for (int f : around)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				int other = faces[3 * f + k];
+				if (other != c.keep) queueEdge(c.keep, other);
+			}
+		}
+	}
+
+	error = (float)sqrt(maxCost);
+
+
+	//gather the remaining triangles and the vertices they still use
+	IndexedMesh result;
+	vector<int> remap(n, -1);
+
+	for (int f = 0; f < m; f++)
+	{
+		if (!faceAlive[f]) continue;
+
+		for (int k = 0; k < 3; k++)
+		{
+			int v = faces[3 * f + k];
+			if (remap[v] < 0)
+			{
+				remap[v] = result.vertexCount();
+				result.px.push_back(mesh.px[v]);
+				result.py.push_back(mesh.py[v]);
+				result.pz.push_back(mesh.pz[v]);
+				result.nx.push_back(mesh.nx[v]);
+				result.ny.push_back(mesh.ny[v]);
+				result.nz.push_back(mesh.nz[v]);
+				result.r.push_back(mesh.r[v]);
+				result.g.push_back(mesh.g[v]);
+				result.b.push_back(mesh.b[v]);
+			}
+			result.indices.push_back(remap[v]);
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,14 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include "IndexedMesh.h"
+
+/*
+* Reduces the mesh to (about) the target number of triangles by repeatedly collapsing
+* the edge with the smallest quadric error (Garland-Heckbert). Edges collapse onto one
+* of their endpoints, so every remaining vertex keeps its original normal and color.
+* 'error' receives the largest distance (in mesh units) a collapse moved the surface by.
+*/
+IndexedMesh simplify(const IndexedMesh& mesh, int targetTriangles, float& error);
+
+#endif
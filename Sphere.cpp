@@ -50,6 +50,16 @@ Sphere::Sphere(const Point& cn, float r )
 	center = cn;
 }
 
+Point Sphere::getCenter() const
+{
+	return center;
+}
+
+float Sphere::getRadius() const
+{
+	return radius;
+}
+
 optional<Hit> Sphere::intersect(const Ray& ray) const
 {
 	/*
@@ -66,9 +76,13 @@ optional<Hit> Sphere::intersect(const Ray& ray) const
 	Vector centerOrigin(ray.origin().x() - center.x(),			//represent ray origin - center as a vector
 					    ray.origin().y() - center.y(),
 						ray.origin().z() - center.z());
-	double b =  2 * dot(ray.dir(), centerOrigin);
 
-	double c = dot(centerOrigin, centerOrigin) - (radius * radius);
+	//dot products in doubles: b^2 and 4c nearly cancel for small spheres seen from afar,
+	//and float dot() rounds away hits that are well inside the sphere's outline
+	double ocX = centerOrigin.x(), ocY = centerOrigin.y(), ocZ = centerOrigin.z();
+	double b =  2 * (ray.dir().x() * ocX + ray.dir().y() * ocY + ray.dir().z() * ocZ);
+
+	double c = (ocX * ocX + ocY * ocY + ocZ * ocZ) - ((double)radius * radius);
 
 
 
@@ -165,8 +179,8 @@ bool Sphere::isVisible(float u, float v) const
 {
 	if (this->mask == nullptr) return true;		//if no mask, point is visible by default
 
-	//if is mask, find color at given coordinates in the mask (value greater than 0 = visible)
-	return mask->gray_uv(u, v) > 0;
+	//if is mask, test the bit of its texels at the given coordinates (same answer as its gray value being greater than 0)
+	return maskBits.visible(u, v);
 }
 
 
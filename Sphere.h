@@ -27,6 +27,12 @@ public:
 	*/
 	Sphere(const Point& cn, float r);
 
+	/*
+	* Accessors for the sphere's center and radius
+	*/
+	Point getCenter() const;
+	float getRadius() const;
+
 	/*
 	* Return C++ 'optional' of 'Hit' object representing
 	* the point of intersection between the sphere and
@@ -0,0 +1,180 @@
+#include "Transform.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+
+Mat4 identityMatrix()
+{
+	return Mat4{ 1, 0, 0, 0,
+				 0, 1, 0, 0,
+				 0, 0, 1, 0,
+				 0, 0, 0, 1 };
+}
+
+Mat4 multiply(const Mat4& a, const Mat4& b)
+{
+	Mat4 result{};
+
+	for (int col = 0; col < 4; col++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			float sum = 0;
+			for (int i = 0; i < 4; i++) sum += a[i * 4 + row] * b[col * 4 + i];		// row of a dotted with column of b
+
+			result[col * 4 + row] = sum;
+		}
+	}
+
+	return result;
+}
+
+Mat4 compose(const array<float, 3>& trans, const array<float, 3>& scale, const array<float, 3>& rot)
+{
+	float ax = rot[0] * PI / 180;
+	float ay = rot[1] * PI / 180;
+	float az = rot[2] * PI / 180;
+
+	Mat4 rotX{ 1, 0, 0, 0,
+			   0, cos(ax), sin(ax), 0,
+			   0, -sin(ax), cos(ax), 0,
+			   0, 0, 0, 1 };
+
+	Mat4 rotY{ cos(ay), 0, -sin(ay), 0,
+			   0, 1, 0, 0,
+			   sin(ay), 0, cos(ay), 0,
+			   0, 0, 0, 1 };
+
+	Mat4 rotZ{ cos(az), sin(az), 0, 0,
+			   -sin(az), cos(az), 0, 0,
+			   0, 0, 1, 0,
+			   0, 0, 0, 1 };
+
+	Mat4 scaleM{ scale[0], 0, 0, 0,
+				 0, scale[1], 0, 0,
+				 0, 0, scale[2], 0,
+				 0, 0, 0, 1 };
+
+	Mat4 transM = identityMatrix();
+	transM[12] = trans[0];
+	transM[13] = trans[1];
+	transM[14] = trans[2];
+
+	// same order as Sphere::draw: translate, rotate Y, Z, X, then scale
+	return multiply(transM, multiply(rotY, multiply(rotZ, multiply(rotX, scaleM))));
+}
+
+Point transformPoint(const Mat4& m, const Point& pt)
+{
+	return Point(m[0] * pt.x() + m[4] * pt.y() + m[8] * pt.z() + m[12],
+				 m[1] * pt.x() + m[5] * pt.y() + m[9] * pt.z() + m[13],
+				 m[2] * pt.x() + m[6] * pt.y() + m[10] * pt.z() + m[14], 1);
+}
+
+Vector transformVector(const Mat4& m, const Vector& v)
+{
+	return Vector(m[0] * v.x() + m[4] * v.y() + m[8] * v.z(),
+				  m[1] * v.x() + m[5] * v.y() + m[9] * v.z(),
+				  m[2] * v.x() + m[6] * v.y() + m[10] * v.z());
+}
+
+float maxScale(const Mat4& m)
+{
+	float sx = Vector(m[0], m[1], m[2]).length();			// length of each transformed axis
+	float sy = Vector(m[4], m[5], m[6]).length();
+	float sz = Vector(m[8], m[9], m[10]).length();
+
+	return max(sx, max(sy, sz));
+}
+
+Mat4 inverseAffine(const Mat4& m)
+{
+	auto at = [&](int row, int col) { return m[col * 4 + row]; };
+
+	//inverse of the upper 3x3 from its cofactors
+	float c00 = at(1, 1) * at(2, 2) - at(1, 2) * at(2, 1);
+	float c01 = at(1, 2) * at(2, 0) - at(1, 0) * at(2, 2);
+	float c02 = at(1, 0) * at(2, 1) - at(1, 1) * at(2, 0);
+	float det = at(0, 0) * c00 + at(0, 1) * c01 + at(0, 2) * c02;
+
+	Mat4 inv = identityMatrix();
+	auto set = [&](int row, int col, float value) { inv[col * 4 + row] = value / det; };
+
+	set(0, 0, c00);
+	set(1, 0, c01);
+	set(2, 0, c02);
+	set(0, 1, at(0, 2) * at(2, 1) - at(0, 1) * at(2, 2));
+	set(1, 1, at(0, 0) * at(2, 2) - at(0, 2) * at(2, 0));
+	set(2, 1, at(0, 1) * at(2, 0) - at(0, 0) * at(2, 1));
+	set(0, 2, at(0, 1) * at(1, 2) - at(0, 2) * at(1, 1));
+	set(1, 2, at(0, 2) * at(1, 0) - at(0, 0) * at(1, 2));
+	set(2, 2, at(0, 0) * at(1, 1) - at(0, 1) * at(1, 0));
+
+	//translation undone after the rotation/scaling is: -inverse * translation
+	Vector t = transformVector(inv, Vector(at(0, 3), at(1, 3), at(2, 3)));
+	inv[12] = -t.x();
+	inv[13] = -t.y();
+	inv[14] = -t.z();
+
+	return inv;
+}
+
+Mat4 normalMatrix(const Mat4& m)
+{
+	Mat4 inv = inverseAffine(m);
+	Mat4 normal = identityMatrix();
+
+	for (int row = 0; row < 3; row++)
+	{
+		for (int col = 0; col < 3; col++) normal[col * 4 + row] = inv[row * 4 + col];
+	}
+
+	return normal;
+}
+
+int TransformHierarchy::add(int parentNode, const array<float, 3>& trans, const array<float, 3>& scale, const array<float, 3>& rot)
+{
+	parent.push_back(parentNode);
+
+	tx.push_back(trans[0]);
+	ty.push_back(trans[1]);
+	tz.push_back(trans[2]);
+
+	sx.push_back(scale[0]);
+	sy.push_back(scale[1]);
+	sz.push_back(scale[2]);
+
+	rx.push_back(rot[0]);
+	ry.push_back(rot[1]);
+	rz.push_back(rot[2]);
+
+	world.push_back(identityMatrix());
+
+	return size() - 1;
+}
+
+void TransformHierarchy::update()
+{
+	//parents are stored before their children, so a parent's world matrix is always ready when a child needs it
+	for (int i = 0; i < size(); i++)
+	{
+		Mat4 local = compose({ tx[i], ty[i], tz[i] }, { sx[i], sy[i], sz[i] }, { rx[i], ry[i], rz[i] });
+
+		if (parent[i] < 0) world[i] = local;
+		else world[i] = multiply(world[parent[i]], local);
+	}
+}
+
+int TransformHierarchy::size() const
+{
+	return (int)parent.size();
+}
+
+void TransformHierarchy::clear()
+{
+	parent.clear();
+	tx.clear(); ty.clear(); tz.clear();
+	sx.clear(); sy.clear(); sz.clear();
+	rx.clear(); ry.clear(); rz.clear();
+	world.clear();
+}
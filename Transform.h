@@ -0,0 +1,92 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <array>
+#include <vector>
+#include "Point.h"
+#include "Vector.h"
+using namespace std;
+
+using Mat4 = array<float, 16>;			// column-major 4x4 matrix (same layout glUniformMatrix4fv expects)
+
+/*
+* Returns the 4x4 identity matrix
+*/
+Mat4 identityMatrix();
+
+/*
+* Returns the matrix product a * b (b is applied first)
+*/
+Mat4 multiply(const Mat4& a, const Mat4& b);
+
+/*
+* Builds a local transform in the same order Sphere::draw applies it:
+* translate * rotY * rotZ * rotX * scale (rotations in degrees)
+*/
+Mat4 compose(const array<float, 3>& trans, const array<float, 3>& scale, const array<float, 3>& rot);
+
+/*
+* Applies the matrix to a point (w = 1) and returns the transformed point
+*/
+Point transformPoint(const Mat4& m, const Point& pt);
+
+/*
+* Applies the upper 3x3 of the matrix to a vector (no translation)
+*/
+Vector transformVector(const Mat4& m, const Vector& v);
+
+/*
+* Largest scaling the matrix applies along any of its axes (for scaling bounding sphere radii)
+*/
+float maxScale(const Mat4& m);
+
+/*
+* Inverse of a matrix made of translation, rotation and scaling only (no projection), e.g. to bring rays into a shape's space
+*/
+Mat4 inverseAffine(const Mat4& m);
+
+/*
+* Matrix that carries normals along with the matrix's transform (the transpose of its inverse, without translation),
+* so they stay perpendicular to the surface under non-uniform scaling
+*/
+Mat4 normalMatrix(const Mat4& m);
+
+
+/*
+* Flat transform hierarchy stored as structure-of-arrays.
+* Nodes are always appended after their parent, so world matrices
+* can be resolved in one linear pass without recursion or pointer chasing.
+*/
+class TransformHierarchy
+{
+public:
+	vector<int> parent;					// index of parent node (-1 for a root)
+
+	vector<float> tx, ty, tz;			// local translation along each axis
+	vector<float> sx, sy, sz;			// local scaling along each axis
+	vector<float> rx, ry, rz;			// local rotation about each axis (degrees)
+
+	vector<Mat4> world;					// resolved world matrix of each node (filled by update())
+
+	/*
+	* Appends a node under the given parent and returns its index
+	*/
+	int add(int parentNode, const array<float, 3>& trans, const array<float, 3>& scale, const array<float, 3>& rot);
+
+	/*
+	* Recomputes every world matrix from the local components (parents before children)
+	*/
+	void update();
+
+	/*
+	* Number of nodes in the hierarchy
+	*/
+	int size() const;
+
+	/*
+	* Removes all nodes
+	*/
+	void clear();
+};
+
+#endif
@@ -67,6 +67,33 @@ optional<Hit> Triangle::intersect(const Ray& ray) const
 	return {};
 }
 
+void Triangle::set(const Point points[3], const Vector normals[3], const Color& color)
+{
+	Vertex* vertices[3] = { &v1, &v2, &v3 };
+
+	for (int i = 0; i < 3; i++)
+	{
+		vertices[i]->point = points[i];
+		vertices[i]->vNormal = Unit(normals[i]);
+	}
+
+	//compute flat normal given the vertices (cross product counter clockwise)
+	Vector v1V2 = Vector(v1.point, v2.point);
+	Vector v1V3 = Vector(v1.point, v3.point);
+
+	flatNorm = Unit(v1V2.cross(v1V3));
+
+	this->color = color;
+
+	/*
+	* By default triangles vertex colors are the color of the whole triangle
+	*/
+	for (Vertex* v : vertices)
+	{
+		v->vColor = color;
+	}
+}
+
 void Triangle::setSmooth(bool smooth)
 {
 	// loop over each vertex and set color at that vertex
@@ -108,39 +135,20 @@ ostream& operator<<(ostream& os, const Triangle& t)
 
 istream& operator>>(istream& is, Triangle& t)
 {
-	string token; 
-	Point vertPt;
-	Point normPt;
-
-	Vertex* vertices[3] = { &t.v1, &t.v2, &t.v3 };
-
+	Point points[3];
+	Vector normals[3];
+	Color color;
 
-	for (Vertex* v : vertices)
+	for (int i = 0; i < 3; i++)
 	{
-		is >> vertPt >> normPt;					// get vertex, normal pair
-		v->point = vertPt;
-		v->vNormal = Unit(Vector(normPt));
+		Point normPt;
+		is >> points[i] >> normPt;				// get vertex, normal pair
+		normals[i] = Vector(normPt);
 	}
-	
-
-	//compute flat normal given the vertices (cross product counter clockwise)
-	Vector v1V2 = Vector(t.v1.point, t.v2.point);
-	Vector v1V3 = Vector(t.v1.point, t.v3.point);
-
-	t.flatNorm = Unit(v1V2.cross(v1V3));
-	
 
-	is >> t.color;								// read in triangle's color			
-
-
-	/*
-	* By default triangles vertex colors are the color of the whole triangle
-	*/
-	for (Vertex* v : vertices)
-	{
-		v->vColor = t.color;
-	}
+	is >> color;								// read in triangle's color
 
+	t.set(points, normals, color);
 
 	return is;
 }
\ No newline at end of file
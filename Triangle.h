@@ -29,6 +29,12 @@ public:
 	*/
 	optional<Hit> intersect(const Ray& ray) const;
 
+	/*
+	* Sets the vertices (with their normals) and color of the triangle, and computes its flat normal.
+	* Each vertex starts with the color of the whole triangle.
+	*/
+	void set(const Point points[3], const Vector normals[3], const Color& color);
+
 	/*
 	* Sets color of each vertex by creating a unit vector out of 
 	* each vertices' coordinates and then using absolute values 
@@ -0,0 +1,221 @@
+#include "Visibility.h"
+#include "shaderutils.h"
+#include <set>
+#include <vector>
+
+static const int TILE = 8;					// compute work group size (local_size in visComputeShader.glsl)
+
+VisibilityRenderer::~VisibilityRenderer()
+{
+	release();
+
+	if (visibilityProgram) glDeleteProgram(visibilityProgram);
+	if (computeProgram) glDeleteProgram(computeProgram);
+}
+
+void VisibilityRenderer::setup()
+{
+	supported = GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object;
+	if (!supported) return;
+
+	visibilityProgram = loadProgram(vector<string>{ "vertexShader.glsl" }, vector<string>{ "visShader.glsl", "effects.glsl" });
+	computeProgram = loadComputeProgram(vector<string>{ "visComputeShader.glsl", "effects.glsl" }, "#define NO_DISCARD");	// holes were already cut in the first pass
+
+	glUseProgram(computeProgram);
+	glUniform1i(glGetUniformLocation(computeProgram, "visibility"), 0);
+}
+
+bool VisibilityRenderer::available() const
+{
+	return supported;
+}
+
+GLuint VisibilityRenderer::geometryProgram() const
+{
+	return visibilityProgram;
+}
+
+GLuint VisibilityRenderer::shadingProgram() const
+{
+	return computeProgram;
+}
+
+void VisibilityRenderer::resize(int w, int h)
+{
+	release();
+
+	width = w;
+	height = h;
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	glGenTextures(1, &visibilityTexture);
+	glBindTexture(GL_TEXTURE_2D, visibilityTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);		// integer textures cannot be filtered
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, visibilityTexture, 0);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+	//the compute pass writes an image, copied to the window through its own framebuffer
+	glGenFramebuffers(1, &resultFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, resultFramebuffer);
+
+	glGenTextures(1, &resultTexture);
+	glBindTexture(GL_TEXTURE_2D, resultTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);			// immutable: required for image load/store
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resultTexture, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VisibilityRenderer::release()
+{
+	for (GLuint* texture : { &visibilityTexture, &resultTexture })
+	{
+		if (*texture) glDeleteTextures(1, texture);
+		*texture = 0;
+	}
+
+	for (GLuint* target : { &framebuffer, &resultFramebuffer })
+	{
+		if (*target) glDeleteFramebuffers(1, target);
+		*target = 0;
+	}
+
+	if (depthBuffer) glDeleteRenderbuffers(1, &depthBuffer);
+	depthBuffer = 0;
+}
+
+void VisibilityRenderer::drawVisibility(const Mesh& mesh)
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (viewport[2] != width || viewport[3] != height || framebuffer == 0) resize(viewport[2], viewport[3]);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	GLuint none[4] = { 0, 0, 0, 0 };					// triangle 0 = background
+	glClearBufferuiv(GL_COLOR, 0, none);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	glUseProgram(visibilityProgram);
+	mesh.draw();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VisibilityRenderer::shade()
+{
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+	glUseProgram(computeProgram);
+	glUniform4fv(glGetUniformLocation(computeProgram, "background"), 1, clearColor);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, visibilityTexture);
+	glBindImageTexture(0, resultTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+	glDispatchCompute((width + TILE - 1) / TILE, (height + TILE - 1) / TILE, 1);
+	glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);			// the copy below reads what the compute pass wrote
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, resultFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VisibilityRenderer::draw(const Mesh& mesh)
+{
+	if (!supported) return;
+
+	//the compute pass reads the vertices the triangle ids refer to
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mesh.vertexData());
+
+	drawVisibility(mesh);
+	shade();
+}
+
+VisibilityStats VisibilityRenderer::compare(const Mesh& mesh, GLuint forwardProgram)
+{
+	VisibilityStats stats;
+	if (!supported) return stats;
+
+	GpuTimer timer;
+	InvocationCounter invocations;
+
+	//forward, as drawn normally
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glUseProgram(forwardProgram);
+
+	timer.begin();
+	invocations.begin();
+	mesh.draw();
+	invocations.end();
+	timer.end();
+	stats.forwardMs = timer.result();
+	stats.forwardInvocations = invocations.result();
+
+	//visibility buffer, pass by pass
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mesh.vertexData());
+
+	timer.begin();
+	drawVisibility(mesh);
+	timer.end();
+	stats.visibilityMs = timer.result();
+
+	timer.begin();
+	shade();
+	timer.end();
+	stats.shadingMs = timer.result();
+
+	//quad overshading: every 2x2 quad runs 4 fragment shaders for each triangle that touches it
+	vector<GLuint> ids((size_t)width * height * 4);
+	glBindTexture(GL_TEXTURE_2D, visibilityTexture);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, ids.data());
+
+	long long quadInvocations = 0;
+	for (int y = 0; y < height; y += 2)
+	{
+		for (int x = 0; x < width; x += 2)
+		{
+			set<GLuint> triangles;
+			for (int i = 0; i < 4; i++)
+			{
+				int px = x + (i & 1);
+				int py = y + (i >> 1);
+				if (px >= width || py >= height) continue;
+
+				GLuint triangle = ids[((size_t)py * width + px) * 4];
+				if (triangle == 0) continue;
+
+				triangles.insert(triangle);
+				stats.pixels++;
+			}
+			quadInvocations += 4 * (long long)triangles.size();
+		}
+	}
+
+	if (stats.pixels > 0) stats.quadOvershading = (double)quadInvocations / stats.pixels;
+	return stats;
+}
+
+ostream& operator<<(ostream& os, const VisibilityStats& stats)
+{
+	os << "Visibility buffer: " << stats.pixels << " pixels shaded once each, forward quads would run " << stats.quadOvershading
+	   << " fragment shaders per pixel";
+
+	if (stats.forwardInvocations >= 0 && stats.pixels > 0)
+		os << " (measured " << stats.forwardInvocations << " forward, " << (double)stats.forwardInvocations / stats.pixels << " per pixel with overdraw)";
+
+	os << endl << "  forward " << stats.forwardMs << " ms, visibility buffer " << stats.visibilityMs + stats.shadingMs << " ms ("
+	   << stats.visibilityMs << " ids + " << stats.shadingMs << " shading)";
+
+	return os;
+}
@@ -0,0 +1,96 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include <iostream>
+#include <GL/glew.h>
+#include "Mesh.h"
+#include "GpuResources.h"
+using namespace std;
+
+/*
+* Forward drawing against the visibility buffer path, for the same mesh and effect (see VisibilityRenderer::compare())
+*/
+struct VisibilityStats
+{
+	int pixels = 0;						// pixels covered by the mesh
+	double quadOvershading = 0;			// fragment shader runs per covered pixel in 2x2 quads (4 per quad for each triangle in it)
+	long long forwardInvocations = -1;	// fragment shader runs measured on the forward path (overdraw included, -1 = not supported)
+	double forwardMs = -1;				// GPU time of the forward draw
+	double visibilityMs = -1;			// GPU time of the visibility pass...
+	double shadingMs = -1;				// ...and of the compute pass
+};
+
+ostream& operator<<(ostream& os, const VisibilityStats& stats);
+
+
+/*
+* Visibility buffer path: triangles only write their id and barycentrics per pixel, then a compute shader
+* over 8x8 tiles rebuilds each pixel's attributes from the vertex buffer and runs the effect exactly once.
+* Fragment shaders run in 2x2 quads, so a tiny triangle costs up to 4 effect runs per pixel it covers;
+* here the cost only depends on the pixels.
+*
+* Needs GL 4.3 (compute shaders, storage buffers): check available(). Draws single meshes.
+*/
+class VisibilityRenderer
+{
+private:
+	GLuint framebuffer = 0;				// visibility buffer and its depth
+	GLuint visibilityTexture = 0;		// triangle + 1, barycentrics, effect + 1
+	GLuint depthBuffer = 0;
+	GLuint resultFramebuffer = 0;		// compute output (copied to the window)
+	GLuint resultTexture = 0;
+	int width = 0;						// size the targets were created with
+	int height = 0;
+
+	GLuint visibilityProgram = 0;		// first pass (same vertex shader as forward drawing)
+	GLuint computeProgram = 0;			// second pass
+	bool supported = false;
+
+	/*
+	* (Re)creates the targets for the given size
+	*/
+	void resize(int w, int h);
+
+	/*
+	* Deletes the targets
+	*/
+	void release();
+
+	/*
+	* The two passes: ids and barycentrics of the mesh into the visibility buffer, then shading into the window
+	*/
+	void drawVisibility(const Mesh& mesh);
+	void shade();
+
+public:
+	VisibilityRenderer() = default;
+	~VisibilityRenderer();
+
+	VisibilityRenderer(const VisibilityRenderer&) = delete;
+	VisibilityRenderer& operator=(const VisibilityRenderer&) = delete;
+
+	/*
+	* Builds the programs of both passes when compute shaders are supported (requires an openGL context)
+	*/
+	void setup();
+	bool available() const;
+
+	/*
+	* Programs of both passes (both need the same uniforms as forward drawing)
+	*/
+	GLuint geometryProgram() const;
+	GLuint shadingProgram() const;
+
+	/*
+	* Draws the mesh into the window
+	*/
+	void draw(const Mesh& mesh);
+
+	/*
+	* Draws the mesh forward with 'forwardProgram' then through the visibility buffer (left in the window),
+	* timing both and measuring quad overshading. Slow (waits for the GPU).
+	*/
+	VisibilityStats compare(const Mesh& mesh, GLuint forwardProgram);
+};
+
+#endif
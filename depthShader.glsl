@@ -0,0 +1,8 @@
+#version 410 core
+
+// Depth prepass: only fills the depth buffer (color writes are off), so the expensive effects
+// can then run with GL_EQUAL for the one nearest fragment of each pixel. Used with vertexShader.glsl.
+
+void main()
+{
+}
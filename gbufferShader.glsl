@@ -0,0 +1,29 @@
+#version 410 core
+
+// First pass of deferred shading: stores what the effects need for each visible pixel,
+// so the (expensive) effect runs once per pixel in resolveShader.glsl instead of once per fragment.
+
+uniform int currFunc;           // effect that will shade the fragment (stored with it)
+uniform int objectId = 1;       // which draw the fragment belongs to (for overdraw statistics)
+
+in  vec3   fragmentColor;       // interpolated values from vertexShader.glsl
+in  vec3   fragmentNormal;
+in  vec4   fragmentCoord;
+
+layout(location = 0) out vec4 gColor;       // rgb: vertex color
+layout(location = 1) out vec4 gNormal;      // xyz: normal, w: objectId
+layout(location = 2) out vec4 gCoord;       // xyz: effect coords, w: effect + 1 (0 = background)
+
+
+bool stripVisible(vec3 currCoord);          // from effects.glsl
+
+
+void main()
+{
+    //function2 cuts holes in the mesh: those fragments must not hide what is behind them
+    if (currFunc == 2 && !stripVisible(fragmentCoord.xyz)) discard;
+
+    gColor = vec4(fragmentColor, 1);
+    gNormal = vec4(fragmentNormal, objectId);
+    gCoord = vec4(fragmentCoord.xyz, currFunc + 1);
+}
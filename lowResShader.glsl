@@ -0,0 +1,53 @@
+#version 410 core
+
+// Reduced resolution effects: runs the effect once per block of scale x scale pixels (for the effects
+// in lowResMask), reading the G-buffer at the block's center. upsampleShader.glsl spreads the results
+// back over the full resolution pixels. Lighting is not done here.
+
+uniform sampler2D gColor;       // G-buffer from gbufferShader.glsl
+uniform sampler2D gNormal;
+uniform sampler2D gCoord;
+
+uniform int scale;              // full resolution pixels per reduced pixel (along each axis)
+uniform int lowResMask;         // bit n set: effect n runs at reduced resolution
+
+vec3 fragmentColor;             // same names as the forward inputs, so effects.glsl works unchanged
+vec3 fragmentNormal;
+vec4 fragmentCoord;
+
+layout(location = 0) out vec4 lowColor;     // rgb: effect color
+layout(location = 1) out vec4 lowNormal;    // xyz: effect normal
+layout(location = 2) out vec4 lowCoord;     // G-buffer coords and effect of the pixel the effect ran for (0 = none)
+layout(location = 3) out vec4 lowGuide;     // xyz: G-buffer normal of that pixel (surface orientation for upsampling)
+
+
+void runEffect(int func, out vec3 color, out vec3 normal);     // from effects.glsl
+
+
+void main()
+{
+    ivec2 pixel = min(ivec2(gl_FragCoord.xy) * scale + scale / 2, textureSize(gCoord, 0) - 1);
+
+    vec4 coord = texelFetch(gCoord, pixel, 0);
+    int func = int(coord.w) - 1;
+
+    lowColor = vec4(0);
+    lowNormal = vec4(0);
+    lowCoord = vec4(0);
+    lowGuide = vec4(0);
+
+    if (coord.w == 0 || (lowResMask & (1 << func)) == 0) return;      // nothing here, or effect runs at full resolution
+
+    fragmentColor = texelFetch(gColor, pixel, 0).rgb;
+    fragmentNormal = texelFetch(gNormal, pixel, 0).xyz;
+    fragmentCoord = vec4(coord.xyz, 1);
+
+    vec3 color;
+    vec3 normal;
+    runEffect(func, color, normal);
+
+    lowColor = vec4(color, 1);
+    lowNormal = vec4(normal, 0);
+    lowCoord = coord;
+    lowGuide = vec4(fragmentNormal, 0);
+}
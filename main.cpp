@@ -1,11 +1,21 @@
 
 #include "shaderutils.h"
 #include "Mesh.h"
+#include "Scene.h"
+#include "Benchmark.h"
+#include "Deferred.h"
+#include "Visibility.h"
+#include "utils.h"
+#include "Image.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <GL/glew.h>
 #include <GL/freeglut.h> 
 
 
 Mesh mesh("pov/cat.pov");           // global mesh variable
+Scene scene;                        // scene read from a scene file (drawn instead of mesh when not empty)
 float angle = 0;                    // angle of rotation updated on idle
 
 int currFunc = 0;                   // global function choice : function_() 
@@ -20,6 +30,25 @@ bool forwardFlag = true;            // flag to reverse direction of effect flow
 bool rFlag = true;                  //flag to toggle Y-Axis rotation
 
 GLint program;                      // global program variable
+GLint forwardProgram;               // program drawing (and shading) the meshes in one pass, for effects that never discard
+GLint discardProgram;               // same, for the effect that discards (no early depth testing)
+GLint depthProgram;                 // depth prepass: no shading at all
+
+bool prepassFlag = false;           // flag to toggle the depth prepass
+InvocationCounter prepassCounter;   // fragment shader runs of the single mesh's prepass / effect pass
+InvocationCounter effectCounter;
+long long prepassInvocations = -1;
+long long effectInvocations = -1;
+
+DeferredRenderer deferred;          // two pass shading: effects run once per pixel
+bool deferredFlag = false;          // flag to toggle deferred shading
+bool overdrawFlag = false;          // flag to count fragments per draw (for overdraw statistics)
+GLuint overdrawQuery = 0;           // fragments of the single mesh
+bool compareFlag = false;           // flag to compare the alternative path with its reference on the next frame
+
+VisibilityRenderer visibility;      // ids + barycentrics per pixel, then effects in a compute shader (no quad overshading)
+bool visibilityFlag = false;        // flag to toggle the visibility buffer path (single mesh, forward)
+bool sheetFlag = false;             // flag to show every effect at once in a 3x3 grid (one geometry pass)
 
 
 // load the shader program and load the shape
@@ -29,7 +58,14 @@ void init(void)
   glEnable( GL_DEPTH_TEST );              
 
   // load the shaders and combine into shader program; enable use of program
-  program = loadProgram( "vertexShader.glsl", "fragmentShader.glsl" );
+  program = loadProgram( vector<string>{ "vertexShader.glsl" }, vector<string>{ "fragmentShader.glsl", "effects.glsl" }, "#define NO_DISCARD" );
+  forwardProgram = program;
+  discardProgram = loadProgram( vector<string>{ "vertexShader.glsl" }, vector<string>{ "fragmentShader.glsl", "effects.glsl" } );
+  depthProgram = loadProgram( "vertexShader.glsl", "depthShader.glsl" );
+  scene.setDiscardProgram( discardProgram );
+
+  deferred.setup();
+  visibility.setup();
   glUseProgram( program );
 
   //setup data and data layout buffers for the mesh
@@ -37,10 +73,9 @@ void init(void)
 }
 
 
-void display(void)
+// pass the user's choices to the active program
+void setUniforms()
 {
-  glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
-  
   // get current active program -- created in init() -- needed to access shader variables
   glGetIntegerv( GL_CURRENT_PROGRAM, &program );
 
@@ -70,13 +105,252 @@ void display(void)
   
   GLuint flowFlag = glGetUniformLocation(program, "flow");
   glUniform1i(flowFlag, flow);
+}
 
+
+// draw the single mesh: depth first then the effect (GL_EQUAL), counting the fragment shader runs of both
+void drawPrepassed()
+{
+  glUseProgram( depthProgram );
+  glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+  prepassCounter.begin();
+  mesh.draw();
+  prepassCounter.end();
+  glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+
+  glUseProgram( forwardProgram );
+  glDepthFunc( GL_EQUAL );
+  glDepthMask( GL_FALSE );
+  effectCounter.begin();
   mesh.draw();
+  effectCounter.end();
+  glDepthFunc( GL_LESS );
+  glDepthMask( GL_TRUE );
+
+  prepassInvocations = prepassCounter.result();
+  effectInvocations = effectCounter.result();
+}
 
+
+// draw the frame into the back buffer
+void drawFrame()
+{
+  glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+  // every program that may draw this frame gets the user's choices
+  vector<GLuint> programs = deferred.shadingPrograms();
+  programs.insert( programs.end(), { (GLuint)forwardProgram, (GLuint)discardProgram, (GLuint)depthProgram, deferred.geometryProgram() } );
+  if (visibility.available()) programs.insert( programs.end(), { visibility.geometryProgram(), visibility.shadingProgram() } );
+
+  for (GLuint each : programs)
+  {
+    glUseProgram( each );
+    setUniforms();
+  }
+
+  // the effect that discards gets its own program, so the others keep early depth testing
+  GLint meshProgram = currFunc == 2 ? discardProgram : forwardProgram;
+  // contact sheet: a single G-buffer shaded by every effect
+  if (sheetFlag)
+  {
+    deferred.beginSheet();
+    if (scene.empty()) mesh.draw();
+    else scene.draw( 0, angle, deferred.geometryProgram() );
+
+    deferred.resolveSheet();
+    return;
+  }
+
+  bool prepass = prepassFlag && !deferredFlag;
+  bool visible = visibilityFlag && !deferredFlag && scene.empty() && visibility.available();
+
+  // deferred: meshes only fill the G-buffer here, shading happens in resolve()
+  if (deferredFlag) deferred.beginGeometry();
+  else glUseProgram( meshProgram );
+
+  if (scene.empty())
+  {
+    if (overdrawFlag) glBeginQuery(GL_SAMPLES_PASSED, overdrawQuery);
+
+    if (visible && compareFlag) cout << visibility.compare( mesh, meshProgram ) << endl;
+    else if (visible) visibility.draw( mesh );
+    else if (prepass && currFunc != 2) drawPrepassed();
+    else mesh.draw();
+
+    if (overdrawFlag) glEndQuery(GL_SAMPLES_PASSED);
+  }
+  else if (prepass) scene.drawPrepassed(currFunc, angle, depthProgram);
+  else scene.draw(currFunc, angle, deferredFlag ? deferred.geometryProgram() : 0);
+
+  deferred.setView( angle, frame );
+  if (deferredFlag && compareFlag) cout << deferred.compareReduced() << endl;
+  else if (deferredFlag) deferred.resolve();
+  compareFlag = false;
+}
+
+
+void display(void)
+{
+  drawFrame();
   glutSwapBuffers();
 }
 
 
+// read the back buffer as 8 bit RGB, top row first
+vector<unsigned char> readFrame(int& width, int& height)
+{
+  GLint viewport[4];
+  glGetIntegerv( GL_VIEWPORT, viewport );
+  width = viewport[2];
+  height = viewport[3];
+
+  vector<unsigned char> pixels( (size_t)width * height * 3 );
+  glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+  glReadBuffer( GL_BACK );
+  glReadPixels( 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data() );
+
+  // window rows go bottom up
+  size_t row = (size_t)width * 3;
+  for (int y = 0; y < height / 2; y++) swap_ranges( pixels.begin() + y * row, pixels.begin() + (y + 1) * row, pixels.begin() + (height - 1 - y) * row );
+
+  return pixels;
+}
+
+
+// draw the contact sheet of every effect once and save it as a PPM image
+void saveSheet(const string& filename)
+{
+  sheetFlag = true;
+  drawFrame();
+  sheetFlag = false;
+
+  int width, height;
+  vector<unsigned char> pixels = readFrame( width, height );
+
+  Image sheet( width, height );
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      const unsigned char* pixel = &pixels[((size_t)y * width + x) * 3];
+      sheet.setPixel( x, y, Color(pixel[0] / 255.0f, pixel[1] / 255.0f, pixel[2] / 255.0f) );
+    }
+  }
+
+  sheet.saveImage( filename );
+  cout << "Saved the contact sheet of all effects to " << filename << endl;
+}
+
+
+// print fragments written per draw, and (deferred) how many pixels each ended up shading
+void printOverdraw()
+{
+  if (!overdrawFlag)
+  {
+    cout << "Overdraw: not measured (press 'v')" << endl;
+    return;
+  }
+
+  int draws = scene.empty() ? 1 : scene.drawCount();
+  vector<int> pixels;
+  if (deferredFlag) pixels = deferred.pixelsPerObject(draws);
+
+  GLuint meshFragments = 0;
+  if (scene.empty() && glIsQuery(overdrawQuery)) glGetQueryObjectuiv(overdrawQuery, GL_QUERY_RESULT, &meshFragments);
+
+  for (int i = 0; i < draws; i++)
+  {
+    int fragments = scene.empty() ? (int)meshFragments : scene.frameStats().fragments[i];
+
+    cout << "  draw " << i + 1 << " (mesh " << (scene.empty() ? 0 : scene.drawnMesh(i)) << "): ";
+    if (fragments < 0) { cout << "not drawn" << endl; continue; }
+
+    cout << fragments << " fragments";
+    if (!pixels.empty())
+    {
+      cout << ", " << pixels[i + 1] << " pixels shaded";
+      if (pixels[i + 1] > 0) cout << " (" << (float)fragments / pixels[i + 1] << " fragments per pixel forward)";
+    }
+    cout << endl;
+  }
+}
+
+
+// render every mesh in pov/ with every effect (contact sheet) at fixed settings, diff each against its golden
+// image in 'goldenDir' (created when missing) and record its time in 'historyFile'; returns the failures
+int runRegression(const string& goldenDir, const string& historyFile)
+{
+  const int TOLERANCE = 8;              // levels (out of 255) a channel may differ by (drivers round differently)
+  const double BAD_FRACTION = 0.001;    // share of an effect's pixels allowed beyond the tolerance
+  const double SLACK = 0.25;            // allowed slowdown against the recent timings
+  const int RUNS = 5;                   // each time is the best of this many frames
+
+  f = 15;
+  k = 3;
+  t = 0.1;
+  frame = 1;
+  flow = false;
+  angle = 0.5;
+
+  filesystem::create_directories( goldenDir );
+
+  vector<string> meshes;
+  for (const auto& entry : filesystem::directory_iterator( "pov" ))
+    if (entry.path().extension() == ".pov") meshes.push_back( entry.path().generic_string() );
+  sort( meshes.begin(), meshes.end() );
+
+  int failures = 0;
+  sheetFlag = true;
+
+  for (const string& file : meshes)
+  {
+    string name = filesystem::path( file ).stem().string();
+    mesh.reload( file );
+    mesh.setupBuffers();                // reload() keeps the old buffers: the new geometry must be uploaded into them
+
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++)
+    {
+      auto start = chrono::steady_clock::now();
+      drawFrame();
+      glFinish();
+      chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+      best = min( best, elapsed.count() );
+    }
+
+    int width, height;
+    vector<unsigned char> pixels = readFrame( width, height );
+    GoldenDiff diff = compareGolden( pixels, width, height, goldenDir + "/" + name + ".ppm", TOLERANCE, 3 );
+    bool fast = recordTiming( historyFile, name, best, SLACK );
+
+    cout << name << ": " << best << " ms";
+    if (!fast) cout << " (SLOWER than recent runs)";
+
+    if (diff.created) cout << ", golden image created" << endl;
+    else if (diff.sizeMismatch) cout << ", golden image has another size: FAILED" << endl;
+    else
+    {
+      cout << ", PSNR " << diff.psnr << " dB";
+      int cellPixels = (width / 3) * (height / 3);
+
+      for (int effect = 0; effect < 9; effect++)
+      {
+        if (diff.badPixels[effect] <= BAD_FRACTION * cellPixels) continue;
+        cout << ", effect " << effect << " differs (" << diff.badPixels[effect] << " pixels)";
+        failures++;
+      }
+      cout << endl;
+    }
+
+    failures += diff.sizeMismatch + !fast;
+  }
+
+  sheetFlag = false;
+  cout << (failures ? "Regression: " + to_string(failures) + " failures" : "Regression: passed") << endl;
+  return failures;
+}
+
+
 void idle()
 {
     if(rFlag) angle += 0.0001;
@@ -95,6 +369,9 @@ void keyboard( unsigned char key, int x, int y )
 {
     string filename;                        //filename for when user changes mesh
 
+    glUseProgram( forwardProgram );         //meshes (re)loaded below describe their attributes for it
+    deferred.invalidateHistory();           //most keys change what the effects show: cached results are stale
+
     switch (key)
     {
         case 27:
@@ -176,9 +453,110 @@ void keyboard( unsigned char key, int x, int y )
             cout << "Enter a file path to a mesh:" << endl;
             cin >> filename;
 
-            mesh = Mesh(filename);
-            mesh.setupBuffers();             //must setup buffers again after change mesh (only done once in init())
+            {
+                auto start = chrono::steady_clock::now();
+
+                mesh.reload(filename);
+                mesh.setupBuffers();             //must setup buffers again after change mesh (reuses the old mesh's buffers)
+                scene.clear();                   //back to drawing the single mesh
+
+                chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+                cout << "Loaded " << mesh.triangleCount() << " triangles in " << elapsed.count() << " ms, peak memory "
+                     << peakMemory() / (1024 * 1024) << " MB" << endl;
+                cout << "Mesh memory: " << mesh.cpuBytes() / 1024 << " KB CPU, " << mesh.gpuBytes() / 1024 << " KB GPU" << endl;
+            }
+
+            break;
+
+        case 'o':                           //stream a (large) mesh straight to the GPU, block by block
+            cout << "Enter a file path to a mesh to stream:" << endl;
+            cin >> filename;
+
+            {
+                auto start = chrono::steady_clock::now();
+
+                mesh.streamSource(filename, true);
+                scene.clear();
+
+                chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+                cout << "Streamed " << mesh.triangleCount() << " triangles in " << elapsed.count() << " ms, peak memory "
+                     << peakMemory() / (1024 * 1024) << " MB" << endl;
+            }
+
+            break;
+
+        case 'l':                           //load a scene file (drawn instead of the single mesh)
+            cout << "Enter a file path to a scene:" << endl;
+            cin >> filename;
+
+            scene.load(filename);
+            scene.setupBuffers();
+            break;
 
+        case 'p':                           //print draw/state counters of the last frame
+            if (scene.empty())
+            {
+                cout << "Frame: 1 draw calls, level of detail " << mesh.drawnLod() << ", "
+                     << mesh.lodTriangles(mesh.drawnLod()) << "/" << mesh.lodTriangles(0) << " triangles drawn" << endl;
+
+                if (prepassFlag && prepassInvocations >= 0)
+                    cout << "Depth prepass: " << prepassInvocations << " fragments, " << effectInvocations << " shaded by the effect ("
+                         << prepassInvocations - effectInvocations << " effect invocations avoided)" << endl;
+            }
+            else cout << scene.frameStats() << endl;
+            printOverdraw();
+            break;
+
+        case 'd':                           //toggle deferred shading (effects run once per visible pixel)
+            deferredFlag = !deferredFlag;
+            cout << (deferredFlag ? "Deferred" : "Forward") << " shading" << endl;
+            break;
+
+        case 'h':                           //toggle running the current effect at reduced resolution (deferred only)
+            deferred.setReduced( deferred.reducedEffects() ^ (1u << currFunc), deferred.reducedFactor() );
+            cout << "Effect " << currFunc << " at " << ((deferred.reducedEffects() >> currFunc & 1) ? "reduced" : "full") << " resolution" << endl;
+            break;
+
+        case 'H':                           //switch reduced resolution between half and quarter
+            deferred.setReduced( deferred.reducedEffects(), deferred.reducedFactor() == 2 ? 4 : 2 );
+            cout << "Reduced resolution: 1/" << deferred.reducedFactor() << endl;
+            break;
+
+        case 'q':                           //compare with the reference (next frame): reduced resolution effects (deferred) or the visibility buffer
+            if (!deferredFlag && !visibilityFlag) cout << "Nothing to compare: press 'd' (deferred shading) or 'g' (visibility buffer) first" << endl;
+            compareFlag = deferredFlag || visibilityFlag;
+            break;
+
+        case 'e':                           //toggle the contact sheet: every effect at once, from one geometry pass
+            sheetFlag = !sheetFlag;
+            break;
+
+        case 'E':                           //save the contact sheet
+            cout << "Enter a file path for the image (.ppm):" << endl;
+            cin >> filename;
+            saveSheet( filename );
+            break;
+
+        case 'g':                           //toggle the visibility buffer path (effects in a compute shader, single mesh)
+            visibilityFlag = !visibilityFlag;
+            if (!visibility.available()) cout << "Visibility buffer needs compute shaders (GL 4.3)" << endl;
+            else cout << "Visibility buffer " << (visibilityFlag ? "on" : "off") << (scene.empty() ? "" : " (single mesh only)") << endl;
+            break;
+
+        case 'c':                           //toggle the temporal cache (deferred only): a quarter of the pixels run their effect per frame
+            deferred.setTemporal( !deferred.temporalCache() );
+            cout << "Temporal cache " << (deferred.temporalCache() ? "on" : "off") << (deferredFlag ? "" : " (needs deferred shading, press 'd')") << endl;
+            break;
+
+        case 'z':                           //toggle depth prepass (effects then run once per pixel with GL_EQUAL)
+            prepassFlag = !prepassFlag;
+            cout << "Depth prepass " << (prepassFlag ? "on" : "off") << endl;
+            break;
+
+        case 'v':                           //toggle counting fragments per draw (see 'p')
+            overdrawFlag = !overdrawFlag;
+            if (overdrawQuery == 0) glGenQueries(1, &overdrawQuery);
+            scene.setMeasureOverdraw(overdrawFlag);
             break;
 
         default:
@@ -191,6 +569,73 @@ void keyboard( unsigned char key, int x, int y )
 
 int main(int argc, char* argv[])
 {
+  // command line benchmarks run without opening a window
+  if (argc > 2 && string(argv[1]) == "--bench-load")
+  {
+    benchLoad(argv[2]);
+    return 0;
+  }
+
+  if (argc > 2 && string(argv[1]) == "--bench-rays")
+  {
+    benchRays(argv[2], argc > 3 ? stoi(argv[3]) : 256);
+    return 0;
+  }
+
+  if (argc > 2 && string(argv[1]) == "--bench-shading")
+  {
+    benchShading(argv[2], argc > 3 ? stoi(argv[3]) : 1000000);
+    return 0;
+  }
+
+  if (argc > 2 && string(argv[1]) == "--bench-scene")
+  {
+    benchScene(argv[2], argc > 3 ? stoi(argv[3]) : 4000, argc > 4 ? stoi(argv[4]) : 128);
+    return 0;
+  }
+
+  if (argc > 2 && string(argv[1]) == "--bench-packets")
+  {
+    benchPackets(argv[2], argc > 3 ? stoi(argv[3]) : 4000, argc > 4 ? stoi(argv[4]) : 256, argc > 5 ? argv[5] : "");
+    return 0;
+  }
+
+  if (argc > 1 && string(argv[1]) == "--bench-mask")
+  {
+    benchMask(argc > 2 ? stoi(argv[2]) : 1024, argc > 3 ? stoi(argv[3]) : 1000000);
+    return 0;
+  }
+
+  if (argc > 1 && string(argv[1]) == "--bench-images")
+  {
+    benchImages(argc > 2 ? stoi(argv[2]) : 1024, argc > 3 ? stoi(argv[3]) : 1000000);
+    return 0;
+  }
+
+  if (argc > 1 && string(argv[1]) == "--bench-compression")
+  {
+    benchCompression(argc > 2 ? stoi(argv[2]) : 1024);
+    return 0;
+  }
+
+  if (argc > 1 && string(argv[1]) == "--bench-save")
+  {
+    benchSave(argc > 2 ? stoi(argv[2]) : 1024);
+    return 0;
+  }
+
+  if (argc > 2 && string(argv[1]) == "--bench-bvh-cache")
+  {
+    benchBvhCache(argv[2]);
+    return 0;
+  }
+
+  if (argc > 2 && string(argv[1]) == "--bench-instances")
+  {
+    benchInstances(argv[2], argc > 3 ? stoi(argv[3]) : 1000, argc > 4 ? stoi(argv[4]) : 128);
+    return 0;
+  }
+
   glutInit(&argc, argv);
 
   glutInitContextVersion( 3, 0 );
@@ -210,5 +655,31 @@ int main(int argc, char* argv[])
 
   init();
 
+  // soak test needs the context, so it runs once the window is up
+  if (argc > 2 && string(argv[1]) == "--soak-reload")
+  {
+    soakReload(mesh, argv[2], argc > 3 ? stoi(argv[3]) : 5000);
+    return 0;
+  }
+
+  // golden image and timing regressions of every mesh and effect (fails with a non zero exit code)
+  if (argc > 2 && string(argv[1]) == "--regress")
+  {
+    string history = argc > 3 ? argv[3] : string(argv[2]) + "/history.txt";
+    return runRegression( argv[2], history ) ? 1 : 0;
+  }
+
+  // contact sheet of every effect (for comparing effects between versions), optionally of another mesh
+  if (argc > 2 && string(argv[1]) == "--contact-sheet")
+  {
+    if (argc > 3)
+    {
+      mesh.reload( argv[3] );
+      mesh.setupBuffers();              // (reload() keeps the old buffers, without the new geometry)
+    }
+    saveSheet( argv[2] );
+    return 0;
+  }
+
   glutMainLoop();
 }
@@ -0,0 +1,32 @@
+#version 410 core
+
+// Second pass of deferred shading: runs the effect of each covered pixel exactly once,
+// reading its inputs from the G-buffer written by gbufferShader.glsl.
+
+uniform sampler2D gColor;
+uniform sampler2D gNormal;
+uniform sampler2D gCoord;
+
+vec3 fragmentColor;             // same names as the forward inputs, so effects.glsl works unchanged
+vec3 fragmentNormal;
+vec4 fragmentCoord;
+
+out vec3   finalColor;          // final color to use for drawing
+
+
+vec3 shade(int func);           // from effects.glsl
+
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+    vec4 coord = texelFetch(gCoord, pixel, 0);
+    if (coord.w == 0) discard;                  // no mesh here: keep the clear color
+
+    fragmentColor = texelFetch(gColor, pixel, 0).rgb;
+    fragmentNormal = texelFetch(gNormal, pixel, 0).xyz;
+    fragmentCoord = vec4(coord.xyz, 1);
+
+    finalColor = shade(int(coord.w) - 1);
+}
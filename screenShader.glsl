@@ -0,0 +1,9 @@
+#version 410 core
+
+// Full screen triangle for screen space passes (no vertex buffer: 3 vertices from gl_VertexID)
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);     // (0,0), (2,0), (0,2)
+    gl_Position = vec4(corner * 2 - 1, 0, 1);                        // covers [-1,1] x [-1,1]
+}
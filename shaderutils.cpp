@@ -5,6 +5,7 @@
 #include <fstream>
 #include <vector>
 #include <iostream>
+#include <iterator>
 
 #include <cstdlib>
 
@@ -17,12 +18,21 @@ void showProgramErrorLog( GLint program );
 
 GLuint loadProgram( const std::string& vertShaderFile,
 		    const std::string& fragShaderFile )
+{
+  return loadProgram( std::vector<std::string>{ vertShaderFile },
+		      std::vector<std::string>{ fragShaderFile } );
+}
+
+
+GLuint loadProgram( const std::vector<std::string>& vertShaderFiles,
+		    const std::vector<std::string>& fragShaderFiles,
+		    const std::string& defines )
 {
   // create vertex shader object
-  GLuint vertShader = loadShader( vertShaderFile, GL_VERTEX_SHADER );
+  GLuint vertShader = loadShader( vertShaderFiles, GL_VERTEX_SHADER, defines );
   
   // create fragment shader object
-  GLuint fragShader = loadShader( fragShaderFile, GL_FRAGMENT_SHADER );
+  GLuint fragShader = loadShader( fragShaderFiles, GL_FRAGMENT_SHADER, defines );
   
   // create shader program with the shaders
   GLuint program = glCreateProgram();
@@ -38,30 +48,68 @@ GLuint loadProgram( const std::string& vertShaderFile,
 }
 
 
+GLuint loadComputeProgram( const std::vector<std::string>& compShaderFiles,
+			   const std::string& defines )
+{
+  // create compute shader object
+  GLuint compShader = loadShader( compShaderFiles, GL_COMPUTE_SHADER, defines );
+
+  // create shader program with the shader
+  GLuint program = glCreateProgram();
+  glAttachShader( program, compShader );
+
+  // link program and show error log if did not succeed
+  glLinkProgram( program );
+
+  showProgramErrorLog( program );
+
+  return program;
+}
+
+
 GLuint loadShader( const std::string& fileName, GLenum shaderType )
 {
-  // initialize input stream
-  std::ifstream inFile( fileName.c_str(), std::ios::binary );
-
-  // determine shader file length and reserve space to read it in
-  inFile.seekg( 0, std::ios::end );
-  int fileLength = inFile.tellg();
-  std::vector<char> fileContent( fileLength + 1 );
-	
-  // read in shader file, set last character to NULL, close input stream
-  inFile.seekg( 0, std::ios::beg );
-  inFile.read( fileContent.data(), fileLength );
-  fileContent[fileLength] = '\0';
-  inFile.close();
-
-  // create the shader from the source in the given file
+  return loadShader( std::vector<std::string>{ fileName }, shaderType );
+}
+
+
+GLuint loadShader( const std::vector<std::string>& fileNames, GLenum shaderType,
+		   const std::string& defines )
+{
+  std::vector<std::string> sources;
+  std::vector<const char*> sourcesRaw;
+  std::string allNames;
+
+  for ( const std::string& fileName : fileNames ) {
+    // read in the whole shader file
+    std::ifstream inFile( fileName.c_str(), std::ios::binary );
+    std::string fileContent( ( std::istreambuf_iterator<char>( inFile ) ), std::istreambuf_iterator<char>() );
+    inFile.close();
+
+    sources.push_back( fileContent );
+    allNames += ( allNames.empty() ? "" : " + " ) + fileName;
+  }
+
+  // defines go right after the #version line (which must come first)
+  if ( !defines.empty() && !sources.empty() ) {
+    size_t lineEnd = sources[0].find( '\n' );
+    std::string rest = lineEnd == std::string::npos ? "" : sources[0].substr( lineEnd + 1 );
+
+    sources[0].resize( lineEnd == std::string::npos ? sources[0].size() : lineEnd + 1 );
+    sources.insert( sources.begin() + 1, { defines + "\n", rest } );
+  }
+
+  for ( const std::string& source : sources ) {
+    sourcesRaw.push_back( source.c_str() );
+  }
+
+  // create the shader from the sources in the given files (concatenated in order)
   GLuint shader = glCreateShader( shaderType );
-  const char* fileContentRaw = fileContent.data();
-  glShaderSource( shader, 1, &fileContentRaw, NULL );
+  glShaderSource( shader, (GLsizei)sourcesRaw.size(), sourcesRaw.data(), NULL );
 
   // compile the shader and show error log if compilation failed
   glCompileShader( shader );
-  showShaderErrorLog( shader, fileName );
+  showShaderErrorLog( shader, allNames );
 
   return shader;
 }
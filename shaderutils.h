@@ -3,6 +3,7 @@
 #define SHADERUTILS_H
 
 #include <string>
+#include <vector>
 
 #include <GL/glew.h>
 
@@ -12,5 +13,19 @@ GLuint loadProgram( const std::string& vertShaderFile,
 
 GLuint loadShader( const std::string& fileName, GLenum shaderType );
 
+// Builds each stage from several files, compiled as one source in the given order
+// (the first file of a stage holds its #version line, e.g. a stage file followed by effects.glsl).
+// 'defines' (e.g. "#define NO_DISCARD") is inserted right after the #version line.
+GLuint loadProgram( const std::vector<std::string>& vertShaderFiles,
+		    const std::vector<std::string>& fragShaderFiles,
+		    const std::string& defines = "" );
+
+GLuint loadShader( const std::vector<std::string>& fileNames, GLenum shaderType,
+		   const std::string& defines = "" );
+
+// Same for a compute program (GL 4.3 / ARB_compute_shader)
+GLuint loadComputeProgram( const std::vector<std::string>& compShaderFiles,
+			   const std::string& defines = "" );
+
 
 #endif
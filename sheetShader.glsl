@@ -0,0 +1,47 @@
+#version 410 core
+
+// Contact sheet: shows every effect side by side, from a single G-buffer (one geometry pass).
+// The window is split into a 3x3 grid, effect 0 at the top left through 8 at the bottom right;
+// each cell shows the whole G-buffer shrunk 3 times and shaded with its own effect.
+
+uniform sampler2D gColor;       // G-buffer from gbufferShader.glsl
+uniform sampler2D gNormal;
+uniform sampler2D gCoord;
+
+vec3 fragmentColor;             // same names as the forward inputs, so effects.glsl works unchanged
+vec3 fragmentNormal;
+vec4 fragmentCoord;
+
+out vec3   finalColor;          // final color to use for drawing
+
+
+const int GRID = 3;             // cells per row and per column
+
+
+vec3 shade(int func);                       // from effects.glsl
+bool stripVisible(vec3 currCoord);
+
+
+void main()
+{
+    ivec2 size = textureSize(gCoord, 0);
+    ivec2 cellSize = max(size / GRID, ivec2(1));
+
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 cell = min(pixel / cellSize, ivec2(GRID - 1));
+    ivec2 source = min((pixel - cell * cellSize) * GRID + GRID / 2, size - 1);     // center of the block this pixel stands for
+
+    int func = (GRID - 1 - cell.y) * GRID + cell.x;                                 // rows go top to bottom (window y goes up)
+
+    vec4 coord = texelFetch(gCoord, source, 0);
+    if (coord.w == 0) discard;                                                      // no mesh here: keep the clear color
+
+    //function2's holes show the background (the G-buffer only holds the nearest surface)
+    if (func == 2 && !stripVisible(coord.xyz)) discard;
+
+    fragmentColor = texelFetch(gColor, source, 0).rgb;
+    fragmentNormal = texelFetch(gNormal, source, 0).xyz;
+    fragmentCoord = vec4(coord.xyz, 1);
+
+    finalColor = shade(func);
+}
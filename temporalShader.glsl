@@ -0,0 +1,100 @@
+#version 410 core
+
+// Second pass of deferred shading with a temporal cache: each frame only a quarter of the pixels
+// (rotating checkerboard) run their effect, the rest reuse what the previous frame computed for the
+// same surface point. Meshes only rotate around Y and flowing effects only shift their coords by
+// frame * 1e-5, so the point's previous position is known exactly; a reused result must come from the
+// same draw, the same effect and (nearly) the same coords, otherwise (disocclusion, edits) it runs again.
+// Lighting always runs, since it depends on the current normal.
+
+uniform sampler2D gColor;           // G-buffer from gbufferShader.glsl
+uniform sampler2D gNormal;
+uniform sampler2D gCoord;
+
+uniform sampler2D historyColor;     // previous frame's effect results (written below)
+uniform sampler2D historyNormal;
+uniform sampler2D historyCoord;
+
+uniform float angle;                // rotation of this frame and of the history
+uniform float prevAngle;
+uniform int frame;                  // flow of this frame and of the history
+uniform int prevFrame;
+uniform bool historyValid;          // false on the first frame and after anything the history cannot follow
+uniform int phase;                  // checkerboard cell (0-3) that runs its effect this frame
+uniform float tolerance;            // how far (in coords) a reused result may be from the point it stands for
+
+vec3 fragmentColor;                 // same names as the forward inputs, so effects.glsl works unchanged
+vec3 fragmentNormal;
+vec4 fragmentCoord;
+
+layout(location = 0) out vec4 finalColor;       // lit color (copied to the window)
+layout(location = 1) out vec4 effectColor;      // rgb: effect color
+layout(location = 2) out vec4 effectNormal;     // xyz: effect normal, w: objectId
+layout(location = 3) out vec4 effectCoord;      // xyz: coords the effect result belongs to, w: effect + 1
+
+
+void runEffect(int func, out vec3 color, out vec3 normal);     // from effects.glsl
+vec3 computeFinalColor(vec3 currColor, vec3 currNormal);
+
+
+// rotation around Y, as in vertexShader.glsl
+mat3 rotateY(float a)
+{
+    return mat3(cos(a), 0, sin(a),
+                0,      1, 0,
+               -sin(a), 0, cos(a));
+}
+
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(gCoord, 0);
+
+    vec4 coord = texelFetch(gCoord, pixel, 0);
+    if (coord.w == 0) discard;                  // no mesh here: keep the clear color (and an empty history)
+
+    vec4 normalId = texelFetch(gNormal, pixel, 0);
+    fragmentColor = texelFetch(gColor, pixel, 0).rgb;
+    fragmentNormal = normalId.xyz;
+    fragmentCoord = vec4(coord.xyz, 1);
+
+    //the previous frame's effect at coords c showed what this frame shows at c - flow
+    vec3 flow = (frame - prevFrame) * 1e-5 * vec3(1, 1, 1);
+    vec3 wanted = coord.xyz + flow;
+
+    vec3 color;
+    vec3 normal;
+    vec3 source = coord.xyz;
+    bool reused = false;
+
+    bool refresh = (pixel.x & 1) + 2 * (pixel.y & 1) == phase;
+
+    if (historyValid && !refresh)
+    {
+        //no projection: the rotated coords are already in [-1, 1] screen space
+        vec2 previous = (rotateY(prevAngle) * wanted).xy;
+        ivec2 prevPixel = ivec2(floor((previous * 0.5 + 0.5) * size));
+
+        if (all(greaterThanEqual(prevPixel, ivec2(0))) && all(lessThan(prevPixel, size)))
+        {
+            vec4 historyAt = texelFetch(historyCoord, prevPixel, 0);
+            vec4 historyNormalId = texelFetch(historyNormal, prevPixel, 0);
+
+            if (historyAt.w == coord.w && historyNormalId.w == normalId.w && distance(historyAt.xyz, wanted) < tolerance)
+            {
+                color = texelFetch(historyColor, prevPixel, 0).rgb;
+                normal = rotateY(angle - prevAngle) * historyNormalId.xyz;      // normals turned with the mesh since
+                source = historyAt.xyz - flow;                                  // keep track of the drift, so it cannot build up
+                reused = true;
+            }
+        }
+    }
+
+    if (!reused) runEffect(int(coord.w) - 1, color, normal);
+
+    finalColor = vec4(computeFinalColor(color, normal), 1);
+    effectColor = vec4(color, 1);
+    effectNormal = vec4(normal, normalId.w);
+    effectCoord = vec4(source, coord.w);
+}
@@ -0,0 +1,91 @@
+#version 410 core
+
+// Second pass of deferred shading when some effects run at reduced resolution (lowResShader.glsl):
+// their color and normal are blended from the 4 nearest reduced pixels, each weighted by distance
+// and by how much its surface matches this pixel's (same effect, same plane, same orientation),
+// so edges do not bleed. Lighting, and effects at full resolution, run for every pixel.
+
+uniform sampler2D gColor;       // G-buffer from gbufferShader.glsl
+uniform sampler2D gNormal;
+uniform sampler2D gCoord;
+
+uniform sampler2D lowColor;     // reduced resolution results from lowResShader.glsl
+uniform sampler2D lowNormal;
+uniform sampler2D lowCoord;
+uniform sampler2D lowGuide;
+
+uniform int scale;
+uniform int lowResMask;
+
+vec3 fragmentColor;             // same names as the forward inputs, so effects.glsl works unchanged
+vec3 fragmentNormal;
+vec4 fragmentCoord;
+
+out vec3   finalColor;          // final color to use for drawing
+
+
+const float PLANE_SIGMA = 0.02;             // distance off this pixel's plane at which a sample's weight drops to ~60%
+const float NORMAL_POWER = 8;               // how quickly the weight drops as normals diverge
+const float MIN_WEIGHT = 1e-3;              // below this no sample matches: run the effect here instead
+
+
+void runEffect(int func, out vec3 color, out vec3 normal);     // from effects.glsl
+vec3 computeFinalColor(vec3 currColor, vec3 currNormal);
+
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+    vec4 coord = texelFetch(gCoord, pixel, 0);
+    if (coord.w == 0) discard;                  // no mesh here: keep the clear color
+
+    fragmentColor = texelFetch(gColor, pixel, 0).rgb;
+    fragmentNormal = texelFetch(gNormal, pixel, 0).xyz;
+    fragmentCoord = vec4(coord.xyz, 1);
+
+    int func = int(coord.w) - 1;
+    vec3 color = vec3(0);
+    vec3 normal = vec3(0);
+    float total = 0;
+
+    if ((lowResMask & (1 << func)) != 0)
+    {
+        //position of this pixel among the reduced pixels' centers, and the 2x2 block around it
+        vec2 lowPos = (vec2(pixel) + 0.5) / scale - 0.5;
+        ivec2 base = ivec2(floor(lowPos));
+        vec2 frac = lowPos - base;
+
+        vec3 n = normalize(fragmentNormal);
+
+        for (int j = 0; j < 2; j++)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                ivec2 low = clamp(base + ivec2(i, j), ivec2(0), textureSize(lowCoord, 0) - 1);
+                vec4 sampleCoord = texelFetch(lowCoord, low, 0);
+                if (sampleCoord.w != coord.w) continue;                         // other effect, or nothing
+
+                float plane = dot(sampleCoord.xyz - coord.xyz, n) / PLANE_SIGMA;
+                vec3 sampleNormal = normalize(texelFetch(lowGuide, low, 0).xyz);
+
+                float w = (i == 0 ? 1 - frac.x : frac.x) * (j == 0 ? 1 - frac.y : frac.y);
+                w *= exp(-0.5 * plane * plane);
+                w *= pow(max(dot(n, sampleNormal), 0), NORMAL_POWER);
+
+                color += w * texelFetch(lowColor, low, 0).rgb;
+                normal += w * texelFetch(lowNormal, low, 0).xyz;
+                total += w;
+            }
+        }
+    }
+
+    if (total > MIN_WEIGHT)
+    {
+        color /= total;
+        normal /= total;
+    }
+    else runEffect(func, color, normal);        // full resolution effect, or an edge no reduced pixel matches
+
+    finalColor = computeFinalColor(color, normal);
+}
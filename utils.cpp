@@ -1,6 +1,16 @@
 #include "utils.h"
 #include <cmath>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
 std::default_random_engine gen(time(0));                    //random engine, seeded with current time
 std::uniform_real_distribution<float> unif(0.0, 1.0);		//for generating random numbers in range 0-1
 
@@ -19,4 +29,48 @@ bool gt_zero(float value)
 float genFloat()
 {
     return unif(gen);
-}
\ No newline at end of file
+}
+
+size_t peakMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss;                                 // already in bytes
+#else
+    return usage.ru_maxrss * 1024;                          // kilobytes
+#endif
+#endif
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+double psnr(const unsigned char* a, const unsigned char* b, size_t count)
+{
+    double squared = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        double diff = (double)a[i] - b[i];
+        squared += diff * diff;
+    }
+
+    if (squared == 0 || count == 0) return INFINITY;
+
+    double mse = squared / count;
+    return 10 * log10(255.0 * 255.0 / mse);
+}
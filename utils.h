@@ -1,6 +1,8 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <cstddef>
+#include <cstdint>
 #include <numbers>
 #include <random>
 
@@ -11,5 +13,8 @@ const float PI = std::numbers::pi_v<float>;			//PI for use in EQs in all shapes
 bool eq_zero(float value);
 bool gt_zero(float value);
 float genFloat();									//generate random float in range 0 - 1
+size_t peakMemory();								//largest resident set size (bytes) of the process so far
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);	//FNV-1a hash of the bytes (pass a previous hash to continue it)
+double psnr(const unsigned char* a, const unsigned char* b, size_t count);	//peak signal to noise ratio (dB) of two 8 bit images, infinite when equal
 
 #endif
\ No newline at end of file
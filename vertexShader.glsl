@@ -2,17 +2,30 @@
 
 uniform float angle;        // received from application (updates on idle)
                             // uniform~shared by all for current draw cycle
+uniform mat4 model = mat4(1);   // world transform of the mesh being drawn (set per draw by a scene)
+uniform mat4 normalModel = mat4(1); // its normal matrix (transpose of the inverse, computed with it on the CPU)
+uniform bool ringModel = false; // true when a scene passes the transform through its ring buffer instead
+
+layout(std140) uniform Instance // per draw data, written by the scene into a persistently mapped buffer
+{
+    mat4 instanceModel;
+    mat4 instanceNormal;
+};
+
+layout(location = 0) in  vec3   vertexCoords;    // "vertex attribute" received from application
+                                            // we sent (x,y) but shader can promote to (x,y,z)
+layout(location = 1) in  vec3   vertexColor;    // (fixed locations: every program built on this shader
+layout(location = 2) in  vec3   vertexNorm;     //  shares the layout buffers of the meshes)
 
-in  vec3   vertexCoords;    // "vertex attribute" received from application
-                            // we sent (x,y) but shader can promote to (x,y,z)
-in  vec3   vertexColor;
-in  vec3   vertexNorm;
 
+invariant gl_Position;      // same position in every program using this shader (depth prepass + GL_EQUAL pass)
 
 out vec3   fragmentColor;   // color to send to next stage (fragment shader)
                             // should have the same name/type but with "in"
 out vec3   fragmentNormal;
 out vec4   fragmentCoord;
+flat out int fragmentTriangle;  // triangle and position in it, for the visibility buffer (visShader.glsl)
+out vec3   fragmentBary;        // (meshes are not indexed: vertex 3i + c is corner c of triangle i)
 
 void main()
 {
@@ -28,15 +41,21 @@ void main()
                         0, 0, 2, 0,
                         0, 0, 0, 1);
 
+    mat4 world = ringModel ? instanceModel : model;
+    mat3 normalWorld = mat3(ringModel ? instanceNormal : normalModel);
+
     //send actual vertex coord to fragmentShader
-    fragmentCoord = scale2X * vec4(vertexCoords, 1);            //will use for some functions in fragmentShader (do not want to special effect to rotate ON the mesh itself)
+    fragmentCoord = scale2X * world * vec4(vertexCoords, 1);            //will use for some functions in fragmentShader (do not want to special effect to rotate ON the mesh itself)
 	                                                                          
     gl_Position = rotY * fragmentCoord;                         // final vertex position (rotate and scale entire mesh)
     
 
     // send values to the fragment shader
     fragmentColor = vertexColor;                                //pass vertex color to fragment shader
-    fragmentNormal = vec3(rotY * vec4(vertexNorm,1));           // so as vertex rotates, normal follows (avoid dark spot on mesh)
+    fragmentNormal = vec3(rotY * vec4(normalize(normalWorld * vertexNorm),1));   // so as vertex rotates, normal follows (avoid dark spot on mesh)
+
+    fragmentTriangle = gl_VertexID / 3;
+    fragmentBary = vec3(equal(ivec3(gl_VertexID % 3), ivec3(0, 1, 2)));      // 1 for this corner, interpolates to barycentrics
 
 
 }
@@ -0,0 +1,74 @@
+#version 430 core
+
+// Second pass of the visibility buffer path: one invocation per pixel, in 8x8 tiles. It rebuilds what
+// vertexShader.glsl would have interpolated from the triangle's corners (read straight from the mesh's
+// vertex buffer) and runs the effect.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(std430, binding = 0) readonly buffer Vertices
+{
+    float vertexData[];         // Vertex (Vertex.h): point x y z w, color r g b, normal x y z
+};
+
+uniform usampler2D visibility;                          // from visShader.glsl
+layout(rgba8, binding = 0) writeonly uniform image2D result;
+
+uniform vec4 background;        // color of pixels no triangle covers
+uniform float angle;            // as in vertexShader.glsl
+uniform mat4 model = mat4(1);
+uniform mat4 normalModel = mat4(1);
+
+vec3 fragmentColor;             // same names as the forward inputs, so effects.glsl works unchanged
+vec3 fragmentNormal;
+vec4 fragmentCoord;
+
+
+const uint VERTEX_FLOATS = 10;  // floats per vertex, and where each attribute starts
+const uint COLOR_AT = 4;
+const uint NORMAL_AT = 7;
+
+
+vec3 shade(int func);           // from effects.glsl
+
+
+// attribute starting 'at' floats into the vertex, blended over the triangle's corners
+vec3 interpolate(uint first, vec3 bary, uint at)
+{
+    vec3 value = vec3(0);
+    for (uint corner = 0; corner < 3; corner++)
+    {
+        uint base = (first + corner) * VERTEX_FLOATS + at;
+        value += bary[corner] * vec3(vertexData[base], vertexData[base + 1], vertexData[base + 2]);
+    }
+    return value;
+}
+
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, imageSize(result)))) return;       // partial tile at the edge
+
+    uvec4 visible = texelFetch(visibility, pixel, 0);
+    if (visible.x == 0)
+    {
+        imageStore(result, pixel, background);
+        return;
+    }
+
+    uint first = (visible.x - 1) * 3;
+    vec3 bary = vec3(0, uintBitsToFloat(visible.y), uintBitsToFloat(visible.z));
+    bary.x = 1 - bary.y - bary.z;
+
+    //same transforms as vertexShader.glsl (no projection, so linear interpolation is exact)
+    mat3 rotY = mat3(cos(angle), 0, sin(angle),
+                     0,          1, 0,
+                    -sin(angle), 0, cos(angle));
+
+    fragmentCoord = vec4(2 * (model * vec4(interpolate(first, bary, 0), 1)).xyz, 1);
+    fragmentColor = interpolate(first, bary, COLOR_AT);
+    fragmentNormal = rotY * normalize(mat3(normalModel) * interpolate(first, bary, NORMAL_AT));
+
+    imageStore(result, pixel, vec4(shade(int(visible.w) - 1), 1));
+}
@@ -0,0 +1,25 @@
+#version 410 core
+
+// First pass of the visibility buffer path: stores only which triangle covers each pixel and where in it,
+// so that shading (visComputeShader.glsl) runs once per pixel, never for the helper fragments that
+// fill the 2x2 quads along the edges of tiny triangles.
+
+uniform int currFunc;           // effect that will shade the fragment (stored with it)
+
+in  vec4   fragmentCoord;       // interpolated values from vertexShader.glsl
+flat in int fragmentTriangle;
+in  vec3   fragmentBary;
+
+layout(location = 0) out uvec4 visibility;  // x: triangle + 1 (0 = background), y, z: barycentrics of corners 1 and 2 (float bits), w: effect + 1
+
+
+bool stripVisible(vec3 currCoord);          // from effects.glsl
+
+
+void main()
+{
+    //function2 cuts holes in the mesh: those fragments must not hide what is behind them
+    if (currFunc == 2 && !stripVisible(fragmentCoord.xyz)) discard;
+
+    visibility = uvec4(fragmentTriangle + 1, floatBitsToUint(fragmentBary.y), floatBitsToUint(fragmentBary.z), currFunc + 1);
+}